@@ -0,0 +1,448 @@
+/* batch.cpp
+   Batch engine: runs many instances of one program, BATCH_LANES at a time,
+   in lockstep over the fast interpreter's decoded text. Each step picks
+   the lowest PC among the running lanes and executes that instruction for
+   every lane at it. While the lanes agree on the PC that is all of them;
+   after a data-dependent branch sends them different ways, the lanes at
+   the lowest PC run on alone (a group of one lane is plain scalar
+   execution) until the others' PCs are reached and the groups merge again.
+
+   Register and ALU work is written as loops over the lanes with a mask,
+   which the compiler turns into vector instructions (see BATCHFLAGS in
+   the Makefile). Loads, stores, atomics and system calls go lane by lane,
+   since every lane has its own memory.
+*/
+
+#include "batch.h"
+#include "syscall.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define MAX_BATCH_SHOW 16
+
+// One register or data word: set from the input file, or shown
+struct BatchItem {
+  int reg;                    // Register number, or -1 for a data word
+  unsigned int addr;
+  unsigned int value;
+};
+
+static FastSim program;       // Loaded image and decoded text shared by every lane
+static BatchSim batch;
+
+static void lane_stop(BatchSim *b, unsigned int *active, int l, int status) {
+  b->status[l] = (unsigned char)status;
+  b->stops++;
+  active[l] = 0;
+}
+
+// Loads of size bytes for the active lanes; lanes with a bad address fault
+static void batch_load(BatchSim *b, const DecodedInstr &d, unsigned int *active,
+                       unsigned int size, unsigned int *v) {
+  for (int l = 0; l < BATCH_LANES; l++) {
+    if (!active[l]) continue;
+    int idx = mem_index(b->R[d.rs1][l] + d.imm, size);
+    if (idx < 0) {
+      lane_stop(b, active, l, BATCH_FAULT);
+      continue;
+    }
+    const unsigned char *p = b->MEM[l] + idx;
+    switch (d.op) {
+      case F_LB:  v[l] = (unsigned int)(signed char)p[0]; break;
+      case F_LBU: v[l] = p[0]; break;
+      case F_LH:  v[l] = (unsigned int)(short)(p[0] | p[1] << 8); break;
+      case F_LHU: v[l] = p[0] | p[1] << 8; break;
+      default:    std::memcpy(&v[l], p, 4); break;
+    }
+  }
+}
+
+// Stores; the lanes share one decoded text, so a store into the text
+// segment faults
+static void batch_store(BatchSim *b, const DecodedInstr &d, unsigned int *active,
+                        unsigned int size) {
+  for (int l = 0; l < BATCH_LANES; l++) {
+    if (!active[l]) continue;
+    int idx = mem_index(b->R[d.rs1][l] + d.imm, size);
+    if (idx < TEXT_SIZE) {
+      lane_stop(b, active, l, BATCH_FAULT);
+      continue;
+    }
+    std::memcpy(b->MEM[l] + idx, &b->R[d.rs2][l], size);
+  }
+}
+
+static void batch_atomic(BatchSim *b, const DecodedInstr &d, unsigned int *active,
+                         unsigned int *v) {
+  for (int l = 0; l < BATCH_LANES; l++) {
+    if (!active[l]) continue;
+    unsigned int a = b->R[d.rs1][l];
+    int idx = (a & 3) ? -1 : mem_index(a, 4);
+    if (idx < 0 || (d.op != F_LR && idx < TEXT_SIZE)) {
+      lane_stop(b, active, l, BATCH_FAULT);
+      continue;
+    }
+    unsigned int old;
+    std::memcpy(&old, b->MEM[l] + idx, 4);
+    unsigned int stored = b->R[d.rs2][l];
+    if (d.op == F_LR) {
+      v[l] = old;
+      b->reserved[l] = true;
+      b->reserved_addr[l] = a;
+      continue;
+    }
+    if (d.op == F_SC) {
+      bool ok = b->reserved[l] && b->reserved_addr[l] == a;
+      b->reserved[l] = false;
+      v[l] = ok ? 0 : 1;
+      if (!ok) continue;
+    } else {
+      stored = fast_amo_value(d.instr, old, stored);
+      v[l] = old;
+    }
+    std::memcpy(b->MEM[l] + idx, &stored, 4);
+  }
+}
+
+// System calls, one lane at a time through the shared syscall layer
+static void batch_ecall(BatchSim *b, unsigned int *active) {
+  for (int l = 0; l < BATCH_LANES; l++) {
+    if (!active[l]) continue;
+    unsigned int R[32];
+    for (int r = 0; r < 32; r++)
+      R[r] = b->R[r][l];
+    if (!syscall_dispatch(R, b->MEM[l], b->instret[l])) {
+      b->exit_code[l] = syscall_exit_code;
+      lane_stop(b, active, l, BATCH_EXITED);
+      continue;
+    }
+    for (int r = 1; r < 32; r++)
+      b->R[r][l] = R[r];
+  }
+}
+
+// Executes d at pc for the lanes whose active entry is 1
+static void batch_exec(BatchSim *b, const DecodedInstr &d, unsigned int pc, unsigned int *active) {
+  const unsigned int *A = b->R[d.rs1];
+  const unsigned int *B = b->R[d.rs2];
+  const unsigned int imm = (unsigned int)d.imm;
+  const unsigned int seq = pc + d.len;
+  const unsigned int target = pc + imm;
+  unsigned int v[BATCH_LANES];
+  unsigned int next[BATCH_LANES];
+
+  for (int l = 0; l < BATCH_LANES; l++) {
+    v[l] = 0;
+    next[l] = seq;
+  }
+  switch (d.op) {
+    case F_LUI:   for (int l = 0; l < BATCH_LANES; l++) v[l] = imm; break;
+    case F_AUIPC: for (int l = 0; l < BATCH_LANES; l++) v[l] = target; break;
+    case F_JAL:
+      for (int l = 0; l < BATCH_LANES; l++) {
+        v[l] = seq;
+        next[l] = target;
+      }
+      break;
+    case F_JALR:
+      for (int l = 0; l < BATCH_LANES; l++) {
+        v[l] = seq;
+        next[l] = (A[l] + imm) & ~1u;
+      }
+      break;
+    case F_BEQ:  for (int l = 0; l < BATCH_LANES; l++) next[l] = (A[l] == B[l]) ? target : seq; break;
+    case F_BNE:  for (int l = 0; l < BATCH_LANES; l++) next[l] = (A[l] != B[l]) ? target : seq; break;
+    case F_BLT:  for (int l = 0; l < BATCH_LANES; l++) next[l] = ((int)A[l] < (int)B[l]) ? target : seq; break;
+    case F_BGE:  for (int l = 0; l < BATCH_LANES; l++) next[l] = ((int)A[l] >= (int)B[l]) ? target : seq; break;
+    case F_BLTU: for (int l = 0; l < BATCH_LANES; l++) next[l] = (A[l] < B[l]) ? target : seq; break;
+    case F_BGEU: for (int l = 0; l < BATCH_LANES; l++) next[l] = (A[l] >= B[l]) ? target : seq; break;
+    case F_LB: case F_LBU: batch_load(b, d, active, 1, v); break;
+    case F_LH: case F_LHU: batch_load(b, d, active, 2, v); break;
+    case F_LW: batch_load(b, d, active, 4, v); break;
+    case F_SB: batch_store(b, d, active, 1); break;
+    case F_SH: batch_store(b, d, active, 2); break;
+    case F_SW: batch_store(b, d, active, 4); break;
+    case F_ADDI:  for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] + imm; break;
+    case F_SLTI:  for (int l = 0; l < BATCH_LANES; l++) v[l] = ((int)A[l] < (int)imm) ? 1 : 0; break;
+    case F_SLTIU: for (int l = 0; l < BATCH_LANES; l++) v[l] = (A[l] < imm) ? 1 : 0; break;
+    case F_XORI:  for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] ^ imm; break;
+    case F_ORI:   for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] | imm; break;
+    case F_ANDI:  for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] & imm; break;
+    case F_SLLI:  for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] << imm; break;
+    case F_SRLI:  for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] >> imm; break;
+    case F_SRAI:  for (int l = 0; l < BATCH_LANES; l++) v[l] = (unsigned int)((int)A[l] >> imm); break;
+    case F_ADD:   for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] + B[l]; break;
+    case F_SUB:   for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] - B[l]; break;
+    case F_SLL:   for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] << (B[l] & 0x1F); break;
+    case F_SLT:   for (int l = 0; l < BATCH_LANES; l++) v[l] = ((int)A[l] < (int)B[l]) ? 1 : 0; break;
+    case F_SLTU:  for (int l = 0; l < BATCH_LANES; l++) v[l] = (A[l] < B[l]) ? 1 : 0; break;
+    case F_XOR:   for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] ^ B[l]; break;
+    case F_SRL:   for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] >> (B[l] & 0x1F); break;
+    case F_SRA:   for (int l = 0; l < BATCH_LANES; l++) v[l] = (unsigned int)((int)A[l] >> (B[l] & 0x1F)); break;
+    case F_OR:    for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] | B[l]; break;
+    case F_AND:   for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] & B[l]; break;
+    case F_MULDIV:
+      if (FUNCT3(d.instr) == 0) {
+        for (int l = 0; l < BATCH_LANES; l++) v[l] = A[l] * B[l];
+      } else {
+        for (int l = 0; l < BATCH_LANES; l++)
+          if (active[l]) v[l] = alu_compute(d.instr, A[l], B[l]);
+      }
+      break;
+    case F_LR: case F_SC: case F_AMO: batch_atomic(b, d, active, v); break;
+    case F_ECALL: batch_ecall(b, active); break;
+    case F_EXIT:
+      for (int l = 0; l < BATCH_LANES; l++) {
+        if (!active[l]) continue;
+        b->exit_code[l] = 0;
+        lane_stop(b, active, l, BATCH_EXITED);
+      }
+      return;
+    default:
+      for (int l = 0; l < BATCH_LANES; l++)
+        if (active[l]) lane_stop(b, active, l, BATCH_FAULT);
+      return;
+  }
+
+  if (d.rd != 0) {
+    unsigned int *D = b->R[d.rd];
+    for (int l = 0; l < BATCH_LANES; l++)
+      D[l] = active[l] ? v[l] : D[l];
+  }
+  for (int l = 0; l < BATCH_LANES; l++) {
+    b->PC[l] = active[l] ? next[l] : b->PC[l];
+    b->instret[l] += active[l];
+  }
+}
+
+// Lanes still active after a step, which are the ones it retired an
+// instruction on
+static unsigned int lanes_active(const unsigned int *active) {
+  unsigned int n = 0;
+  for (int l = 0; l < BATCH_LANES; l++)
+    n += active[l];
+  return n;
+}
+
+// Runs the lanes in active, which are all the running lanes and share pc,
+// while they stay together: until a branch or JALR splits them, one of
+// them stops or budget instructions have run
+static void batch_run_converged(BatchSim *b, const DecodedInstr *code, unsigned int pc,
+                                unsigned int *active, unsigned int n,
+                                unsigned long long budget) {
+  unsigned int stops = b->stops;
+  int lead = 0;
+  while (!active[lead])
+    lead++;
+  for (; budget > 0; budget--) {
+    if (pc >= TEXT_SIZE || (pc & 1))
+      return;
+    const DecodedInstr &d = code[pc >> 1];
+    batch_exec(b, d, pc, active);
+    b->steps++;
+    if (b->stops != stops) {
+      b->lane_instrs += lanes_active(active);
+      return;
+    }
+    b->lane_instrs += n;
+    pc = b->PC[lead];
+    if ((d.op >= F_BEQ && d.op <= F_BGEU) || d.op == F_JALR) {
+      bool split = false;
+      for (int l = 0; l < BATCH_LANES; l++)
+        split |= active[l] && b->PC[l] != pc;
+      if (split)
+        return;
+    }
+  }
+}
+
+// Steps the running lanes until all of them have stopped
+static void batch_run(BatchSim *b, const DecodedInstr *code, unsigned long long limit) {
+  unsigned int active[BATCH_LANES];
+  for (;;) {
+    unsigned int running = 0;
+    unsigned int pc = 0;
+    for (int l = 0; l < BATCH_LANES; l++) {
+      if (b->status[l] != BATCH_RUNNING) continue;
+      if (b->instret[l] >= limit) {
+        b->status[l] = BATCH_LIMIT;
+        continue;
+      }
+      if (running == 0 || b->PC[l] < pc) pc = b->PC[l];
+      running++;
+    }
+    if (running == 0) return;
+
+    unsigned int n = 0;
+    unsigned long long budget = ~0ULL;
+    for (int l = 0; l < BATCH_LANES; l++) {
+      active[l] = (b->status[l] == BATCH_RUNNING && b->PC[l] == pc) ? 1 : 0;
+      n += active[l];
+      if (active[l] && limit - b->instret[l] < budget)
+        budget = limit - b->instret[l];
+    }
+    if (pc >= TEXT_SIZE || (pc & 1)) {
+      for (int l = 0; l < BATCH_LANES; l++)
+        if (active[l]) lane_stop(b, active, l, BATCH_FAULT);
+      continue;
+    }
+    if (n == running) {
+      batch_run_converged(b, code, pc, active, n, budget);
+      continue;
+    }
+    batch_exec(b, code[pc >> 1], pc, active);
+    b->steps++;
+    b->lane_instrs += lanes_active(active);
+  }
+}
+
+// Parses "x<n>" or an address into item; value follows after '=' if
+// with_value is set
+static bool parse_item(const char *tok, bool with_value, BatchItem *item) {
+  char *end;
+  item->reg = -1;
+  item->addr = 0;
+  item->value = 0;
+  if (tok[0] == 'x') {
+    item->reg = (int)std::strtol(tok + 1, &end, 10);
+    if (end == tok + 1 || item->reg < 0 || item->reg > 31) return false;
+  } else {
+    item->addr = (unsigned int)std::strtoul(tok, &end, 0);
+    if (end == tok || mem_index(item->addr, 4) < 0) return false;
+  }
+  if (!with_value)
+    return *end == '\0';
+  if (*end != '=') return false;
+  tok = end + 1;
+  item->value = (unsigned int)std::strtoul(tok, &end, 0);
+  return end != tok && *end == '\0';
+}
+
+// Reads the input file: one instance per line, its items appended to
+// items and the index of its first item appended to first
+static void load_inputs(const char *input_file, std::vector<BatchItem> &items,
+                        std::vector<size_t> &first) {
+  FILE *fp = std::fopen(input_file, "r");
+  if (fp == nullptr) {
+    std::printf("Error opening batch input file %s\n", input_file);
+    std::exit(1);
+  }
+  char line[1024];
+  int line_no = 0;
+  while (std::fgets(line, sizeof(line), fp) != nullptr) {
+    line_no++;
+    char *p = line + std::strspn(line, " \t\r\n");
+    if (*p == '#') continue;
+    first.push_back(items.size());
+    for (char *tok = std::strtok(p, " \t\r\n"); tok != nullptr; tok = std::strtok(nullptr, " \t\r\n")) {
+      BatchItem item;
+      if (!parse_item(tok, true, &item)) {
+        std::printf("Invalid item \"%s\" on line %d of %s\n", tok, line_no, input_file);
+        std::exit(1);
+      }
+      items.push_back(item);
+    }
+    if (first.back() == items.size() && *p == '\0')
+      first.pop_back();       // Blank line
+  }
+  std::fclose(fp);
+}
+
+static unsigned int item_value(const BatchSim *b, int l, const BatchItem &item) {
+  unsigned int v;
+  if (item.reg >= 0)
+    return b->R[item.reg][l];
+  std::memcpy(&v, b->MEM[l] + mem_index(item.addr, 4), 4);
+  return v;
+}
+
+int run_batch(const char *file_name, const char *input_file, const char *show,
+              unsigned long long max_instrs) {
+  std::vector<BatchItem> items;
+  std::vector<size_t> first;
+  load_inputs(input_file, items, first);
+  first.push_back(items.size());
+  size_t instances = first.size() - 1;
+
+  BatchItem shown[MAX_BATCH_SHOW];
+  int num_shown = 0;
+  char list[256];
+  std::snprintf(list, sizeof(list), "%s", show);
+  for (char *tok = std::strtok(list, ","); tok != nullptr; tok = std::strtok(nullptr, ",")) {
+    if (num_shown == MAX_BATCH_SHOW || !parse_item(tok, false, &shown[num_shown])) {
+      std::printf("Invalid -batch-show list %s\n", show);
+      return 1;
+    }
+    num_shown++;
+  }
+
+  fast_reset(&program);
+  fast_load(&program, file_name);
+  unsigned long long limit = max_instrs ? max_instrs : ~0ULL;
+  BatchSim *b = &batch;
+  unsigned long long total_steps = 0, total_lane_instrs = 0;
+  int faulted = 0;
+
+  std::printf("%-8s %-18s %14s", "instance", "status", "instructions");
+  for (int i = 0; i < num_shown; i++) {
+    char name[16];
+    if (shown[i].reg >= 0) std::snprintf(name, sizeof(name), "x%d", shown[i].reg);
+    else std::snprintf(name, sizeof(name), "0x%08X", shown[i].addr);
+    std::printf(" %12s", name);
+  }
+  std::printf("\n");
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t base = 0; base < instances; base += BATCH_LANES) {
+    std::memset(b->R, 0, sizeof(b->R));
+    b->steps = b->lane_instrs = 0;
+    for (int l = 0; l < BATCH_LANES; l++) {
+      b->PC[l] = 0;
+      b->instret[l] = 0;
+      b->exit_code[l] = 0;
+      b->reserved[l] = false;
+      b->status[l] = (base + l < instances) ? BATCH_RUNNING : BATCH_IDLE;
+      if (b->status[l] == BATCH_IDLE) continue;
+      std::memcpy(b->MEM[l], program.MEM, MEM_SIZE);
+      for (size_t i = first[base + l]; i < first[base + l + 1]; i++) {
+        const BatchItem &item = items[i];
+        if (item.reg > 0)
+          b->R[item.reg][l] = item.value;
+        else if (item.reg < 0)
+          std::memcpy(b->MEM[l] + mem_index(item.addr, 4), &item.value, 4);
+      }
+    }
+
+    batch_run(b, program.code, limit);
+    total_steps += b->steps;
+    total_lane_instrs += b->lane_instrs;
+
+    syscall_flush();
+    for (int l = 0; l < BATCH_LANES && base + l < instances; l++) {
+      char status[32];
+      if (b->status[l] == BATCH_EXITED)
+        std::snprintf(status, sizeof(status), "exit %d", b->exit_code[l]);
+      else if (b->status[l] == BATCH_FAULT)
+        std::snprintf(status, sizeof(status), "fault 0x%08X", b->PC[l]);
+      else
+        std::snprintf(status, sizeof(status), "limit");
+      if (b->status[l] == BATCH_FAULT) faulted = 1;
+      std::printf("%-8zu %-18s %14llu", base + l, status, b->instret[l]);
+      for (int i = 0; i < num_shown; i++)
+        std::printf(" %12d", (int)item_value(b, l, shown[i]));
+      std::printf("\n");
+    }
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+  double ms = std::chrono::duration<double, std::milli>(end - start).count();
+  std::printf("\n=== BATCH (%zu instances, %d lanes) ===\n", instances, BATCH_LANES);
+  std::printf("%llu instructions in %llu steps (%.1f%% lane utilization), %.3f ms, %.1f MIPS\n",
+              total_lane_instrs, total_steps,
+              total_steps ? 100.0 * total_lane_instrs / (total_steps * BATCH_LANES) : 0.0, ms,
+              ms > 0 ? total_lane_instrs / (ms * 1000.0) : 0.0);
+  return faulted;
+}
@@ -0,0 +1,38 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "fastsim.h"
+
+// Instances executed in lockstep; 8 lanes of 32-bit registers fill one
+// 256-bit vector, 16 one 512-bit vector
+#define BATCH_LANES 8
+
+enum BatchStatus { BATCH_IDLE, BATCH_RUNNING, BATCH_EXITED, BATCH_FAULT, BATCH_LIMIT };
+
+// BATCH_LANES instances of one program. Registers are stored lane-minor
+// (R[reg][lane]) so an instruction is applied to every lane with one
+// vector operation; each lane has its own memory.
+struct BatchSim {
+  unsigned int R[32][BATCH_LANES];
+  unsigned int PC[BATCH_LANES];
+  unsigned long long instret[BATCH_LANES];
+  unsigned char status[BATCH_LANES];  // BatchStatus
+  int exit_code[BATCH_LANES];
+  bool reserved[BATCH_LANES];         // LR.W reservation is held
+  unsigned int reserved_addr[BATCH_LANES];
+  unsigned long long steps;           // Instructions issued, to any number of lanes
+  unsigned long long lane_instrs;     // Sum over steps of the lanes they ran on
+  unsigned int stops;                 // Lanes stopped so far
+  unsigned char MEM[BATCH_LANES][MEM_SIZE];
+};
+
+// Runs file_name once per line of input_file, BATCH_LANES instances at a
+// time. Each line sets the initial state of one instance with
+// "x<n>=<value>" (register) and "<addr>=<value>" (data word) items. Every
+// instance stops at the exit word, an exit system call, a fault or after
+// max_instrs instructions (0 for no limit). show lists the registers and
+// words, in the same syntax without values, printed for each instance.
+int run_batch(const char *file_name, const char *input_file, const char *show,
+              unsigned long long max_instrs);
+
+#endif
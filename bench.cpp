@@ -0,0 +1,187 @@
+/* bench.cpp
+   Microbenchmarks of the simulator's hot-path primitives: immediate
+   extraction, decode()/execute() dispatch, word access with the
+   DATA_OFFSET remapping and .mc line parsing.
+
+   Build with "make bench" and run ./myRISCVSim_bench [filter]. Each line
+   of output is "<name> <iterations> <ns/op>", in a fixed order, so runs
+   before and after a change can be diffed directly.
+*/
+
+#include "myRISCVSim.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// Minimum wall time of one measurement
+#define MIN_TIME_NS 100000000.0
+#define REPETITIONS 3
+
+// Keeps results alive so the compiler cannot drop the measured work
+static volatile unsigned int sink;
+
+// Instruction words covering every format, indexed with (i & 15)
+static const unsigned int sample_instrs[16] = {
+  0x003100b3,  // add   x1, x2, x3
+  0x40628233,  // sub   x4, x5, x6
+  0x029403b3,  // mul   x7, x8, x9
+  0x02c5c533,  // div   x10, x11, x12
+  0x00a38313,  // addi  x6, x7, 10
+  0xfff60713,  // addi  x14, x12, -1
+  0x00229593,  // slli  x11, x5, 2
+  0x0009aa03,  // lw    x20, 0(x19)
+  0x00752023,  // sw    x7, 0(x10)
+  0x014aa023,  // sw    x20, 0(x21)
+  0x00728863,  // beq   x5, x7, 16
+  0x000c1663,  // bne   x24, x0, 12
+  0xfd1ff06f,  // jal   x0, -48
+  0x028a8a67,  // jalr  x20, 40(x21)
+  0x10000537,  // lui   x10, 0x10000
+  0x00001517   // auipc x10, 1
+};
+
+static const char *sample_lines[4] = {
+  "0x00000000 0x00500293\n",
+  "0x10000004 0x0000000A\n",
+  "0x0 0x003100b3 , add   x1, x2, x3 # 0110011-000-0000000-00001-00010-00011-NULL\n",
+  "\n"
+};
+
+static char bench_mem[MEM_SIZE];
+
+static unsigned int bench_imm_i(unsigned long long iters) {
+  unsigned int acc = 0;
+  for (unsigned long long i = 0; i < iters; i++)
+    acc += imm_i(sample_instrs[i & 15]);
+  return acc;
+}
+
+static unsigned int bench_imm_s(unsigned long long iters) {
+  unsigned int acc = 0;
+  for (unsigned long long i = 0; i < iters; i++)
+    acc += imm_s(sample_instrs[i & 15]);
+  return acc;
+}
+
+static unsigned int bench_imm_b(unsigned long long iters) {
+  unsigned int acc = 0;
+  for (unsigned long long i = 0; i < iters; i++)
+    acc += imm_b(sample_instrs[i & 15]);
+  return acc;
+}
+
+static unsigned int bench_imm_j(unsigned long long iters) {
+  unsigned int acc = 0;
+  for (unsigned long long i = 0; i < iters; i++)
+    acc += imm_j(sample_instrs[i & 15]);
+  return acc;
+}
+
+static unsigned int bench_imm_u(unsigned long long iters) {
+  unsigned int acc = 0;
+  for (unsigned long long i = 0; i < iters; i++)
+    acc += imm_u(sample_instrs[i & 15]);
+  return acc;
+}
+
+// decode() on the mixed instruction sample, trace disabled
+static unsigned int bench_decode(unsigned long long iters) {
+  for (unsigned long long i = 0; i < iters; i++) {
+    set_IR(sample_instrs[i & 15]);
+    decode();
+  }
+  return (unsigned int)iters;
+}
+
+// decode() + execute(); PC is pinned so branches and jumps stay in text
+static unsigned int bench_decode_execute(unsigned long long iters) {
+  for (unsigned long long i = 0; i < iters; i++) {
+    set_PC(0x100);
+    set_IR(sample_instrs[i & 15]);
+    decode();
+    execute();
+  }
+  return (unsigned int)iters;
+}
+
+// Alternates text and data addresses to exercise both sides of the remap
+static unsigned int bench_read_word(unsigned long long iters) {
+  unsigned int acc = 0;
+  for (unsigned long long i = 0; i < iters; i++) {
+    unsigned int offset = (unsigned int)(i * 4) & (TEXT_SIZE - 4);
+    unsigned int addr = (i & 1) ? DATA_OFFSET + offset : offset;
+    acc += read_word(bench_mem, addr);
+  }
+  return acc;
+}
+
+static unsigned int bench_write_word(unsigned long long iters) {
+  for (unsigned long long i = 0; i < iters; i++) {
+    unsigned int offset = (unsigned int)(i * 4) & (TEXT_SIZE - 4);
+    unsigned int addr = (i & 1) ? DATA_OFFSET + offset : offset;
+    write_word(bench_mem, addr, (unsigned int)i);
+  }
+  return (unsigned int)bench_mem[8];
+}
+
+static unsigned int bench_parse_mc_line(unsigned long long iters) {
+  unsigned int acc = 0;
+  for (unsigned long long i = 0; i < iters; i++) {
+    unsigned int address = 0, word = 0;
+    if (parse_mc_line(sample_lines[i & 3], &address, &word))
+      acc += address ^ word;
+  }
+  return acc;
+}
+
+struct Benchmark {
+  const char *name;
+  unsigned int (*fn)(unsigned long long iters);
+};
+
+static const Benchmark benchmarks[] = {
+  {"imm_i", bench_imm_i},
+  {"imm_s", bench_imm_s},
+  {"imm_b", bench_imm_b},
+  {"imm_j", bench_imm_j},
+  {"imm_u", bench_imm_u},
+  {"decode", bench_decode},
+  {"decode_execute", bench_decode_execute},
+  {"read_word", bench_read_word},
+  {"write_word", bench_write_word},
+  {"parse_mc_line", bench_parse_mc_line}
+};
+
+static double time_ns(const Benchmark &b, unsigned long long iters) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  sink = b.fn(iters);
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+// Grows the iteration count until one run takes MIN_TIME_NS, then keeps
+// the fastest of REPETITIONS runs
+static void run_benchmark(const Benchmark &b) {
+  unsigned long long iters = 1000;
+  while (time_ns(b, iters) < MIN_TIME_NS && iters < (1ULL << 40))
+    iters *= 4;
+  double best = time_ns(b, iters);
+  for (int r = 1; r < REPETITIONS; r++) {
+    double t = time_ns(b, iters);
+    if (t < best) best = t;
+  }
+  std::printf("%-16s %14llu %10.3f ns/op\n", b.name, iters, best / iters);
+}
+
+int main(int argc, char **argv) {
+  const char *filter = (argc > 1) ? argv[1] : nullptr;
+
+  trace_enabled = 0;
+  reset_proc();
+
+  for (unsigned int i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+    if (filter == nullptr || std::strstr(benchmarks[i].name, filter) != nullptr)
+      run_benchmark(benchmarks[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,113 @@
+/* coherence.cpp
+   MSI/MESI cost model for per-hart private data caches. Every line of MEM
+   has a state in every hart's cache; an access is charged as a hit, an
+   upgrade, a cache-to-cache transfer or a memory fetch, and updates the
+   states of the other harts' copies as the protocol requires.
+*/
+
+#include "coherence.h"
+#include <cstdio>
+#include <cstring>
+
+#define NUM_LINES (MEM_SIZE / COHERENCE_LINE_SIZE)
+
+enum LineState { LINE_I, LINE_S, LINE_E, LINE_M };
+
+struct HartCacheStats {
+  unsigned long long reads, writes;
+  unsigned long long hits, misses, upgrades;
+  unsigned long long transfers;      // Misses served by another cache
+  unsigned long long invalidations;  // Copies invalidated in other caches
+  unsigned long long writebacks;     // Modified lines downgraded for a reader
+  unsigned long long cycles;
+};
+
+static unsigned char line_state[MAX_HARTS][NUM_LINES];
+static HartCacheStats cache_stats[MAX_HARTS];
+static int num_harts = 1;
+static int protocol = PROTO_MESI;
+
+void coherence_reset(int harts, int proto) {
+  std::memset(line_state, LINE_I, sizeof(line_state));
+  std::memset(cache_stats, 0, sizeof(cache_stats));
+  num_harts = harts;
+  protocol = proto;
+}
+
+int coherence_protocol(const char *name) {
+  if (std::strcmp(name, "msi") == 0) return PROTO_MSI;
+  if (std::strcmp(name, "mesi") == 0) return PROTO_MESI;
+  return -1;
+}
+
+void coherence_access(int hart, unsigned int idx, bool write) {
+  unsigned int line = idx / COHERENCE_LINE_SIZE;
+  unsigned char &state = line_state[hart][line];
+  HartCacheStats &st = cache_stats[hart];
+  write ? st.writes++ : st.reads++;
+
+  // Hits: any valid copy for a read, M (or E, silently) for a write
+  if ((!write && state != LINE_I) || (write && (state == LINE_M || state == LINE_E))) {
+    st.hits++;
+    st.cycles += COST_HIT;
+    if (write) state = LINE_M;
+    return;
+  }
+
+  bool other_copies = false, other_modified = false;
+  for (int h = 0; h < num_harts; h++) {
+    if (h == hart || line_state[h][line] == LINE_I) continue;
+    other_copies = true;
+    if (line_state[h][line] == LINE_M) other_modified = true;
+  }
+
+  if (write) {
+    for (int h = 0; h < num_harts; h++) {
+      if (h != hart && line_state[h][line] != LINE_I) {
+        line_state[h][line] = LINE_I;
+        st.invalidations++;
+      }
+    }
+    if (state == LINE_S) {
+      st.upgrades++;
+      st.cycles += COST_UPGRADE;
+    } else {
+      st.misses++;
+      if (other_modified) st.transfers++;
+      st.cycles += other_modified ? COST_TRANSFER : COST_MEMORY;
+    }
+    state = LINE_M;
+    return;
+  }
+
+  // Read miss: a modified copy is written back and supplied by its owner
+  st.misses++;
+  if (other_modified) {
+    st.transfers++;
+    st.writebacks++;
+    st.cycles += COST_TRANSFER;
+  } else {
+    st.cycles += COST_MEMORY;
+  }
+  for (int h = 0; h < num_harts; h++) {
+    if (h != hart && line_state[h][line] != LINE_I)
+      line_state[h][line] = LINE_S;
+  }
+  state = (protocol == PROTO_MESI && !other_copies) ? LINE_E : LINE_S;
+}
+
+unsigned long long coherence_cycles(int hart) {
+  return cache_stats[hart].cycles;
+}
+
+void coherence_report() {
+  std::printf("\n=== COHERENCE (%s, %d-byte lines) ===\n",
+              protocol == PROTO_MESI ? "MESI" : "MSI", COHERENCE_LINE_SIZE);
+  std::printf("  Hart     Reads    Writes      Hits    Misses  Upgrades  Transfers  Invals  Writebacks     Cycles\n");
+  for (int h = 0; h < num_harts; h++) {
+    const HartCacheStats &st = cache_stats[h];
+    std::printf("  %4d %9llu %9llu %9llu %9llu %9llu %10llu %7llu %11llu %10llu\n", h,
+                st.reads, st.writes, st.hits, st.misses, st.upgrades, st.transfers,
+                st.invalidations, st.writebacks, st.cycles);
+  }
+}
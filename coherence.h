@@ -0,0 +1,26 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include "myRISCVSim.h"
+
+#define MAX_HARTS 8
+#define COHERENCE_LINE_SIZE 32
+
+enum CoherenceProtocol { PROTO_MSI, PROTO_MESI };
+
+// Cost in cycles of each kind of access to a private cache
+#define COST_HIT       1
+#define COST_UPGRADE   5    // S -> M, invalidating the other sharers
+#define COST_TRANSFER  10   // Line supplied by another hart's cache
+#define COST_MEMORY    30   // Line fetched from memory
+
+// Per-hart private caches of unlimited capacity over MEM, kept coherent by
+// MSI or MESI. Only the cost of each access is modelled; data always
+// comes from the shared memory image.
+void coherence_reset(int harts, int protocol);
+int coherence_protocol(const char *name);   // -1 if unknown
+void coherence_access(int hart, unsigned int idx, bool write);
+unsigned long long coherence_cycles(int hart);
+void coherence_report();
+
+#endif
@@ -0,0 +1,185 @@
+/* cosim.cpp
+   Differential co-simulation: steps two execution engines in lockstep and
+   reports the first retired instruction (or basic block) on which they
+   disagree about the PC, the destination register or the stored data.
+*/
+
+#include "cosim.h"
+#include "myRISCVSim.h"
+#include "fastsim.h"
+#include "pipeline.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Adapter over the step interface of one engine
+struct CosimEngine {
+  const char *name;
+  void (*load)(const char *file_name);
+  bool (*step)(RetireInfo *ri);
+  void (*regs)(unsigned int *R);
+};
+
+static FastSim fast_state;
+
+static void staged_load(const char *file_name) {
+  reset_proc();
+  load_program_memory(const_cast<char*>(file_name));
+}
+
+static void fast_engine_load(const char *file_name) {
+  fast_reset(&fast_state);
+  fast_load(&fast_state, file_name);
+}
+
+static bool fast_engine_step(RetireInfo *ri) {
+  return fast_step(&fast_state, ri);
+}
+
+static void fast_engine_regs(unsigned int *R) {
+  std::memcpy(R, fast_state.R, sizeof(fast_state.R));
+}
+
+static void pipeline_load(const char *file_name) {
+  reset_pipeline();
+  load_pipeline_program(file_name);
+}
+
+static const CosimEngine engines[] = {
+  {"staged", staged_load, step_RISCVsim, get_regs},
+  {"fast", fast_engine_load, fast_engine_step, fast_engine_regs},
+  {"pipeline", pipeline_load, pipeline_step, pipeline_regs}
+};
+
+static const CosimEngine *find_engine(const char *name) {
+  for (unsigned int i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+    if (std::strcmp(engines[i].name, name) == 0)
+      return &engines[i];
+  }
+  std::printf("Unknown engine %s (expected staged, fast or pipeline)\n", name);
+  std::exit(1);
+}
+
+static bool same_retire(const RetireInfo &a, const RetireInfo &b) {
+  return a.pc == b.pc && a.instr == b.instr && a.len == b.len && a.next_pc == b.next_pc &&
+         a.rd == b.rd && a.rd_value == b.rd_value && a.mem_size == b.mem_size &&
+         a.mem_addr == b.mem_addr && a.mem_value == b.mem_value;
+}
+
+static void print_retire(const char *name, const RetireInfo &ri) {
+  std::printf("  %-9s pc=0x%08X instr=0x%08X next=0x%08X", name, ri.pc, ri.instr, ri.next_pc);
+  if (ri.rd != 0)
+    std::printf(" x%u=0x%08X", ri.rd, ri.rd_value);
+  if (ri.mem_size != 0)
+    std::printf(" mem%u[0x%08X]=0x%08X", ri.mem_size * 8, ri.mem_addr, ri.mem_value);
+  std::printf("\n");
+}
+
+// Per-block comparison state of one engine
+struct BlockState {
+  unsigned long long signature;   // FNV-1a over every retirement in the block
+  unsigned long long count;
+  RetireInfo last;
+  bool running;
+};
+
+static unsigned long long fold(unsigned long long h, unsigned int word) {
+  return (h ^ word) * 1099511628211ULL;
+}
+
+// Steps an engine up to and including its next branch or jump
+static void run_block(const CosimEngine *e, BlockState *b, unsigned long long limit) {
+  RetireInfo ri;
+  b->signature = 14695981039346656037ULL;
+  b->count = 0;
+  while (b->count < limit) {
+    if (!e->step(&ri)) {
+      b->running = false;
+      return;
+    }
+    b->signature = fold(b->signature, ri.pc);
+    b->signature = fold(b->signature, ri.instr);
+    b->signature = fold(b->signature, ri.next_pc);
+    b->signature = fold(b->signature, ri.rd << 8 | ri.mem_size);
+    b->signature = fold(b->signature, ri.rd_value);
+    b->signature = fold(b->signature, ri.mem_addr);
+    b->signature = fold(b->signature, ri.mem_value);
+    b->count++;
+    b->last = ri;
+    unsigned int opcode = OPCODE(ri.instr);
+    if (opcode == 0x63 || opcode == 0x6F || opcode == 0x67)
+      return;
+  }
+}
+
+static void print_reg_diff(const CosimEngine *a, const CosimEngine *b) {
+  unsigned int Ra[32], Rb[32];
+  a->regs(Ra);
+  b->regs(Rb);
+  for (int i = 1; i < 32; i++) {
+    if (Ra[i] != Rb[i])
+      std::printf("  x%-2d %s=0x%08X %s=0x%08X\n", i, a->name, Ra[i], b->name, Rb[i]);
+  }
+}
+
+int run_cosim(const char *engine_a, const char *engine_b, const char *file_name,
+              bool per_block, unsigned long long max_instrs) {
+  const CosimEngine *a = find_engine(engine_a);
+  const CosimEngine *b = find_engine(engine_b);
+  if (a == b) {
+    std::printf("Co-simulation needs two different engines\n");
+    std::exit(1);
+  }
+  trace_enabled = 0;
+  a->load(file_name);
+  b->load(file_name);
+
+  unsigned long long limit = max_instrs ? max_instrs : ~0ULL;
+  unsigned long long n = 0;
+
+  if (!per_block) {
+    RetireInfo ra, rb;
+    while (n < limit) {
+      bool more_a = a->step(&ra);
+      bool more_b = b->step(&rb);
+      if (!more_a || !more_b) {
+        if (more_a != more_b) {
+          std::printf("COSIM: DIVERGENCE after %llu instructions: %s halted\n", n,
+                      more_a ? b->name : a->name);
+          print_retire(more_a ? a->name : b->name, more_a ? ra : rb);
+          return 1;
+        }
+        break;
+      }
+      if (!same_retire(ra, rb)) {
+        std::printf("COSIM: DIVERGENCE at instruction #%llu\n", n);
+        print_retire(a->name, ra);
+        print_retire(b->name, rb);
+        return 1;
+      }
+      n++;
+    }
+  } else {
+    BlockState ba, bb;
+    unsigned long long blocks = 0;
+    ba.running = bb.running = true;
+    while (n < limit && ba.running && bb.running) {
+      run_block(a, &ba, limit - n);
+      run_block(b, &bb, limit - n);
+      if (ba.count != bb.count || ba.signature != bb.signature || ba.running != bb.running) {
+        std::printf("COSIM: DIVERGENCE in block #%llu (instructions %llu..%llu)\n",
+                    blocks, n, n + (ba.count > bb.count ? ba.count : bb.count));
+        if (ba.count) print_retire(a->name, ba.last);
+        if (bb.count) print_retire(b->name, bb.last);
+        print_reg_diff(a, b);
+        return 1;
+      }
+      n += ba.count;
+      blocks++;
+    }
+  }
+
+  std::printf("COSIM: %s and %s agree on %llu instructions%s\n", a->name, b->name, n,
+              (n == limit) ? " (instruction limit reached)" : "");
+  return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef COSIM_H
+#define COSIM_H
+
+// Runs two engines ("staged", "fast" or "pipeline") in lockstep on the
+// same program and stops at the first divergence. With per_block the
+// engines are compared at the end of every basic block instead of after
+// every instruction. Returns 0 if they agree, 1 otherwise.
+int run_cosim(const char *engine_a, const char *engine_b, const char *file_name,
+              bool per_block, unsigned long long max_instrs);
+
+#endif
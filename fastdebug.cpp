@@ -0,0 +1,171 @@
+/* fastdebug.cpp
+   Breakpoints and watchpoints of the fast interpreter. A breakpoint swaps
+   the op of the decoded instruction for F_BREAK and keeps the original to
+   run when the program continues. A watchpoint flags the pages it covers
+   in s->watch_pages; only accesses to those pages come here to be compared
+   against the watchpoints.
+*/
+
+#include "fastdebug.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static unsigned int option_breaks[FAST_MAX_BREAKPOINTS];
+static int num_option_breaks = 0;
+static Watchpoint option_watches[FAST_MAX_WATCHPOINTS];
+static int num_option_watches = 0;
+
+bool fast_break_set(FastSim *s, unsigned int pc) {
+  if (pc >= TEXT_SIZE || (pc & 1))
+    return false;
+  for (int i = 0; i < s->num_breaks; i++) {
+    if (s->breaks[i].pc == pc)
+      return true;
+  }
+  if (s->num_breaks == FAST_MAX_BREAKPOINTS)
+    return false;
+  Breakpoint &b = s->breaks[s->num_breaks++];
+  b.pc = pc;
+  b.original = s->code[pc >> 1];
+  s->code[pc >> 1].op = F_BREAK;
+  return true;
+}
+
+// Flags the pages an access can start on and still overlap w
+static void flag_pages(FastSim *s, const Watchpoint &w) {
+  unsigned int first = (w.idx >= 3) ? w.idx - 3 : 0;
+  for (unsigned int p = first >> WATCH_PAGE_SHIFT; p <= (w.idx + w.len - 1) >> WATCH_PAGE_SHIFT; p++)
+    s->watch_pages[p] |= w.kind;
+}
+
+bool fast_watch_set(FastSim *s, unsigned int addr, unsigned int len, int kind) {
+  int idx = mem_index(addr, len);
+  if (len == 0 || idx < 0 || s->num_watches == FAST_MAX_WATCHPOINTS)
+    return false;
+  Watchpoint &w = s->watches[s->num_watches++];
+  w.addr = addr;
+  w.len = len;
+  w.idx = idx;
+  w.kind = (unsigned char)kind;
+  flag_pages(s, w);
+  s->watching = true;
+  return true;
+}
+
+void fast_debug_clear(FastSim *s) {
+  for (int i = 0; i < s->num_breaks; i++)
+    s->code[s->breaks[i].pc >> 1] = s->breaks[i].original;
+  s->num_breaks = 0;
+  s->num_watches = 0;
+  s->watching = false;
+  std::memset(s->watch_pages, 0, sizeof(s->watch_pages));
+  s->stop = STOP_NONE;
+}
+
+void fast_break_rearm(FastSim *s) {
+  for (int i = 0; i < s->num_breaks; i++) {
+    DecodedInstr &d = s->code[s->breaks[i].pc >> 1];
+    if (d.op != F_BREAK) {
+      s->breaks[i].original = d;
+      d.op = F_BREAK;
+    }
+  }
+}
+
+void fast_watch_check(FastSim *s, unsigned int addr, int idx, unsigned int size, int kind,
+                      unsigned int value) {
+  for (int i = 0; i < s->num_watches; i++) {
+    const Watchpoint &w = s->watches[i];
+    if ((w.kind & kind) && idx < w.idx + (int)w.len && idx + (int)size > w.idx) {
+      s->hit.pc = s->PC;
+      s->hit.addr = addr;
+      s->hit.size = size;
+      s->hit.value = (size == 4) ? value : value & ((1u << (8 * size)) - 1);
+      s->hit.kind = (unsigned char)kind;
+      s->stop = STOP_WATCH;
+      return;
+    }
+  }
+}
+
+void fast_stop_report(const FastSim *s) {
+  if (s->stop == STOP_BREAK) {
+    std::printf("Breakpoint at PC 0x%08X after %llu instructions\n", s->PC, s->instret);
+  } else if (s->stop == STOP_WATCH) {
+    std::printf("Watchpoint: %s of %u bytes at 0x%08X = 0x%08X by PC 0x%08X after %llu instructions\n",
+                (s->hit.kind == WATCH_WRITE) ? "write" : "read", s->hit.size, s->hit.addr,
+                s->hit.value, s->hit.pc, s->instret);
+  }
+}
+
+static const char *kind_name(int kind) {
+  return (kind == WATCH_READ) ? "r" : (kind == WATCH_WRITE) ? "w" : "rw";
+}
+
+void fast_debug_list(const FastSim *s) {
+  for (int i = 0; i < s->num_breaks; i++)
+    std::printf("break 0x%08X\n", s->breaks[i].pc);
+  for (int i = 0; i < s->num_watches; i++)
+    std::printf("watch 0x%08X, %u bytes, %s\n", s->watches[i].addr, s->watches[i].len,
+                kind_name(s->watches[i].kind));
+}
+
+bool parse_watch(const char *spec, unsigned int *addr, unsigned int *len, int *kind) {
+  char *end;
+  *addr = (unsigned int)std::strtoul(spec, &end, 0);
+  *len = 4;
+  *kind = WATCH_READ | WATCH_WRITE;
+  if (end == spec)
+    return false;
+  if (*end == ':' && end[1] >= '0' && end[1] <= '9') {
+    spec = end + 1;
+    *len = (unsigned int)std::strtoul(spec, &end, 0);
+    if (*len == 0)
+      return false;
+  }
+  if (*end == ':') {
+    end++;
+    if (std::strcmp(end, "r") == 0) *kind = WATCH_READ;
+    else if (std::strcmp(end, "w") == 0) *kind = WATCH_WRITE;
+    else if (std::strcmp(end, "rw") != 0) return false;
+    return true;
+  }
+  return *end == '\0';
+}
+
+bool debug_option_break(const char *arg) {
+  char *end;
+  unsigned int pc = (unsigned int)std::strtoul(arg, &end, 0);
+  if (end == arg || *end != '\0' || num_option_breaks == FAST_MAX_BREAKPOINTS)
+    return false;
+  option_breaks[num_option_breaks++] = pc;
+  return true;
+}
+
+bool debug_option_watch(const char *arg) {
+  Watchpoint &w = option_watches[num_option_watches];
+  int kind;
+  if (num_option_watches == FAST_MAX_WATCHPOINTS || !parse_watch(arg, &w.addr, &w.len, &kind))
+    return false;
+  w.kind = (unsigned char)kind;
+  num_option_watches++;
+  return true;
+}
+
+bool fast_debug_apply(FastSim *s) {
+  for (int i = 0; i < num_option_breaks; i++) {
+    if (!fast_break_set(s, option_breaks[i])) {
+      std::printf("Cannot set a breakpoint at 0x%08X\n", option_breaks[i]);
+      return false;
+    }
+  }
+  for (int i = 0; i < num_option_watches; i++) {
+    const Watchpoint &w = option_watches[i];
+    if (!fast_watch_set(s, w.addr, w.len, w.kind)) {
+      std::printf("Cannot watch %u bytes at 0x%08X\n", w.len, w.addr);
+      return false;
+    }
+  }
+  return true;
+}
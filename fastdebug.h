@@ -0,0 +1,50 @@
+#ifndef FASTDEBUG_H
+#define FASTDEBUG_H
+
+#include "fastsim.h"
+
+// Breakpoints and watchpoints of the fast interpreter. Neither costs
+// anything while unset: a breakpoint replaces the op of its decoded
+// instruction with F_BREAK, and runs only take the access-checking path
+// while a watchpoint is set. A run that stops on one returns with s->stop
+// set; running again continues from there.
+
+// Sets a breakpoint before the instruction at pc. Returns false if pc is
+// not an instruction address or the table is full.
+bool fast_break_set(FastSim *s, unsigned int pc);
+
+// Watches len bytes from addr for kind (WATCH_READ and/or WATCH_WRITE)
+// accesses. Returns false if the range is outside memory or the table is
+// full.
+bool fast_watch_set(FastSim *s, unsigned int addr, unsigned int len, int kind);
+
+// Removes every breakpoint and watchpoint
+void fast_debug_clear(FastSim *s);
+
+// Marks the breakpoints again after their slots were re-decoded
+void fast_break_rearm(FastSim *s);
+
+// Slow path of a data access to a flagged page: stops the run with
+// STOP_WATCH if the access overlaps a watchpoint
+void fast_watch_check(FastSim *s, unsigned int addr, int idx, unsigned int size, int kind,
+                      unsigned int value);
+
+// Prints why the last run of s stopped, if it hit a breakpoint or watchpoint
+void fast_stop_report(const FastSim *s);
+
+// Prints the breakpoints and watchpoints of s
+void fast_debug_list(const FastSim *s);
+
+// Parses "<addr>[:<len>][:r|w|rw]" (length 4 and rw by default)
+bool parse_watch(const char *spec, unsigned int *addr, unsigned int *len, int *kind);
+
+// Breakpoints (-break) and watchpoints (-watch) from the command line.
+// Both return false on a malformed argument.
+bool debug_option_break(const char *arg);
+bool debug_option_watch(const char *arg);
+
+// Sets the command-line breakpoints and watchpoints on a loaded s. Returns
+// false, after printing why, if one of them does not fit the program.
+bool fast_debug_apply(FastSim *s);
+
+#endif
@@ -0,0 +1,539 @@
+/* fastsim.cpp
+   Fast interpreter: the text segment is decoded once at load time into
+   DecodedInstr entries and executed through a single dense switch, with
+   no per-stage tracing. All state lives in a FastSim instance, so several
+   interpreters can coexist.
+*/
+
+#include "fastsim.h"
+#include "profiler.h"
+#include "syscall.h"
+#include "rvc.h"
+#include "fastdebug.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+DecodedInstr fast_decode(unsigned int instr) {
+  static const unsigned char branch_ops[8] = {
+    F_BEQ, F_BNE, F_ILLEGAL, F_ILLEGAL, F_BLT, F_BGE, F_BLTU, F_BGEU
+  };
+  static const unsigned char load_ops[8] = {
+    F_LB, F_LH, F_LW, F_ILLEGAL, F_LBU, F_LHU, F_ILLEGAL, F_ILLEGAL
+  };
+  static const unsigned char store_ops[8] = {
+    F_SB, F_SH, F_SW, F_ILLEGAL, F_ILLEGAL, F_ILLEGAL, F_ILLEGAL, F_ILLEGAL
+  };
+  static const unsigned char op_imm_ops[8] = {
+    F_ADDI, F_SLLI, F_SLTI, F_SLTIU, F_XORI, F_SRLI, F_ORI, F_ANDI
+  };
+  static const unsigned char op_ops[8] = {
+    F_ADD, F_SLL, F_SLT, F_SLTU, F_XOR, F_SRL, F_OR, F_AND
+  };
+
+  DecodedInstr d;
+  unsigned int funct3 = FUNCT3(instr);
+  unsigned int funct7 = FUNCT7(instr);
+  d.op = F_ILLEGAL;
+  d.rd = RD(instr);
+  d.rs1 = RS1(instr);
+  d.rs2 = RS2(instr);
+  d.len = 4;
+  d.imm = 0;
+  d.instr = instr;
+
+  if (instr == 0xEF000011) {
+    d.op = F_EXIT;
+    d.rd = 0;
+    return d;
+  }
+  if (instr == ECALL_INSTR) {
+    d.op = F_ECALL;
+    return d;
+  }
+  switch (OPCODE(instr)) {
+    case 0x37: d.op = F_LUI; d.imm = imm_u(instr); break;
+    case 0x17: d.op = F_AUIPC; d.imm = imm_u(instr); break;
+    case 0x6F: d.op = F_JAL; d.imm = imm_j(instr); break;
+    case 0x67:
+      if (funct3 == 0x0) d.op = F_JALR;
+      d.imm = imm_i(instr);
+      break;
+    case 0x63:
+      d.op = branch_ops[funct3];
+      d.imm = imm_b(instr);
+      d.rd = 0;
+      break;
+    case 0x03: d.op = load_ops[funct3]; d.imm = imm_i(instr); break;
+    case 0x23:
+      d.op = store_ops[funct3];
+      d.imm = imm_s(instr);
+      d.rd = 0;
+      break;
+    case 0x13:
+      d.op = op_imm_ops[funct3];
+      d.imm = imm_i(instr);
+      if (funct3 == 0x1 || funct3 == 0x5) {
+        d.imm = RS2(instr);   // shamt
+        if (funct3 == 0x5 && funct7 == 0x20) d.op = F_SRAI;
+        else if (funct7 != 0x00) d.op = F_ILLEGAL;
+      }
+      break;
+    case 0x2F:
+      if (funct3 != 0x2) break;
+      switch (instr >> 27) {
+        case 0x02: if (d.rs2 == 0) d.op = F_LR; break;
+        case 0x03: d.op = F_SC; break;
+        case 0x00: case 0x01: case 0x04: case 0x08: case 0x0C:
+        case 0x10: case 0x14: case 0x18: case 0x1C: d.op = F_AMO; break;
+      }
+      break;
+    case 0x33:
+      if (funct7 == 0x01) d.op = F_MULDIV;
+      else if (funct7 == 0x00) d.op = op_ops[funct3];
+      else if (funct7 == 0x20 && funct3 == 0x0) d.op = F_SUB;
+      else if (funct7 == 0x20 && funct3 == 0x5) d.op = F_SRA;
+      break;
+  }
+  if (d.op == F_ILLEGAL)
+    d.rd = 0;
+  return d;
+}
+
+// Decodes the instruction starting at text address pc, which may be
+// compressed
+DecodedInstr fast_decode_at(const unsigned char *mem, unsigned int pc) {
+  unsigned int parcel, len;
+  std::memcpy(&parcel, mem + pc, 4);
+  DecodedInstr d = fast_decode(rvc_fetch(parcel, &len));
+  d.len = (unsigned char)len;
+  return d;
+}
+
+// Flags the pages of a store for fast_restore()
+static inline void fast_dirty(FastSim *s, int idx, unsigned int size) {
+  s->dirty[idx >> DIRTY_PAGE_SHIFT] = 1;
+  s->dirty[(idx + size - 1) >> DIRTY_PAGE_SHIFT] = 1;
+}
+
+// Re-decodes the text slots touched by a store, including a 32-bit
+// instruction that starts in the halfword before it
+static inline void fast_invalidate(FastSim *s, int idx, unsigned int size) {
+  unsigned int first = (idx >= 2) ? (idx - 2) >> 1 : 0;
+  for (unsigned int slot = first; slot <= (idx + size - 1) >> 1 && slot < FAST_SLOTS; slot++)
+    s->code[slot] = fast_decode_at(s->MEM, slot << 1);
+  if (s->num_breaks) fast_break_rearm(s);
+}
+
+unsigned int fast_amo_value(unsigned int instr, unsigned int old, unsigned int b) {
+  switch (instr >> 27) {
+    case 0x00: return old + b;
+    case 0x01: return b;
+    case 0x04: return old ^ b;
+    case 0x08: return old | b;
+    case 0x0C: return old & b;
+    case 0x10: return ((int)old < (int)b) ? old : b;
+    case 0x14: return ((int)old > (int)b) ? old : b;
+    case 0x18: return (old < b) ? old : b;
+    default:   return (old > b) ? old : b;
+  }
+}
+
+// Performs LR/SC/AMO d with operands a (address) and b against mem.
+// Returns the byte index of the word, or -1 for a misaligned or
+// out-of-range address. *v receives the rd value and *stored the value
+// written, with *size set to 4 if the instruction stored.
+static int atomic_op(FastSim *s, unsigned char *mem, const DecodedInstr &d,
+                     unsigned int a, unsigned int b, unsigned int *v,
+                     unsigned int *stored, unsigned int *size) {
+  int idx = (a & 3) ? -1 : mem_index(a, 4);
+  if (idx < 0) return -1;
+  unsigned int old;
+  std::memcpy(&old, mem + idx, 4);
+  *size = 0;
+
+  if (d.op == F_LR) {
+    *v = old;
+    s->reserved = true;
+    s->reserved_addr = a;
+    return idx;
+  }
+  if (d.op == F_SC) {
+    bool ok = s->reserved && s->reserved_addr == a;
+    s->reserved = false;
+    *v = ok ? 0 : 1;
+    if (!ok) return idx;
+    *stored = b;
+  } else {
+    *stored = fast_amo_value(d.instr, old, b);
+    *v = old;
+  }
+  std::memcpy(mem + idx, stored, 4);
+  *size = 4;
+  return idx;
+}
+
+void fast_reset(FastSim *s) {
+  std::memset(s, 0, sizeof(*s));
+  for (unsigned int slot = 0; slot < FAST_SLOTS; slot++)
+    s->code[slot] = fast_decode(0);
+}
+
+void fast_load(FastSim *s, const char *file_name) {
+  FILE *fp = std::fopen(file_name, "r");
+  if (fp == nullptr) {
+    std::printf("Error opening input mem file\n");
+    std::exit(1);
+  }
+  char line[256];
+  unsigned int address, word;
+  unsigned int data_end = DATA_OFFSET;
+  while (std::fgets(line, sizeof(line), fp) != nullptr) {
+    if (parse_mc_line(line, &address, &word)) {
+      write_word(reinterpret_cast<char*>(s->MEM), address, word);
+      if (address >= DATA_OFFSET && address + 4 > data_end) data_end = address + 4;
+    }
+  }
+  std::fclose(fp);
+  syscall_reset(data_end);
+  fast_predecode(s);
+}
+
+// Decodes the whole text segment of s->MEM
+void fast_predecode(FastSim *s) {
+  for (unsigned int slot = 0; slot < FAST_SLOTS; slot++)
+    s->code[slot] = fast_decode_at(s->MEM, slot << 1);
+  if (s->num_breaks) fast_break_rearm(s);
+}
+
+// Slots whose four bytes reach into the text up to its last nonzero byte
+static unsigned int text_slots(const FastSim *s) {
+  unsigned int end = TEXT_SIZE;
+  while (end > 0 && s->MEM[end - 1] == 0)
+    end--;
+  return (end + 1) >> 1;
+}
+
+void fast_recycle(FastSim *s) {
+  static const unsigned char zeros[4] = {0, 0, 0, 0};
+  DecodedInstr zero = fast_decode_at(zeros, 0);
+  unsigned int slots = text_slots(s);
+  for (unsigned int slot = 0; slot < slots; slot++)
+    s->code[slot] = zero;
+  bool serial_ecalls = s->serial_ecalls;
+  std::memset(s, 0, offsetof(FastSim, code));
+  s->serial_ecalls = serial_ecalls;
+}
+
+void fast_predecode_text(FastSim *s) {
+  unsigned int slots = text_slots(s);
+  for (unsigned int slot = 0; slot < slots; slot++)
+    s->code[slot] = fast_decode_at(s->MEM, slot << 1);
+}
+
+void fast_snapshot(FastSim *s, FastSim *snap) {
+  std::memset(s->dirty, 0, sizeof(s->dirty));
+  std::memcpy(snap, s, sizeof(*s));
+}
+
+void fast_restore(FastSim *s, const FastSim *snap) {
+  const unsigned int page_size = 1u << DIRTY_PAGE_SHIFT;
+  for (unsigned int page = 0; page < DIRTY_PAGES; page++) {
+    if (!s->dirty[page])
+      continue;
+    unsigned int first = page << DIRTY_PAGE_SHIFT;
+    std::memcpy(s->MEM + first, snap->MEM + first, page_size);
+    if (first < TEXT_SIZE) {
+      // The page's slots, and the one starting in the halfword before it
+      unsigned int slot = (first >> 1) ? (first >> 1) - 1 : 0;
+      unsigned int end = (first + page_size) >> 1;
+      std::memcpy(&s->code[slot], &snap->code[slot], (end - slot) * sizeof(DecodedInstr));
+    }
+  }
+  std::memcpy(s, snap, offsetof(FastSim, dirty));
+  std::memset(s->dirty, 0, sizeof(s->dirty));
+}
+
+bool fast_poke(FastSim *s, unsigned int address, const unsigned int *words, unsigned int n) {
+  if (n == 0)
+    return true;
+  int idx = (n <= MEM_SIZE / 4) ? mem_index(address, 4 * n) : -1;
+  if (idx < 0)
+    return false;
+  std::memcpy(s->MEM + idx, words, 4 * n);
+  for (unsigned int page = idx >> DIRTY_PAGE_SHIFT; page <= (idx + 4 * n - 1) >> DIRTY_PAGE_SHIFT; page++)
+    s->dirty[page] = 1;
+  if (idx < TEXT_SIZE)
+    fast_invalidate(s, idx, 4 * n);
+  return true;
+}
+
+const DecodedInstr &fast_decoded(const FastSim *s, unsigned int pc) {
+  const DecodedInstr &d = s->code[pc >> 1];
+  if (d.op == F_BREAK) {
+    for (int i = 0; i < s->num_breaks; i++) {
+      if (s->breaks[i].pc == pc)
+        return s->breaks[i].original;
+    }
+  }
+  return d;
+}
+
+// Checks a data access against the watchpoints, but only when its page is
+// flagged; compiled out of runs without watchpoints
+template <bool WATCH>
+static inline void fast_watch(FastSim *s, unsigned int addr, int idx, unsigned int size,
+                              int kind, unsigned int value) {
+  if (WATCH && (s->watch_pages[idx >> WATCH_PAGE_SHIFT] & kind))
+    fast_watch_check(s, addr, idx, size, kind, value);
+}
+
+// Records a data access of a hart for the coherence model and the
+// end-of-quantum commit
+static inline void fast_log(FastSim *s, int idx, unsigned int size, bool write) {
+  MemAccess &m = s->log->entries[s->log->count++];
+  m.step = (unsigned int)(s->instret - s->log->base);
+  m.idx = (unsigned short)idx;
+  m.size = (unsigned char)size;
+  m.write = write;
+}
+
+// Executes the decoded instruction d at s->PC. With RECORD the retirement
+// is described in ri; the plain run loop instantiates it without. With
+// WATCH data accesses are checked against the watchpoints.
+template <bool RECORD, bool WATCH>
+static inline bool fast_exec(FastSim *s, const DecodedInstr &d, RetireInfo *ri) {
+  unsigned int pc = s->PC;
+  unsigned int *R = s->R;
+  unsigned int a = R[d.rs1];
+  unsigned int b = R[d.rs2];
+  unsigned int v = 0;
+  unsigned int next = pc + d.len;
+  unsigned int addr = a + d.imm;
+  unsigned int size = 0;
+  unsigned int stored = b;
+  int idx = 0;
+
+  switch (d.op) {
+    case F_LUI:   v = d.imm; break;
+    case F_AUIPC: v = pc + d.imm; break;
+    case F_JAL:   v = pc + d.len; next = pc + d.imm; break;
+    case F_JALR:  v = pc + d.len; next = addr & ~1u; break;
+    case F_BEQ:   if (a == b) next = pc + d.imm; break;
+    case F_BNE:   if (a != b) next = pc + d.imm; break;
+    case F_BLT:   if ((int)a < (int)b) next = pc + d.imm; break;
+    case F_BGE:   if ((int)a >= (int)b) next = pc + d.imm; break;
+    case F_BLTU:  if (a < b) next = pc + d.imm; break;
+    case F_BGEU:  if (a >= b) next = pc + d.imm; break;
+    case F_LB: case F_LBU:
+      if ((idx = mem_index(addr, 1)) < 0) break;
+      v = (d.op == F_LB) ? (unsigned int)(signed char)s->MEM[idx] : s->MEM[idx];
+      fast_watch<WATCH>(s, addr, idx, 1, WATCH_READ, v);
+      if (s->log) fast_log(s, idx, 1, false);
+      break;
+    case F_LH: case F_LHU: {
+      if ((idx = mem_index(addr, 2)) < 0) break;
+      unsigned short h;
+      std::memcpy(&h, s->MEM + idx, 2);
+      v = (d.op == F_LH) ? (unsigned int)(short)h : h;
+      fast_watch<WATCH>(s, addr, idx, 2, WATCH_READ, v);
+      if (s->log) fast_log(s, idx, 2, false);
+      break;
+    }
+    case F_LW:
+      if ((idx = mem_index(addr, 4)) < 0) break;
+      std::memcpy(&v, s->MEM + idx, 4);
+      fast_watch<WATCH>(s, addr, idx, 4, WATCH_READ, v);
+      if (s->log) fast_log(s, idx, 4, false);
+      break;
+    case F_SB: case F_SH: case F_SW:
+      size = (d.op == F_SB) ? 1 : (d.op == F_SH) ? 2 : 4;
+      if ((idx = mem_index(addr, size)) < 0) break;
+      std::memcpy(s->MEM + idx, &b, size);
+      fast_dirty(s, idx, size);
+      fast_watch<WATCH>(s, addr, idx, size, WATCH_WRITE, b);
+      if (idx < TEXT_SIZE)
+        fast_invalidate(s, idx, size);
+      if (s->log) fast_log(s, idx, size, true);
+      break;
+    case F_ADDI:  v = a + d.imm; break;
+    case F_SLTI:  v = ((int)a < d.imm) ? 1 : 0; break;
+    case F_SLTIU: v = (a < (unsigned int)d.imm) ? 1 : 0; break;
+    case F_XORI:  v = a ^ d.imm; break;
+    case F_ORI:   v = a | d.imm; break;
+    case F_ANDI:  v = a & d.imm; break;
+    case F_SLLI:  v = a << d.imm; break;
+    case F_SRLI:  v = a >> d.imm; break;
+    case F_SRAI:  v = (unsigned int)((int)a >> d.imm); break;
+    case F_ADD:   v = a + b; break;
+    case F_SUB:   v = a - b; break;
+    case F_SLL:   v = a << (b & 0x1F); break;
+    case F_SLT:   v = ((int)a < (int)b) ? 1 : 0; break;
+    case F_SLTU:  v = (a < b) ? 1 : 0; break;
+    case F_XOR:   v = a ^ b; break;
+    case F_SRL:   v = a >> (b & 0x1F); break;
+    case F_SRA:   v = (unsigned int)((int)a >> (b & 0x1F)); break;
+    case F_OR:    v = a | b; break;
+    case F_AND:   v = a & b; break;
+    case F_MULDIV: v = alu_compute(d.instr, a, b); break;
+    case F_LR: case F_SC: case F_AMO:
+      // Harts run atomics serially against shared memory between quanta
+      if (s->log) {
+        s->serial_pending = true;
+        return false;
+      }
+      idx = atomic_op(s, s->MEM, d, a, b, &v, &stored, &size);
+      if (idx >= 0)
+        fast_watch<WATCH>(s, addr, idx, 4, size ? WATCH_WRITE : WATCH_READ, size ? stored : v);
+      if (idx >= 0 && size) {
+        fast_dirty(s, idx, size);
+        if (idx < TEXT_SIZE)
+          fast_invalidate(s, idx, size);
+      }
+      break;
+    case F_ECALL:
+      // System calls of harts run serially between quanta, like atomics
+      if (s->log || s->serial_ecalls) {
+        s->serial_pending = true;
+        return false;
+      }
+      std::memset(s->dirty, 1, sizeof(s->dirty));   // It may write anywhere
+      if (!syscall_dispatch(R, s->MEM, s->instret)) {
+        s->halted = true;
+        return false;
+      }
+      break;
+    case F_EXIT:
+      s->halted = true;
+      return false;
+    case F_BREAK:
+      // Stop before the instruction, and run it when continuing from here
+      if (s->stop != STOP_BREAK && !s->debug_suspended) {
+        s->stop = STOP_BREAK;
+        return false;
+      }
+      s->stop = STOP_NONE;
+      return fast_exec<RECORD, WATCH>(s, fast_decoded(s, pc), ri);
+    default:
+      idx = -1;
+      break;
+  }
+  if (idx < 0) {
+    s->fault = s->halted = true;
+    return false;
+  }
+
+  R[d.rd] = v;
+  R[0] = 0;
+  s->PC = next;
+  s->instret++;
+
+  if (RECORD) {
+    ri->pc = pc;
+    ri->instr = d.instr;
+    ri->len = d.len;
+    ri->next_pc = next;
+    ri->rd = d.rd;
+    ri->rd_value = R[d.rd];
+    ri->mem_size = size;
+    ri->mem_addr = size ? addr : 0;
+    ri->mem_value = (size == 4) ? stored : (size ? stored & ((1u << (8 * size)) - 1) : 0);
+  }
+  return true;
+}
+
+template <bool RECORD, bool WATCH>
+static inline bool fast_execute(FastSim *s, RetireInfo *ri) {
+  unsigned int pc = s->PC;
+  if (pc >= TEXT_SIZE || (pc & 1)) {
+    s->fault = s->halted = true;
+    return false;
+  }
+  return fast_exec<RECORD, WATCH>(s, s->code[pc >> 1], ri);
+}
+
+int fast_atomic(FastSim *s, unsigned char *mem, bool *wrote) {
+  const DecodedInstr &d = fast_decoded(s, s->PC);
+  unsigned int v = 0, stored = 0, size = 0;
+  int idx = atomic_op(s, mem, d, s->R[d.rs1], s->R[d.rs2], &v, &stored, &size);
+  s->serial_pending = false;
+  *wrote = (size != 0);
+  if (idx >= 0 && size)
+    fast_dirty(s, idx, size);
+  if (idx < 0) {
+    s->fault = s->halted = true;
+    return -1;
+  }
+  s->R[d.rd] = v;
+  s->R[0] = 0;
+  s->PC += d.len;
+  s->instret++;
+  return idx;
+}
+
+bool fast_ecall(FastSim *s, unsigned char *mem) {
+  s->serial_pending = false;
+  std::memset(s->dirty, 1, sizeof(s->dirty));
+  if (!syscall_dispatch(s->R, mem, s->instret)) {
+    s->halted = true;
+    return false;
+  }
+  s->PC += fast_decoded(s, s->PC).len;
+  s->instret++;
+  return true;
+}
+
+// A watchpoint stop lasts until the next run; a breakpoint stop makes the
+// next run start with the instruction under the breakpoint
+bool fast_step(FastSim *s, RetireInfo *ri) {
+  if (s->halted)
+    return false;
+  if (s->stop == STOP_WATCH) s->stop = STOP_NONE;
+  if (s->watching && !s->debug_suspended)
+    return fast_execute<true, true>(s, ri);
+  return fast_execute<true, false>(s, ri);
+}
+
+template <bool WATCH>
+static void fast_loop(FastSim *s, unsigned long long limit) {
+  if (prof_enabled) {
+    while (s->instret < limit) {
+      profile_pc(s->PC);
+      if (!fast_execute<false, WATCH>(s, nullptr) || (WATCH && s->stop)) break;
+    }
+  } else {
+    while (s->instret < limit && fast_execute<false, WATCH>(s, nullptr) && !(WATCH && s->stop))
+      ;
+  }
+}
+
+// Runs until the exit word, a fault, a breakpoint or watchpoint, or
+// max_instrs (0 for no limit)
+void fast_run(FastSim *s, unsigned long long max_instrs) {
+  unsigned long long limit = max_instrs ? max_instrs : ~0ULL;
+  if (s->stop == STOP_WATCH) s->stop = STOP_NONE;
+  if (s->watching && !s->debug_suspended)
+    fast_loop<true>(s, limit);
+  else
+    fast_loop<false>(s, limit);
+}
+
+void fast_dump(FastSim *s) {
+  syscall_flush();
+  dump_data_memory(reinterpret_cast<char*>(s->MEM));
+  if (s->fault)
+    std::printf("\nFAULT at PC 0x%08X (instruction 0x%08X)\n", s->PC,
+                (s->PC < TEXT_SIZE) ? s->code[s->PC >> 1].instr : 0);
+  std::printf("\n=== REGISTER DUMP ===\n");
+  for (int i = 0; i < 32; i++) {
+    std::printf("R%-2d = %d\n", i, s->R[i]);
+  }
+  std::printf("\nFinal array:\n");
+  for (int i = 0; i < 10; i++) {
+    int val = read_word(reinterpret_cast<char*>(s->MEM), DATA_OFFSET + i * 4);
+    std::printf("[%d] = %d\n", i, val);
+  }
+  std::printf("\nInstructions executed: %llu\n", s->instret);
+  if (prof_enabled) profiler_report(reinterpret_cast<char*>(s->MEM));
+}
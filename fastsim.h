@@ -0,0 +1,156 @@
+#ifndef FASTSIM_H
+#define FASTSIM_H
+
+#include "myRISCVSim.h"
+
+// Operations of the fast interpreter; one per RV32IM instruction, plus the
+// RV32A LR.W/SC.W, one shared op for the AMOs and ECALL. F_BREAK replaces
+// the op of an instruction with a breakpoint on it.
+enum FastOp {
+  F_ILLEGAL, F_EXIT, F_ECALL,
+  F_LUI, F_AUIPC, F_JAL, F_JALR,
+  F_BEQ, F_BNE, F_BLT, F_BGE, F_BLTU, F_BGEU,
+  F_LB, F_LH, F_LW, F_LBU, F_LHU, F_SB, F_SH, F_SW,
+  F_ADDI, F_SLTI, F_SLTIU, F_XORI, F_ORI, F_ANDI, F_SLLI, F_SRLI, F_SRAI,
+  F_ADD, F_SUB, F_SLL, F_SLT, F_SLTU, F_XOR, F_SRL, F_SRA, F_OR, F_AND,
+  F_MULDIV,
+  F_LR, F_SC, F_AMO,
+  F_BREAK,
+  NUM_FAST_OPS
+};
+
+// An instruction decoded once at load time
+struct DecodedInstr {
+  unsigned char op;
+  unsigned char rd, rs1, rs2;
+  unsigned char len;          // 2 for a compressed instruction, else 4
+  int imm;
+  unsigned int instr;         // Compressed forms are stored expanded
+};
+
+// One decoded slot per halfword of the text segment, since RV32C code
+// can start an instruction at any even address
+#define FAST_SLOTS (TEXT_SIZE / 2)
+
+// Breakpoints and watchpoints (see fastdebug.h). A watchpoint flags the
+// pages it covers, and only accesses to a flagged page compare against
+// the watchpoints.
+#define FAST_MAX_BREAKPOINTS 16
+#define FAST_MAX_WATCHPOINTS 8
+#define WATCH_PAGE_SHIFT 6
+#define WATCH_PAGES      (MEM_SIZE >> WATCH_PAGE_SHIFT)
+#define WATCH_READ       1
+#define WATCH_WRITE      2
+
+// Why a run returned before the exit word, a fault or its limit
+enum FastStop { STOP_NONE, STOP_BREAK, STOP_WATCH };
+
+struct Breakpoint {
+  unsigned int pc;
+  DecodedInstr original;      // The decoded instruction F_BREAK replaced
+};
+
+struct Watchpoint {
+  unsigned int addr;
+  unsigned int len;
+  int idx;                    // Byte index of addr into MEM
+  unsigned char kind;         // WATCH_READ and/or WATCH_WRITE
+};
+
+// The access that triggered the last STOP_WATCH
+struct WatchHit {
+  unsigned int pc;
+  unsigned int addr;
+  unsigned int size;
+  unsigned int value;         // Value loaded or stored
+  unsigned char kind;
+};
+
+// One data access of a hart during a scheduling quantum (see harts.cpp)
+struct MemAccess {
+  unsigned int step;          // Instructions the hart had executed in the quantum
+  unsigned short idx;         // Byte index into MEM
+  unsigned char size;
+  unsigned char write;
+};
+
+struct HartLog {
+  MemAccess *entries;         // One slot per instruction of the quantum
+  unsigned int count;
+  unsigned long long base;    // instret at the start of the quantum
+};
+
+// Complete state of one fast-interpreter instance
+struct FastSim {
+  unsigned int PC;
+  unsigned int R[32];
+  unsigned long long instret;
+  bool halted;
+  bool fault;                 // Stopped on an illegal instruction or bad address
+  bool reserved;              // LR.W reservation is held
+  unsigned int reserved_addr;
+  HartLog *log;               // Set when running as one of several harts
+  bool serial_pending;        // Stopped before an atomic or ECALL, see fast_atomic()
+  bool serial_ecalls;         // Stop before ECALLs too when not a hart (see serve.cpp)
+  unsigned char stop;         // FastStop of the last run
+  bool watching;              // A watchpoint is set, so runs check data accesses
+  bool debug_suspended;       // Breakpoints and watchpoints are ignored (replays)
+  int num_breaks;
+  int num_watches;
+  Breakpoint breaks[FAST_MAX_BREAKPOINTS];
+  Watchpoint watches[FAST_MAX_WATCHPOINTS];
+  WatchHit hit;
+  unsigned char watch_pages[WATCH_PAGES];  // WATCH_* of the watchpoints on each page
+  unsigned char dirty[DIRTY_PAGES];        // Pages of MEM written since fast_snapshot()
+  unsigned char MEM[MEM_SIZE];
+  DecodedInstr code[FAST_SLOTS];  // Indexed by PC >> 1
+};
+
+DecodedInstr fast_decode(unsigned int instr);
+DecodedInstr fast_decode_at(const unsigned char *mem, unsigned int pc);
+void fast_reset(FastSim *s);
+void fast_load(FastSim *s, const char *file_name);
+void fast_predecode(FastSim *s);
+
+// Readies s for another program more cheaply than fast_reset(): clears
+// the state and memory, but only resets the decoded slots the last
+// program had text in, the others still holding decoded zeros. Keeps
+// serial_ecalls. Load the next program into MEM, then call
+// fast_predecode_text().
+void fast_recycle(FastSim *s);
+
+// Decodes the slots up to the last nonzero byte of the text segment
+void fast_predecode_text(FastSim *s);
+
+// Dirty-page snapshot for running many short programs on one instance:
+// fast_restore() returns s to the state saved in snap, copying back only
+// the pages of MEM (and their decoded slots) written since. Stores, atomics
+// and fast_poke() flag the pages they write; a system call flags them all.
+// Other writes to s->MEM must be followed by a new snapshot.
+void fast_snapshot(FastSim *s, FastSim *snap);
+void fast_restore(FastSim *s, const FastSim *snap);
+
+// Writes n words from address on and re-decodes the text they cover.
+// Returns false if they do not fit in MEM.
+bool fast_poke(FastSim *s, unsigned int address, const unsigned int *words, unsigned int n);
+
+bool fast_step(FastSim *s, RetireInfo *ri);
+void fast_run(FastSim *s, unsigned long long max_instrs);
+void fast_dump(FastSim *s);
+
+// Decoded instruction at pc, looking through a breakpoint
+const DecodedInstr &fast_decoded(const FastSim *s, unsigned int pc);
+
+// Value AMO instr stores over the word old, with b from rs2
+unsigned int fast_amo_value(unsigned int instr, unsigned int old, unsigned int b);
+
+// Executes the atomic instruction at s->PC against mem, which may be
+// shared by several harts. Returns the byte index of the word it accessed,
+// or -1 on a bad address; *wrote tells whether it stored to it.
+int fast_atomic(FastSim *s, unsigned char *mem, bool *wrote);
+
+// Executes the ECALL at s->PC against mem. Returns false if the hart
+// exited.
+bool fast_ecall(FastSim *s, unsigned char *mem);
+
+#endif
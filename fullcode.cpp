@@ -65,6 +65,16 @@ unordered_map<string, B_t> instrmap_br = {
     {"blt", {"1100011", "100"}}
 };
 
+// Mapping for RV32A atomics to funct5; all use opcode 0101111 and funct3 010
+unordered_map<string, string> instrmap_a = {
+    {"lr.w",      "00010"}, {"sc.w",      "00011"},
+    {"amoswap.w", "00001"}, {"amoadd.w",  "00000"},
+    {"amoxor.w",  "00100"}, {"amoand.w",  "01100"},
+    {"amoor.w",   "01000"}, {"amomin.w",  "10000"},
+    {"amomax.w",  "10100"}, {"amominu.w", "11000"},
+    {"amomaxu.w", "11100"}
+};
+
 // Mapping for store instructions (S-type); allof them use the same opcode.
 unordered_map<string, string> instrmap_st = {
     {"sb", "0100011"}, {"sh", "0100011"}, {"sw", "0100011"}, {"sd", "0100011"}
@@ -128,6 +138,12 @@ string enc_r(string ins, string rd, string rs1, string rs2)
            r.f3 + reg_bin(rd) + r.op;
 }
 
+// Atomic instruction; aq and rl are left clear
+string enc_a(string ins, string rd, string rs1, string rs2) {
+    return instrmap_a[ins] + "00" + reg_bin(rs2) + reg_bin(rs1) +
+           "010" + reg_bin(rd) + "0101111";
+}
+
 // same for U-type instruction.
 string enc_u(string ins, string rd, string imm) {
     return imm_bin(imm, 20) + reg_bin(rd) + instrmap_u[ins];
@@ -212,7 +228,255 @@ unsigned int parse_val(const string &tok) {
     return val;
 }
 
-int main() {
+// Encodes the text instruction tok at address pc, reading its operands
+// from ops. Returns false if tok is not an instruction.
+bool encode_txt(const string &tok, istream &ops, unsigned int pc, string &mc, string &bin_cmt) {
+    if(instrmap_r.count(tok)) {
+        string rd, rs1, rs2;
+        ops >> rd >> rs1 >> rs2;
+        mc = enc_r(tok, rm_comma(rd), rm_comma(rs1), rm_comma(rs2));
+        R_t r = instrmap_r[tok];
+        bin_cmt = r.op + "-" + r.f3 + "-" + r.f7 + "-" +
+                 reg_bin(rm_comma(rd)) + "-" +
+                 reg_bin(rm_comma(rs1)) + "-" +
+                 reg_bin(rm_comma(rs2)) + "-NULL";
+    } else if(instrmap_a.count(tok)) {
+        // lr.w rd, (rs1)  /  sc.w and amo*.w rd, rs2, (rs1)
+        string rd, rs2 = "x0", opr;
+        ops >> rd;
+        if(tok != "lr.w")
+            ops >> rs2;
+        ops >> opr;
+        string rs1 = opr.substr(opr.find('(') + 1, opr.find(')') - opr.find('(') - 1);
+        mc = enc_a(tok, rm_comma(rd), rs1, rm_comma(rs2));
+        bin_cmt = "0101111-010-" + instrmap_a[tok] + "00-" +
+                 reg_bin(rm_comma(rd)) + "-" + reg_bin(rs1) + "-" +
+                 reg_bin(rm_comma(rs2)) + "-NULL";
+    } else if(instrmap_i.count(tok)) {
+        string rd, opr;
+        ops >> rd >> opr;
+        string imm, rs1;
+        size_t pos = opr.find('(');
+        if(pos != string::npos) {
+            imm = opr.substr(0, pos);
+            rs1 = opr.substr(pos+1, opr.find(')') - pos - 1);
+        } else {
+            rs1 = opr;
+            ops >> imm;
+        }
+        mc = enc_i(tok, rm_comma(rd), rm_comma(rs1), rm_comma(imm));
+        I_t it = instrmap_i[tok];
+        string immB = imm_bin(rm_comma(imm), 12);
+        bin_cmt = it.op + "-" + it.f3 + "-NULL-" +
+                 reg_bin(rm_comma(rd)) + "-" +
+                 reg_bin(rm_comma(rs1)) + "-" + immB;
+    } else if(instrmap_st.count(tok)) {
+        string rs2, opr;
+        ops >> rs2 >> opr;
+        string imm, rs1;
+        size_t pos = opr.find('(');
+        if(pos != string::npos) {
+            imm = opr.substr(0, pos);
+            rs1 = opr.substr(pos+1, opr.find(')') - pos - 1);
+        }
+        mc = enc_st(tok, rm_comma(rs2), rm_comma(rs1), rm_comma(imm));
+        string immB = imm_bin(rm_comma(imm), 12);
+        string f3;
+        if(tok == "sb")  f3 = "000";
+        if(tok == "sh")  f3 = "001";
+        if(tok == "sw")  f3 = "010";
+        if(tok == "sd")  f3 = "011";
+        bin_cmt = instrmap_st[tok] + "-" + f3 + "-NULL-NULL-" +
+                 reg_bin(rm_comma(rs1)) + "-" +
+                 reg_bin(rm_comma(rs2)) + "-" + immB;
+    } else if(instrmap_br.count(tok)) {
+        string rs1, rs2, imm;
+        ops >> rs1 >> rs2 >> imm;
+        if(!is_num(imm)) {
+            int off = lbl_map[imm] - (pc+4);
+            imm = to_string(off);
+        }
+        mc = enc_br(tok, rm_comma(rs1), rm_comma(rs2), rm_comma(imm));
+        string immB = imm_bin(rm_comma(imm), 13);
+        B_t br = instrmap_br[tok];
+        bin_cmt = br.op + "-" + br.f3 + "-NULL-NULL-" +
+                 reg_bin(rm_comma(rs1)) + "-" +
+                 reg_bin(rm_comma(rs2)) + "-" + immB;
+    } else if(instrmap_u.count(tok)) {
+        string rd, imm;
+        ops >> rd >> imm;
+        mc = enc_u(tok, rm_comma(rd), rm_comma(imm));
+        string immB = imm_bin(rm_comma(imm), 20);
+        bin_cmt = instrmap_u[tok] + "-NULL-NULL-" +
+                 reg_bin(rm_comma(rd)) + "-NULL-" + immB;
+    } else if(instrmap_uj.count(tok)) {
+        string rd, lbl;
+        ops >> rd >> lbl;
+        int off = lbl_map[lbl] - pc;
+        string imm = to_string(off);
+        mc = enc_uj(tok, rm_comma(rd), rm_comma(imm));
+        string immB = imm_bin(rm_comma(imm), 21);
+        bin_cmt = instrmap_uj[tok] + "-NULL-NULL-" +
+                 reg_bin(rm_comma(rd)) + "-NULL-" + immB;
+    } else if(tok == "ecall") {
+        // System call number in a7, arguments in a0-a2
+        mc = "00000000000000000000000001110011";
+        bin_cmt = "1110011-000-NULL-00000-00000-000000000000";
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// RV32C compression. A compressed instruction runs exactly like the
+// 32-bit instruction it replaces; branches and jal are never compressed
+// because their offsets (and so their size) depend on the final layout.
+
+// Bits hi..lo of x, shifted down
+unsigned int bits(unsigned int x, int hi, int lo) {
+    return (x >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+// True for x8-x15, the registers the 3-bit register fields can name
+bool creg(unsigned int r) {
+    return r >= 8 && r <= 15;
+}
+
+bool fits_signed(int v, int width) {
+    return v >= -(1 << (width - 1)) && v < (1 << (width - 1));
+}
+
+// Compressed form of the 32-bit instruction w, if it has one. Its name is
+// returned in cname for the listing comment.
+bool compress_instr(unsigned int w, unsigned int *h, string &cname) {
+    unsigned int opcode = bits(w, 6, 0), f3 = bits(w, 14, 12), f7 = bits(w, 31, 25);
+    unsigned int rd = bits(w, 11, 7), rs1 = bits(w, 19, 15), rs2 = bits(w, 24, 20);
+    int imm_i = (int)w >> 20;
+    int imm_s = ((int)w >> 25) << 5 | (int)rd;
+    unsigned int u;
+
+    if(opcode == 0x13 && f3 == 0 && rd != 0) {                    // addi
+        if(rs1 == rd && imm_i != 0 && fits_signed(imm_i, 6)) {
+            u = imm_i;
+            *h = bits(u, 5, 5) << 12 | rd << 7 | bits(u, 4, 0) << 2 | 0x1;
+            cname = "c.addi";
+            return true;
+        }
+        if(rs1 == 0 && fits_signed(imm_i, 6)) {
+            u = imm_i;
+            *h = 0x2 << 13 | bits(u, 5, 5) << 12 | rd << 7 | bits(u, 4, 0) << 2 | 0x1;
+            cname = "c.li";
+            return true;
+        }
+        if(rs1 == 2 && rd == 2 && imm_i != 0 && imm_i % 16 == 0 && fits_signed(imm_i, 10)) {
+            u = imm_i;
+            *h = 0x3 << 13 | bits(u, 9, 9) << 12 | 2 << 7 | bits(u, 4, 4) << 6 |
+                 bits(u, 6, 6) << 5 | bits(u, 8, 7) << 3 | bits(u, 5, 5) << 2 | 0x1;
+            cname = "c.addi16sp";
+            return true;
+        }
+        if(rs1 == 2 && creg(rd) && imm_i > 0 && imm_i < 1024 && imm_i % 4 == 0) {
+            u = imm_i;
+            *h = bits(u, 5, 4) << 11 | bits(u, 9, 6) << 7 | bits(u, 2, 2) << 6 |
+                 bits(u, 3, 3) << 5 | (rd - 8) << 2;
+            cname = "c.addi4spn";
+            return true;
+        }
+        if(rs1 != 0 && imm_i == 0) {
+            *h = 0x4 << 13 | rd << 7 | rs1 << 2 | 0x2;
+            cname = "c.mv";
+            return true;
+        }
+    } else if(opcode == 0x13 && f3 == 7 && rd == rs1 && creg(rd) && fits_signed(imm_i, 6)) {
+        u = imm_i;
+        *h = 0x4 << 13 | bits(u, 5, 5) << 12 | 0x2 << 10 | (rd - 8) << 7 |
+             bits(u, 4, 0) << 2 | 0x1;
+        cname = "c.andi";
+        return true;
+    } else if(opcode == 0x33 && rd != 0 && rs2 != 0 && f7 == 0 && f3 == 0) {
+        if(rs1 == rd) {
+            *h = 0x4 << 13 | 1 << 12 | rd << 7 | rs2 << 2 | 0x2;
+            cname = "c.add";
+            return true;
+        }
+        if(rs1 == 0) {
+            *h = 0x4 << 13 | rd << 7 | rs2 << 2 | 0x2;
+            cname = "c.mv";
+            return true;
+        }
+    } else if(opcode == 0x33 && rd == rs1 && creg(rd) && creg(rs2) &&
+              ((f7 == 0x20 && f3 == 0) || (f7 == 0 && (f3 == 4 || f3 == 6 || f3 == 7)))) {
+        unsigned int op2 = (f3 == 0) ? 0 : (f3 == 4) ? 1 : (f3 == 6) ? 2 : 3;
+        *h = 0x4 << 13 | 0x3 << 10 | (rd - 8) << 7 | op2 << 5 | (rs2 - 8) << 2 | 0x1;
+        cname = (f3 == 0) ? "c.sub" : (f3 == 4) ? "c.xor" : (f3 == 6) ? "c.or" : "c.and";
+        return true;
+    } else if(opcode == 0x37 && rd != 0 && rd != 2) {             // lui
+        int imm = (int)w >> 12;
+        if(imm != 0 && fits_signed(imm, 6)) {
+            u = imm;
+            *h = 0x3 << 13 | bits(u, 5, 5) << 12 | rd << 7 | bits(u, 4, 0) << 2 | 0x1;
+            cname = "c.lui";
+            return true;
+        }
+    } else if(opcode == 0x03 && f3 == 2 && imm_i >= 0 && imm_i % 4 == 0) {   // lw
+        u = imm_i;
+        if(creg(rd) && creg(rs1) && imm_i < 128) {
+            *h = 0x2 << 13 | bits(u, 5, 3) << 10 | (rs1 - 8) << 7 | bits(u, 2, 2) << 6 |
+                 bits(u, 6, 6) << 5 | (rd - 8) << 2;
+            cname = "c.lw";
+            return true;
+        }
+        if(rs1 == 2 && rd != 0 && imm_i < 256) {
+            *h = 0x2 << 13 | bits(u, 5, 5) << 12 | rd << 7 | bits(u, 4, 2) << 4 |
+                 bits(u, 7, 6) << 2 | 0x2;
+            cname = "c.lwsp";
+            return true;
+        }
+    } else if(opcode == 0x23 && f3 == 2 && imm_s >= 0 && imm_s % 4 == 0) {   // sw
+        u = imm_s;
+        if(creg(rs2) && creg(rs1) && imm_s < 128) {
+            *h = 0x6 << 13 | bits(u, 5, 3) << 10 | (rs1 - 8) << 7 | bits(u, 2, 2) << 6 |
+                 bits(u, 6, 6) << 5 | (rs2 - 8) << 2;
+            cname = "c.sw";
+            return true;
+        }
+        if(rs1 == 2 && imm_s < 256) {
+            *h = 0x6 << 13 | bits(u, 5, 2) << 9 | bits(u, 7, 6) << 7 | rs2 << 2 | 0x2;
+            cname = "c.swsp";
+            return true;
+        }
+    } else if(opcode == 0x67 && f3 == 0 && imm_i == 0 && rs1 != 0 && (rd == 0 || rd == 1)) {
+        *h = 0x4 << 13 | rd << 12 | rs1 << 7 | 0x2;                // jalr x0/x1, 0(rs1)
+        cname = rd ? "c.jalr" : "c.jr";
+        return true;
+    }
+    return false;
+}
+
+// Size of a text line in bytes: 2 if it will be written compressed.
+// Branches and jal are never compressed, so labels are not needed here.
+unsigned int txt_size(const string &tok, istream &ops, bool compress) {
+    if(!compress || instrmap_br.count(tok) || instrmap_uj.count(tok))
+        return 4;
+    string mc, bin_cmt, cname;
+    unsigned int half;
+    if(!encode_txt(tok, ops, 0, mc, bin_cmt))
+        return 4;
+    return compress_instr(stoul(mc, nullptr, 2), &half, cname) ? 2 : 4;
+}
+
+int main(int argc, char *argv[]) {
+    // -c writes eligible instructions as 16-bit RV32C instructions
+    bool compress = false;
+    for(int i = 1; i < argc; i++) {
+        if(string(argv[i]) == "-c")
+            compress = true;
+        else {
+            cerr << "Usage: " << argv[0] << " [-c]" << endl;
+            return 1;
+        }
+    }
+
     // Open the input assembly file.
     ifstream in("input.asm");
     if (!in) {
@@ -255,7 +519,7 @@ int main() {
             cur_seg = seg_dat;
             cur_addr = 0x10000000;
         } else if(cur_seg == seg_txt) {
-            cur_addr += 4; // Each instruction is 4 bytes.
+            cur_addr += txt_size(tok, *p_ls, compress); // 4 bytes, or 2 compressed
         } else if(cur_seg == seg_dat) {
             // data----add the size of each directive we are taking.
             if(tok == ".byte") {
@@ -359,89 +623,28 @@ int main() {
         if(cur_seg == seg_txt) {
             string mc;
             string bin_cmt;
-            if(instrmap_r.count(tok)) {
-                string rd, rs1, rs2;
-                (*p_ls) >> rd >> rs1 >> rs2;
-                mc = enc_r(tok, rm_comma(rd), rm_comma(rs1), rm_comma(rs2));
-                R_t r = instrmap_r[tok];
-                bin_cmt = r.op + "-" + r.f3 + "-" + r.f7 + "-" +
-                         reg_bin(rm_comma(rd)) + "-" +
-                         reg_bin(rm_comma(rs1)) + "-" +
-                         reg_bin(rm_comma(rs2)) + "-NULL";
-            } else if(instrmap_i.count(tok)) {
-                string rd, opr;
-                (*p_ls) >> rd >> opr;
-                string imm, rs1;
-                size_t pos = opr.find('(');
-                if(pos != string::npos) {
-                    imm = opr.substr(0, pos);
-                    rs1 = opr.substr(pos+1, opr.find(')') - pos - 1);
-                } else {
-                    rs1 = opr;
-                    (*p_ls) >> imm;
-                }
-                mc = enc_i(tok, rm_comma(rd), rm_comma(rs1), rm_comma(imm));
-                I_t it = instrmap_i[tok];
-                string immB = imm_bin(rm_comma(imm), 12);
-                bin_cmt = it.op + "-" + it.f3 + "-NULL-" +
-                         reg_bin(rm_comma(rd)) + "-" +
-                         reg_bin(rm_comma(rs1)) + "-" + immB;
-            } else if(instrmap_st.count(tok)) {
-                string rs2, opr;
-                (*p_ls) >> rs2 >> opr;
-                string imm, rs1;
-                size_t pos = opr.find('(');
-                if(pos != string::npos) {
-                    imm = opr.substr(0, pos);
-                    rs1 = opr.substr(pos+1, opr.find(')') - pos - 1);
-                }
-                mc = enc_st(tok, rm_comma(rs2), rm_comma(rs1), rm_comma(imm));
-                string immB = imm_bin(rm_comma(imm), 12);
-                string f3;
-                if(tok == "sb")  f3 = "000";
-                if(tok == "sh")  f3 = "001";
-                if(tok == "sw")  f3 = "010";
-                if(tok == "sd")  f3 = "011";
-                bin_cmt = instrmap_st[tok] + "-" + f3 + "-NULL-NULL-" +
-                         reg_bin(rm_comma(rs1)) + "-" +
-                         reg_bin(rm_comma(rs2)) + "-" + immB;
-            } else if(instrmap_br.count(tok)) {
-                string rs1, rs2, imm;
-                (*p_ls) >> rs1 >> rs2 >> imm;
-                if(!is_num(imm)) {
-                    int off = lbl_map[imm] - (cur_txt+4);
-                    imm = to_string(off);
-                }
-                mc = enc_br(tok, rm_comma(rs1), rm_comma(rs2), rm_comma(imm));
-                string immB = imm_bin(rm_comma(imm), 13);
-                B_t br = instrmap_br[tok];
-                bin_cmt = br.op + "-" + br.f3 + "-NULL-NULL-" +
-                         reg_bin(rm_comma(rs1)) + "-" +
-                         reg_bin(rm_comma(rs2)) + "-" + immB;
-            } else if(instrmap_u.count(tok)) {
-                string rd, imm;
-                (*p_ls) >> rd >> imm;
-                mc = enc_u(tok, rm_comma(rd), rm_comma(imm));
-                string immB = imm_bin(rm_comma(imm), 20);
-                bin_cmt = instrmap_u[tok] + "-NULL-NULL-" +
-                         reg_bin(rm_comma(rd)) + "-NULL-" + immB;
-            } else if(instrmap_uj.count(tok)) {
-                string rd, lbl;
-                ls >> rd >> lbl;
-                int off = lbl_map[lbl] - cur_txt;
-                string imm = to_string(off);
-                mc = enc_uj(tok, rm_comma(rd), rm_comma(imm));
-                string immB = imm_bin(rm_comma(imm), 21);
-                bin_cmt = instrmap_uj[tok] + "-NULL-NULL-" +
-                         reg_bin(rm_comma(rd)) + "-NULL-" + immB;
-            } else {
+            if(!encode_txt(tok, *p_ls, cur_txt, mc, bin_cmt)) {
+                if(p_ls != &ls)
+                    delete p_ls;
+                continue;
+            }
+            unsigned int word = stoul(mc, nullptr, 2);
+            unsigned int half;
+            string cname;
+            if(compress && compress_instr(word, &half, cname)) {
+                ostringstream oss;
+                oss << "0x" << hex << cur_txt << " 0x"
+                    << setw(4) << setfill('0') << half
+                    << " , " << ln << " # " << cname;
+                txt_lines.push_back(oss.str());
+                cur_txt += 2;
                 if(p_ls != &ls)
                     delete p_ls;
                 continue;
             }
             ostringstream oss;
             oss << "0x" << hex << cur_txt << " 0x" 
-                << setw(8) << setfill('0') << stoul(mc, nullptr, 2)
+                << setw(8) << setfill('0') << word
                 << " , " << ln << " # " << bin_cmt;
             txt_lines.push_back(oss.str());
             cur_txt += 4;
@@ -539,6 +742,18 @@ int main() {
     }
     out.close();
     
+    // Write the text labels so the simulator's profiler can name hot spots.
+    ofstream sym("output.sym");
+    if(!sym) {
+        cerr << "Error: Unable to open output.sym for writing" << endl;
+        return 1;
+    }
+    for(auto &l : lbl_map) {
+        if(l.second < dat_base)
+            sym << "0x" << hex << l.second << " " << l.first << "\n";
+    }
+    sym.close();
+
     cout << "Successfully converted assembly to machine code in output.mc!" << endl;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,633 @@
+/* fuzz.cpp
+   Differential fuzzer (see fuzz.h).
+
+   A program is a prologue that points the base register into the data
+   segment and loads random values (biased towards 0, 1, -1 and the
+   extremes) into a small pool of registers, a body of random instructions
+   over the pool, and the exit word. Branches and jumps only go forward,
+   so every program ends; loads and stores address a small window through
+   the base register, which nothing else writes, so they stay in bounds and
+   often alias. The window starts out random, the rest of the data segment
+   zero.
+
+   Between programs the engine is reset from a dirty-page snapshot taken
+   after the data segment was filled, so only the pages the last program
+   wrote (its text and the data window) are copied back instead of all of
+   memory being cleared and reloaded. The reference only copies back its
+   data window.
+*/
+
+#include "fuzz.h"
+#include "myRISCVSim.h"
+#include "fastsim.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define DATA_SIZE  (MEM_SIZE - TEXT_SIZE)
+#define MAX_TEXT   (2 * (1 + FUZZ_POOL_REGS) + FUZZ_MAX_LENGTH + 1)
+#define EXIT_WORD  0xEF000011
+#define NOP        0x00000013     // addi x0, x0, 0
+#define WINDOW_BASE (DATA_OFFSET + FUZZ_DATA_BYTES / 2)
+#define MAX_SHOWN_WORDS 8
+
+enum FuzzStatus { FUZZ_EXIT, FUZZ_FAULT, FUZZ_LIMIT };
+
+static const char *status_names[] = {"exit", "fault", "limit"};
+
+// Final state of one side of a comparison
+struct FuzzResult {
+  unsigned int R[32];
+  unsigned long long instrs;
+  int status;
+  const unsigned char *data;    // The data segment
+};
+
+// ---------------------------------------------------------------------------
+// Reference model: RV32IM over the program words and the data segment,
+// decoded from the specification without the simulator's helpers
+
+static unsigned char ref_data[DATA_SIZE];
+static unsigned char initial_data[DATA_SIZE];
+
+static int sext(unsigned int v, int bits) {
+  return (int)(v << (32 - bits)) >> (32 - bits);
+}
+
+static bool ref_access(unsigned int addr, unsigned int size, unsigned int *off) {
+  *off = addr - DATA_OFFSET;
+  return addr >= DATA_OFFSET && *off <= DATA_SIZE - size;
+}
+
+static unsigned int ref_op(unsigned int instr, unsigned int a, unsigned int b, bool *ok) {
+  unsigned int funct3 = (instr >> 12) & 7;
+  unsigned int funct7 = instr >> 25;
+  if (funct7 == 0x01) {
+    switch (funct3) {
+      case 0: return a * b;
+      case 1: return (unsigned int)((long long)(int)a * (long long)(int)b >> 32);
+      case 2: return (unsigned int)((long long)(int)a * (long long)b >> 32);
+      case 3: return (unsigned int)((unsigned long long)a * b >> 32);
+      case 4:
+        if (b == 0) return 0xFFFFFFFF;
+        if (a == 0x80000000 && b == 0xFFFFFFFF) return 0x80000000;
+        return (unsigned int)((int)a / (int)b);
+      case 5: return b ? a / b : 0xFFFFFFFF;
+      case 6:
+        if (b == 0) return a;
+        if (a == 0x80000000 && b == 0xFFFFFFFF) return 0;
+        return (unsigned int)((int)a % (int)b);
+      default: return b ? a % b : a;
+    }
+  }
+  if (funct7 != 0x00 && !(funct7 == 0x20 && (funct3 == 0 || funct3 == 5))) {
+    *ok = false;
+    return 0;
+  }
+  switch (funct3) {
+    case 0: return (funct7 == 0x20) ? a - b : a + b;
+    case 1: return a << (b & 31);
+    case 2: return ((int)a < (int)b) ? 1 : 0;
+    case 3: return (a < b) ? 1 : 0;
+    case 4: return a ^ b;
+    case 5: return (funct7 == 0x20) ? (unsigned int)((int)a >> (b & 31)) : a >> (b & 31);
+    case 6: return a | b;
+    default: return a & b;
+  }
+}
+
+static void ref_run(const unsigned int *text, unsigned int n, unsigned long long limit,
+                    FuzzResult *r) {
+  unsigned int *R = r->R;
+  unsigned int pc = 0;
+  std::memset(R, 0, sizeof(r->R));
+  r->instrs = 0;
+  r->data = ref_data;
+  r->status = FUZZ_LIMIT;
+  while (r->instrs < limit) {
+    if ((pc & 3) || pc / 4 >= n) {
+      r->status = FUZZ_FAULT;
+      return;
+    }
+    unsigned int instr = text[pc / 4];
+    if (instr == EXIT_WORD) {
+      r->status = FUZZ_EXIT;
+      return;
+    }
+    unsigned int rd = (instr >> 7) & 31;
+    unsigned int a = R[(instr >> 15) & 31];
+    unsigned int b = R[(instr >> 20) & 31];
+    unsigned int funct3 = (instr >> 12) & 7;
+    int imm_i = sext(instr >> 20, 12);
+    unsigned int v = 0, off;
+    unsigned int next = pc + 4;
+    bool ok = true, write = true;
+    switch (instr & 0x7F) {
+      case 0x37: v = instr & 0xFFFFF000; break;
+      case 0x17: v = pc + (instr & 0xFFFFF000); break;
+      case 0x6F:
+        v = pc + 4;
+        next = pc + sext((instr >> 31) << 20 | ((instr >> 12) & 0xFF) << 12 |
+                         ((instr >> 20) & 1) << 11 | ((instr >> 21) & 0x3FF) << 1, 21);
+        break;
+      case 0x67:
+        v = pc + 4;
+        next = (a + imm_i) & ~1u;
+        ok = (funct3 == 0);
+        break;
+      case 0x63: {
+        bool taken;
+        switch (funct3) {
+          case 0: taken = (a == b); break;
+          case 1: taken = (a != b); break;
+          case 4: taken = ((int)a < (int)b); break;
+          case 5: taken = ((int)a >= (int)b); break;
+          case 6: taken = (a < b); break;
+          case 7: taken = (a >= b); break;
+          default: taken = ok = false; break;
+        }
+        if (taken)
+          next = pc + sext((instr >> 31) << 12 | ((instr >> 7) & 1) << 11 |
+                           ((instr >> 25) & 0x3F) << 5 | ((instr >> 8) & 0xF) << 1, 13);
+        write = false;
+        break;
+      }
+      case 0x03: {
+        unsigned int size = 1u << (funct3 & 3);
+        if (funct3 == 3 || funct3 > 5 || !ref_access(a + imm_i, size, &off)) {
+          ok = false;
+          break;
+        }
+        for (unsigned int i = 0; i < size; i++)
+          v |= (unsigned int)ref_data[off + i] << (8 * i);
+        if (funct3 == 0) v = (unsigned int)sext(v, 8);
+        if (funct3 == 1) v = (unsigned int)sext(v, 16);
+        break;
+      }
+      case 0x23: {
+        unsigned int size = 1u << funct3;
+        int imm_s = sext((instr >> 25) << 5 | ((instr >> 7) & 0x1F), 12);
+        if (funct3 > 2 || !ref_access(a + imm_s, size, &off)) {
+          ok = false;
+          break;
+        }
+        for (unsigned int i = 0; i < size; i++)
+          ref_data[off + i] = (unsigned char)(b >> (8 * i));
+        write = false;
+        break;
+      }
+      case 0x13: {
+        unsigned int shamt = (instr >> 20) & 31;
+        switch (funct3) {
+          case 0: v = a + imm_i; break;
+          case 1: v = a << shamt; ok = (instr >> 25) == 0x00; break;
+          case 2: v = ((int)a < imm_i) ? 1 : 0; break;
+          case 3: v = (a < (unsigned int)imm_i) ? 1 : 0; break;
+          case 4: v = a ^ imm_i; break;
+          case 5:
+            if ((instr >> 25) == 0x20) v = (unsigned int)((int)a >> shamt);
+            else { v = a >> shamt; ok = (instr >> 25) == 0x00; }
+            break;
+          case 6: v = a | imm_i; break;
+          default: v = a & imm_i; break;
+        }
+        break;
+      }
+      case 0x33: v = ref_op(instr, a, b, &ok); break;
+      default: ok = false; break;
+    }
+    if (!ok) {
+      r->status = FUZZ_FAULT;
+      return;
+    }
+    if (write && rd != 0)
+      R[rd] = v;
+    pc = next;
+    r->instrs++;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Engines under test, each set up once with the initial data segment and
+// reset from its snapshot before every program
+
+struct FuzzEngine {
+  const char *name;
+  void (*setup)();
+  void (*run)(const unsigned int *text, unsigned int n, unsigned long long limit, FuzzResult *r);
+};
+
+static void staged_setup() {
+  trace_enabled = 0;
+  reset_proc();
+  for (unsigned int i = 0; i < DATA_SIZE; i += 4) {
+    unsigned int word;
+    std::memcpy(&word, initial_data + i, 4);
+    poke_word(DATA_OFFSET + i, word);
+  }
+  snapshot_proc();
+}
+
+static void staged_run(const unsigned int *text, unsigned int n, unsigned long long limit,
+                       FuzzResult *r) {
+  restore_proc();
+  for (unsigned int i = 0; i < n; i++)
+    poke_word(i * 4, text[i]);
+  RetireInfo ri;
+  r->instrs = 0;
+  r->status = FUZZ_LIMIT;
+  while (r->instrs < limit) {
+    if (!step_RISCVsim(&ri)) {
+      r->status = FUZZ_EXIT;
+      break;
+    }
+    r->instrs++;
+  }
+  get_regs(r->R);
+  r->data = proc_memory() + TEXT_SIZE;
+}
+
+static FastSim fast_state;
+static FastSim fast_snap;
+
+static void fast_setup() {
+  unsigned int words[DATA_SIZE / 4];
+  std::memcpy(words, initial_data, DATA_SIZE);
+  fast_reset(&fast_state);
+  fast_poke(&fast_state, DATA_OFFSET, words, DATA_SIZE / 4);
+  fast_snapshot(&fast_state, &fast_snap);
+}
+
+static void fast_engine_run(const unsigned int *text, unsigned int n, unsigned long long limit,
+                            FuzzResult *r) {
+  fast_restore(&fast_state, &fast_snap);
+  fast_poke(&fast_state, 0, text, n);
+  fast_run(&fast_state, limit);
+  std::memcpy(r->R, fast_state.R, sizeof(r->R));
+  r->instrs = fast_state.instret;
+  r->status = fast_state.fault ? FUZZ_FAULT : fast_state.halted ? FUZZ_EXIT : FUZZ_LIMIT;
+  r->data = fast_state.MEM + TEXT_SIZE;
+}
+
+static const FuzzEngine engines[] = {
+  {"staged", staged_setup, staged_run},
+  {"fast", fast_setup, fast_engine_run}
+};
+
+// ---------------------------------------------------------------------------
+// Program generator
+
+enum OpFormat { FMT_R, FMT_I, FMT_SHIFT, FMT_LOAD, FMT_STORE, FMT_BRANCH, FMT_JAL, FMT_JALR, FMT_U };
+
+struct FuzzOp {
+  const char *name;
+  unsigned char format;
+  unsigned int match;         // Opcode, funct3 and funct7 bits
+};
+
+#define OP(opcode, funct3, funct7) ((opcode) | (funct3) << 12 | (unsigned int)(funct7) << 25)
+
+static const FuzzOp fuzz_ops[] = {
+  {"lui", FMT_U, 0x37}, {"auipc", FMT_U, 0x17},
+  {"jal", FMT_JAL, 0x6F}, {"jalr", FMT_JALR, 0x67},
+  {"beq", FMT_BRANCH, OP(0x63, 0, 0)}, {"bne", FMT_BRANCH, OP(0x63, 1, 0)},
+  {"blt", FMT_BRANCH, OP(0x63, 4, 0)}, {"bge", FMT_BRANCH, OP(0x63, 5, 0)},
+  {"bltu", FMT_BRANCH, OP(0x63, 6, 0)}, {"bgeu", FMT_BRANCH, OP(0x63, 7, 0)},
+  {"lb", FMT_LOAD, OP(0x03, 0, 0)}, {"lh", FMT_LOAD, OP(0x03, 1, 0)},
+  {"lw", FMT_LOAD, OP(0x03, 2, 0)}, {"lbu", FMT_LOAD, OP(0x03, 4, 0)},
+  {"lhu", FMT_LOAD, OP(0x03, 5, 0)},
+  {"sb", FMT_STORE, OP(0x23, 0, 0)}, {"sh", FMT_STORE, OP(0x23, 1, 0)},
+  {"sw", FMT_STORE, OP(0x23, 2, 0)},
+  {"addi", FMT_I, OP(0x13, 0, 0)}, {"slti", FMT_I, OP(0x13, 2, 0)},
+  {"sltiu", FMT_I, OP(0x13, 3, 0)}, {"xori", FMT_I, OP(0x13, 4, 0)},
+  {"ori", FMT_I, OP(0x13, 6, 0)}, {"andi", FMT_I, OP(0x13, 7, 0)},
+  {"slli", FMT_SHIFT, OP(0x13, 1, 0)}, {"srli", FMT_SHIFT, OP(0x13, 5, 0)},
+  {"srai", FMT_SHIFT, OP(0x13, 5, 0x20)},
+  {"add", FMT_R, OP(0x33, 0, 0)}, {"sub", FMT_R, OP(0x33, 0, 0x20)},
+  {"sll", FMT_R, OP(0x33, 1, 0)}, {"slt", FMT_R, OP(0x33, 2, 0)},
+  {"sltu", FMT_R, OP(0x33, 3, 0)}, {"xor", FMT_R, OP(0x33, 4, 0)},
+  {"srl", FMT_R, OP(0x33, 5, 0)}, {"sra", FMT_R, OP(0x33, 5, 0x20)},
+  {"or", FMT_R, OP(0x33, 6, 0)}, {"and", FMT_R, OP(0x33, 7, 0)},
+  {"mul", FMT_R, OP(0x33, 0, 1)}, {"mulh", FMT_R, OP(0x33, 1, 1)},
+  {"mulhsu", FMT_R, OP(0x33, 2, 1)}, {"mulhu", FMT_R, OP(0x33, 3, 1)},
+  {"div", FMT_R, OP(0x33, 4, 1)}, {"divu", FMT_R, OP(0x33, 5, 1)},
+  {"rem", FMT_R, OP(0x33, 6, 1)}, {"remu", FMT_R, OP(0x33, 7, 1)}
+};
+
+#define NUM_FUZZ_OPS (sizeof(fuzz_ops) / sizeof(fuzz_ops[0]))
+
+static const FuzzOp *enabled[NUM_FUZZ_OPS];
+static unsigned int num_enabled;
+
+static unsigned long long rng_state;
+
+// xorshift64*
+static unsigned int rng() {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (unsigned int)((rng_state * 2685821657736338717ULL) >> 32);
+}
+
+// A register or operand value, often one that sits on a boundary
+static unsigned int fuzz_value() {
+  static const unsigned int edges[] = {
+    0, 1, 2, 0xFFFFFFFF, 0xFFFFFFFE, 0x80000000, 0x7FFFFFFF, 0x80000001, 0x8000, 0xFFFF
+  };
+  switch (rng() & 3) {
+    case 0:  return edges[rng() % (sizeof(edges) / sizeof(edges[0]))];
+    case 1:  return (rng() & 31) - 16;
+    default: return rng();
+  }
+}
+
+static int fuzz_imm12() {
+  static const int edges[] = {0, 1, -1, 2047, -2048};
+  return (rng() & 3) ? sext(rng(), 12) : edges[rng() % 5];
+}
+
+static unsigned int enc_i(unsigned int match, unsigned int rd, unsigned int rs1, int imm) {
+  return match | rd << 7 | rs1 << 15 | ((unsigned int)imm & 0xFFF) << 20;
+}
+
+static unsigned int enc_s(unsigned int match, unsigned int rs1, unsigned int rs2, int imm) {
+  unsigned int u = (unsigned int)imm;
+  return match | (u & 0x1F) << 7 | rs1 << 15 | rs2 << 20 | ((u >> 5) & 0x7F) << 25;
+}
+
+static unsigned int enc_b(unsigned int match, unsigned int rs1, unsigned int rs2, int offset) {
+  unsigned int u = (unsigned int)offset;
+  return match | ((u >> 11) & 1) << 7 | ((u >> 1) & 0xF) << 8 | rs1 << 15 | rs2 << 20 |
+         ((u >> 5) & 0x3F) << 25 | ((u >> 12) & 1) << 31;
+}
+
+static unsigned int enc_j(unsigned int match, unsigned int rd, int offset) {
+  unsigned int u = (unsigned int)offset;
+  return match | rd << 7 | ((u >> 12) & 0xFF) << 12 | ((u >> 11) & 1) << 20 |
+         ((u >> 1) & 0x3FF) << 21 | ((u >> 20) & 1) << 31;
+}
+
+static unsigned int text[MAX_TEXT];
+static unsigned int text_len;
+static bool keep[MAX_TEXT];       // Words the minimizer must not replace
+static bool no_target[MAX_TEXT];  // JALRs, whose AUIPC must run first
+
+// A branch or jump whose target is picked once the body is laid out
+struct Fixup {
+  unsigned int at;
+  const FuzzOp *op;
+  unsigned int rd, rs1, rs2;
+};
+
+static Fixup fixups[FUZZ_MAX_LENGTH];
+static unsigned int num_fixups;
+
+// LUI + ADDI pair loading v into rd
+static void emit_load_value(unsigned int rd, unsigned int v) {
+  text[text_len++] = 0x37 | rd << 7 | ((v + 0x800) & 0xFFFFF000);
+  text[text_len++] = enc_i(0x13, rd, rd, sext(v & 0xFFF, 12));
+}
+
+// Offset from word at to a random word after it: up to 8 words on, at
+// most the exit word at end, never a JALR
+static int forward_offset(unsigned int at, unsigned int end) {
+  unsigned int span = (end - at < 8) ? end - at : 8;
+  unsigned int target = at + 1 + rng() % span;
+  while (no_target[target])
+    target++;
+  return (int)(target - at) * 4;
+}
+
+static void generate(unsigned int length) {
+  unsigned int base = 1 + rng() % 31;
+  unsigned int pool[FUZZ_POOL_REGS];
+  for (int i = 0; i < FUZZ_POOL_REGS; i++) {
+    do {
+      pool[i] = rng() & 31;
+    } while (pool[i] == base);
+  }
+
+  text_len = 0;
+  num_fixups = 0;
+  emit_load_value(base, WINDOW_BASE);
+  for (int i = 0; i < FUZZ_POOL_REGS; i++) {
+    if (pool[i] != 0)
+      emit_load_value(pool[i], fuzz_value());
+  }
+  unsigned int end = text_len + length;   // Index of the exit word
+  for (unsigned int i = 0; i <= end; i++)
+    keep[i] = (i < text_len || i == end);
+  std::memset(no_target, 0, (end + 1) * sizeof(bool));
+
+  while (text_len < end) {
+    const FuzzOp *op = enabled[rng() % num_enabled];
+    unsigned int rd = pool[rng() % FUZZ_POOL_REGS];
+    unsigned int rs1 = pool[rng() % FUZZ_POOL_REGS];
+    unsigned int rs2 = pool[rng() % FUZZ_POOL_REGS];
+    switch (op->format) {
+      case FMT_R:
+        text[text_len++] = op->match | rd << 7 | rs1 << 15 | rs2 << 20;
+        break;
+      case FMT_I:
+        text[text_len++] = enc_i(op->match, rd, rs1, fuzz_imm12());
+        break;
+      case FMT_SHIFT:
+        text[text_len++] = op->match | rd << 7 | rs1 << 15 | (rng() & 31) << 20;
+        break;
+      case FMT_LOAD:
+      case FMT_STORE: {
+        unsigned int size = 1u << ((op->match >> 12) & 3);
+        int disp = (int)(rng() % (FUZZ_DATA_BYTES / size) * size) - FUZZ_DATA_BYTES / 2;
+        text[text_len++] = (op->format == FMT_LOAD) ? enc_i(op->match, rd, base, disp)
+                                                    : enc_s(op->match, base, rs2, disp);
+        break;
+      }
+      case FMT_JALR:
+        // AUIPC of its own address into rs1, then the JALR
+        if (end - text_len < 2 || rs1 == 0) {
+          text[text_len++] = NOP;
+          break;
+        }
+        keep[text_len] = true;
+        text[text_len++] = 0x17 | rs1 << 7;
+        no_target[text_len] = true;
+        fixups[num_fixups++] = {text_len++, op, rd, rs1, rs2};
+        break;
+      case FMT_BRANCH:
+      case FMT_JAL:
+        fixups[num_fixups++] = {text_len++, op, rd, rs1, rs2};
+        break;
+      default:
+        text[text_len++] = op->match | rd << 7 | (rng() & 0xFFFFF000);
+        break;
+    }
+  }
+  text[text_len++] = EXIT_WORD;
+
+  for (unsigned int i = 0; i < num_fixups; i++) {
+    const Fixup &f = fixups[i];
+    int offset = forward_offset(f.at, end);
+    if (f.op->format == FMT_BRANCH)
+      text[f.at] = enc_b(f.op->match, f.rs1, f.rs2, offset);
+    else if (f.op->format == FMT_JAL)
+      text[f.at] = enc_j(f.op->match, f.rd, offset);
+    else  // From the AUIPC, sometimes with the low bit set for JALR to clear
+      text[f.at] = enc_i(f.op->match, f.rd, f.rs1, offset + 4 + (int)(rng() & 1));
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Comparison
+
+static FuzzResult engine_result, ref_result;
+
+static bool same_result(const FuzzResult &a, const FuzzResult &b) {
+  return a.status == b.status && a.instrs == b.instrs &&
+         std::memcmp(a.R, b.R, sizeof(a.R)) == 0 &&
+         std::memcmp(a.data, b.data, DATA_SIZE) == 0;
+}
+
+// Runs the current program on both sides; true if they agree
+static bool check(const FuzzEngine *e) {
+  unsigned long long limit = text_len + 1;
+  std::memcpy(ref_data, initial_data, FUZZ_DATA_BYTES);
+  ref_run(text, text_len, limit, &ref_result);
+  e->run(text, text_len, limit, &engine_result);
+  return same_result(engine_result, ref_result);
+}
+
+// Replaces body instructions by NOPs for as long as the mismatch remains
+static void minimize(const FuzzEngine *e) {
+  for (unsigned int i = 0; i < text_len; i++) {
+    if (keep[i] || text[i] == NOP)
+      continue;
+    unsigned int word = text[i];
+    text[i] = NOP;
+    if (check(e))
+      text[i] = word;
+  }
+  check(e);
+}
+
+static void write_failure(unsigned long long program, unsigned long long seed) {
+  FILE *fp = std::fopen(FUZZ_FAIL_FILE, "w");
+  if (fp == nullptr) {
+    std::printf("Error opening %s for writing\n", FUZZ_FAIL_FILE);
+    return;
+  }
+  std::fprintf(fp, "# fuzz program %llu of seed %llu\n", program, seed);
+  for (unsigned int i = 0; i < text_len; i++)
+    std::fprintf(fp, "%08x %08x\n", i * 4, text[i]);
+  for (unsigned int i = 0; i < DATA_SIZE; i += 4) {
+    unsigned int word;
+    std::memcpy(&word, initial_data + i, 4);
+    if (word != 0)
+      std::fprintf(fp, "%08x %08x\n", DATA_OFFSET + i, word);
+  }
+  std::fclose(fp);
+}
+
+static void report(const char *name) {
+  const FuzzResult &a = engine_result, &b = ref_result;
+  std::printf("  %-9s %s after %llu instructions\n", name, status_names[a.status], a.instrs);
+  std::printf("  %-9s %s after %llu instructions\n", "reference", status_names[b.status], b.instrs);
+  for (int i = 0; i < 32; i++) {
+    if (a.R[i] != b.R[i])
+      std::printf("  x%-2d %s=0x%08X reference=0x%08X\n", i, name, a.R[i], b.R[i]);
+  }
+  int shown = 0;
+  for (unsigned int i = 0; i < DATA_SIZE; i += 4) {
+    unsigned int wa, wb;
+    std::memcpy(&wa, a.data + i, 4);
+    std::memcpy(&wb, b.data + i, 4);
+    if (wa != wb && shown++ < MAX_SHOWN_WORDS)
+      std::printf("  mem[0x%08X] %s=0x%08X reference=0x%08X\n", DATA_OFFSET + i, name, wa, wb);
+  }
+  if (shown > MAX_SHOWN_WORDS)
+    std::printf("  ... %d more words differ\n", shown - MAX_SHOWN_WORDS);
+}
+
+static void select_ops(const char *ops) {
+  num_enabled = 0;
+  if (ops == nullptr) {
+    for (unsigned int i = 0; i < NUM_FUZZ_OPS; i++)
+      enabled[num_enabled++] = &fuzz_ops[i];
+    return;
+  }
+  char name[16];
+  const char *p = ops;
+  while (*p) {
+    size_t len = std::strcspn(p, ",");
+    unsigned int i = 0;
+    if (len < sizeof(name)) {
+      std::memcpy(name, p, len);
+      name[len] = '\0';
+      while (i < NUM_FUZZ_OPS && std::strcmp(fuzz_ops[i].name, name) != 0)
+        i++;
+    } else {
+      i = NUM_FUZZ_OPS;
+    }
+    if (i == NUM_FUZZ_OPS) {
+      std::printf("Unknown instruction %.*s in the fuzzing mix\n", (int)len, p);
+      std::exit(1);
+    }
+    enabled[num_enabled++] = &fuzz_ops[i];
+    p += len;
+    if (*p == ',') p++;
+    if (num_enabled == NUM_FUZZ_OPS) break;
+  }
+  if (num_enabled == 0) {
+    std::printf("The fuzzing mix is empty\n");
+    std::exit(1);
+  }
+}
+
+int run_fuzz(const char *engine, unsigned long long count, unsigned int length,
+             const char *ops, unsigned long long seed) {
+  const FuzzEngine *e = nullptr;
+  for (unsigned int i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+    if (std::strcmp(engines[i].name, engine) == 0)
+      e = &engines[i];
+  }
+  if (e == nullptr) {
+    std::printf("Unknown engine %s (expected staged or fast)\n", engine);
+    std::exit(1);
+  }
+  if (length < 1 || length > FUZZ_MAX_LENGTH) {
+    std::printf("Program length must be 1-%d\n", FUZZ_MAX_LENGTH);
+    std::exit(1);
+  }
+  select_ops(ops);
+
+  rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+  for (unsigned int i = 0; i < FUZZ_DATA_BYTES; i += 4) {
+    unsigned int word = fuzz_value();
+    std::memcpy(initial_data + i, &word, 4);
+  }
+  std::memcpy(ref_data, initial_data, DATA_SIZE);
+  e->setup();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  unsigned long long instrs = 0;
+  for (unsigned long long n = 0; n < count; n++) {
+    generate(length);
+    if (!check(e)) {
+      unsigned int words = text_len;
+      minimize(e);
+      write_failure(n, seed);
+      std::printf("FUZZ: MISMATCH on program #%llu of seed %llu (%u words), written to %s\n",
+                  n, seed, words, FUZZ_FAIL_FILE);
+      report(e->name);
+      return 1;
+    }
+    instrs += ref_result.instrs;
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  double secs = std::chrono::duration<double>(end - start).count();
+
+  std::printf("FUZZ: %s and the reference model agree on %llu programs (%llu instructions)\n",
+              e->name, count, instrs);
+  std::printf("FUZZ: %.3f s, %.0f programs/s\n", secs, secs > 0 ? count / secs : 0.0);
+  return 0;
+}
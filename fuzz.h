@@ -0,0 +1,21 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+// Differential fuzzing: random RV32IM programs are run on an engine and
+// on a reference model written straight from the ISA specification, and
+// the final registers, data memory and instruction counts compared.
+
+#define FUZZ_MAX_LENGTH 480         // Instructions of a program body
+#define FUZZ_POOL_REGS  8           // Registers one program computes with
+#define FUZZ_DATA_BYTES 256         // Data window loads and stores address
+#define FUZZ_FAIL_FILE  "fuzz-fail.mc"
+
+// Runs count programs of length instructions (plus a prologue setting up
+// the registers) on engine ("staged" or "fast"), drawn from the
+// comma-separated mnemonics of ops (null for all of RV32IM). The first
+// mismatch is reported and written to FUZZ_FAIL_FILE as a .mc program.
+// Returns 0 if all agreed, 1 otherwise.
+int run_fuzz(const char *engine, unsigned long long count, unsigned int length,
+             const char *ops, unsigned long long seed);
+
+#endif
@@ -0,0 +1,246 @@
+/* harts.cpp
+   Multi-hart simulation over one shared memory image. Each hart is a fast
+   interpreter with its own PC, registers and private copy of memory.
+
+   The harts run in parallel host threads for a quantum of instructions.
+   During the quantum a hart only sees its own stores, and it stops early
+   at an atomic or an ECALL. Between quanta a single thread:
+     1. commits the stores of every hart to shared memory in hart order,
+     2. replays the logged accesses through the coherence model, with the
+        harts interleaved instruction by instruction,
+     3. runs the pending atomics and system calls against shared memory in
+        hart order, and
+     4. refreshes every private copy from shared memory.
+   Nothing a hart observes depends on host thread timing, so every run
+   with the same quantum gives the same result.
+*/
+
+#include "harts.h"
+#include "fastsim.h"
+#include "coherence.h"
+#include "profiler.h"
+#include "syscall.h"
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+static FastSim harts[MAX_HARTS];
+static HartLog logs[MAX_HARTS];
+static unsigned char shared_mem[MEM_SIZE];
+
+// Reusable barrier for the coordinator and the worker threads
+struct QuantumBarrier {
+  std::mutex m;
+  std::condition_variable cv;
+  int parties = 0;
+  int waiting = 0;
+  unsigned long long generation = 0;
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(m);
+    unsigned long long gen = generation;
+    if (++waiting == parties) {
+      waiting = 0;
+      generation++;
+      cv.notify_all();
+    } else {
+      cv.wait(lock, [&] { return generation != gen; });
+    }
+  }
+};
+
+static QuantumBarrier barrier;
+static bool workers_stop = false;
+static int num_harts_run = 0;
+static int num_threads = 1;
+static unsigned long long quantum_end[MAX_HARTS];
+
+// Runs hart h until the end of its quantum, an atomic, an ECALL, the exit
+// word or a fault
+static void run_hart_quantum(int h) {
+  FastSim *s = &harts[h];
+  if (s->halted) return;
+  logs[h].count = 0;
+  logs[h].base = s->instret;
+  fast_run(s, quantum_end[h]);
+}
+
+static void worker(int t) {
+  for (;;) {
+    barrier.wait();
+    if (workers_stop) return;
+    for (int h = t; h < num_harts_run; h += num_threads)
+      run_hart_quantum(h);
+    barrier.wait();
+  }
+}
+
+// Clears the LR reservations other harts hold on the word at idx
+static void break_reservations(int writer, unsigned int idx) {
+  for (int h = 0; h < num_harts_run; h++) {
+    if (h == writer || !harts[h].reserved) continue;
+    int ridx = mem_index(harts[h].reserved_addr, 4);
+    if (ridx >= 0 && ((unsigned int)ridx >> 2) == (idx >> 2))
+      harts[h].reserved = false;
+  }
+}
+
+// Serial phase between two quanta
+static void end_quantum() {
+  bool text_written = false;
+
+  // 1. Stores, in hart order; a later hart wins a conflicting store
+  for (int h = 0; h < num_harts_run; h++) {
+    for (unsigned int i = 0; i < logs[h].count; i++) {
+      const MemAccess &m = logs[h].entries[i];
+      if (!m.write) continue;
+      std::memcpy(shared_mem + m.idx, harts[h].MEM + m.idx, m.size);
+      break_reservations(h, m.idx);
+      if (m.idx < TEXT_SIZE) text_written = true;
+    }
+  }
+
+  // 2. Coherence replay, merged by (step, hart)
+  unsigned int pos[MAX_HARTS] = {0};
+  for (;;) {
+    int next = -1;
+    for (int h = 0; h < num_harts_run; h++) {
+      if (pos[h] == logs[h].count) continue;
+      if (next < 0 || logs[h].entries[pos[h]].step < logs[next].entries[pos[next]].step)
+        next = h;
+    }
+    if (next < 0) break;
+    const MemAccess &m = logs[next].entries[pos[next]++];
+    coherence_access(next, m.idx, m.write);
+  }
+  for (int h = 0; h < num_harts_run; h++)
+    logs[h].count = 0;
+
+  // 3. Atomics and system calls, in hart order
+  for (int h = 0; h < num_harts_run; h++) {
+    if (!harts[h].serial_pending) continue;
+    if (harts[h].code[harts[h].PC >> 1].op == F_ECALL) {
+      // A read() may fill a buffer in the text segment
+      if (harts[h].R[17] == SYS_READ) text_written = true;
+      fast_ecall(&harts[h], shared_mem);
+      continue;
+    }
+    bool wrote = false;
+    int idx = fast_atomic(&harts[h], shared_mem, &wrote);
+    if (idx < 0) continue;
+    coherence_access(h, idx, wrote);
+    if (wrote) {
+      break_reservations(h, idx);
+      if (idx < TEXT_SIZE) text_written = true;
+    }
+  }
+
+  // 4. Refresh the private copies
+  for (int h = 0; h < num_harts_run; h++) {
+    std::memcpy(harts[h].MEM, shared_mem, MEM_SIZE);
+    if (text_written) fast_predecode(&harts[h]);
+  }
+}
+
+int run_harts(const char *file_name, int num_harts, unsigned int quantum,
+              int host_threads, int protocol, unsigned long long max_instrs) {
+  unsigned long long limit = max_instrs ? max_instrs : ~0ULL;
+  std::vector<MemAccess> log_storage((size_t)num_harts * quantum);
+
+  // The per-PC profile counters are not shared safely between threads
+  prof_enabled = 0;
+  num_harts_run = num_harts;
+  coherence_reset(num_harts, protocol);
+
+  fast_reset(&harts[0]);
+  fast_load(&harts[0], file_name);
+  std::memcpy(shared_mem, harts[0].MEM, MEM_SIZE);
+  for (int h = 0; h < num_harts; h++) {
+    if (h > 0) {
+      fast_reset(&harts[h]);
+      std::memcpy(harts[h].MEM, shared_mem, MEM_SIZE);
+      std::memcpy(harts[h].code, harts[0].code, sizeof(harts[0].code));
+    }
+    harts[h].R[10] = h;
+    harts[h].R[11] = num_harts;
+    logs[h].entries = &log_storage[(size_t)h * quantum];
+    logs[h].count = 0;
+    harts[h].log = &logs[h];
+  }
+
+  if (host_threads <= 0) {
+    host_threads = (int)std::thread::hardware_concurrency();
+    if (host_threads <= 0) host_threads = 1;
+  }
+  num_threads = (host_threads < num_harts) ? host_threads : num_harts;
+
+  std::vector<std::thread> workers;
+  barrier.parties = num_threads;     // Workers 1.., plus this thread as worker 0
+  workers_stop = false;
+  for (int t = 1; t < num_threads; t++)
+    workers.emplace_back(worker, t);
+
+  unsigned long long quanta = 0;
+  for (;;) {
+    bool running = false;
+    for (int h = 0; h < num_harts; h++) {
+      FastSim &s = harts[h];
+      unsigned long long end = s.instret + quantum;
+      quantum_end[h] = (end < limit) ? end : limit;
+      if (!s.halted && s.instret < limit) running = true;
+    }
+    if (!running) break;
+
+    if (num_threads > 1) barrier.wait();
+    for (int h = 0; h < num_harts; h += num_threads)
+      run_hart_quantum(h);
+    if (num_threads > 1) barrier.wait();
+
+    end_quantum();
+    quanta++;
+  }
+
+  if (num_threads > 1) {
+    workers_stop = true;
+    barrier.wait();
+    for (size_t t = 0; t < workers.size(); t++)
+      workers[t].join();
+  }
+
+  // Report
+  syscall_flush();
+  dump_data_memory(reinterpret_cast<char*>(shared_mem));
+  std::printf("\n=== HARTS (%d harts, quantum %u, %d host threads, %llu quanta) ===\n",
+              num_harts, quantum, num_threads, quanta);
+  int faulted = 0;
+  for (int h = 0; h < num_harts; h++) {
+    const FastSim &s = harts[h];
+    std::printf("Hart %d: %llu instructions, %llu memory cycles, PC 0x%08X%s\n", h,
+                s.instret, coherence_cycles(h), s.PC, s.fault ? " FAULT" : "");
+    if (s.fault) faulted = 1;
+  }
+
+  std::printf("\n=== REGISTER DUMP ===\n     ");
+  for (int h = 0; h < num_harts; h++)
+    std::printf(" %11s%d", "hart", h);
+  std::printf("\n");
+  for (int i = 0; i < 32; i++) {
+    std::printf("R%-2d =", i);
+    for (int h = 0; h < num_harts; h++)
+      std::printf(" %12d", (int)harts[h].R[i]);
+    std::printf("\n");
+  }
+  std::printf("\nFinal array:\n");
+  for (int i = 0; i < 10; i++) {
+    int val = read_word(reinterpret_cast<char*>(shared_mem), DATA_OFFSET + i * 4);
+    std::printf("[%d] = %d\n", i, val);
+  }
+  coherence_report();
+
+  for (int h = 0; h < num_harts; h++)
+    harts[h].log = nullptr;
+  return faulted ? 1 : syscall_exit_code;
+}
@@ -0,0 +1,14 @@
+#ifndef HARTS_H
+#define HARTS_H
+
+// Runs num_harts harts over one shared memory image, loaded from
+// file_name. Every hart starts at PC 0 with its hart id in a0 and the
+// number of harts in a1. Harts execute quantum instructions at a time on
+// host_threads threads (0 picks one per hart, up to the host's cores);
+// max_instrs caps the instructions of each hart (0 for no limit).
+// Returns 1 if any hart faulted, otherwise the status of the last exit
+// system call.
+int run_harts(const char *file_name, int num_harts, unsigned int quantum,
+              int host_threads, int protocol, unsigned long long max_instrs);
+
+#endif
@@ -0,0 +1,45 @@
+/* hostprof.cpp
+   Accumulators and summary of the host-side self-profiling timers.
+   Empty unless built with -DHOST_PROFILE.
+*/
+
+#include "hostprof.h"
+
+#ifdef HOST_PROFILE
+
+#include <cstdio>
+
+unsigned long long host_phase_ticks[NUM_HOST_PHASES];
+unsigned long long host_phase_calls[NUM_HOST_PHASES];
+unsigned long long host_phase_start[NUM_HOST_PHASES];
+
+static const char *phase_names[NUM_HOST_PHASES] = {
+  "load", "run", "fetch", "decode", "execute", "mem", "writeback",
+  "mem_access", "trace", "exit_dump"
+};
+
+// Taken when the program starts, to convert ticks to nanoseconds
+static const unsigned long long ticks_at_start = host_ticks();
+static const std::chrono::steady_clock::time_point clock_at_start =
+    std::chrono::steady_clock::now();
+
+// Times are inclusive: fetch..writeback nest inside run, and mem_access
+// and trace nest inside the stages that call them.
+void host_profile_report(unsigned long long instructions) {
+  double elapsed_ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - clock_at_start).count();
+  unsigned long long elapsed_ticks = host_ticks() - ticks_at_start;
+  double ns_per_tick = elapsed_ticks ? elapsed_ns / elapsed_ticks : 0.0;
+
+  std::printf("\n=== HOST PROFILE ===\n");
+  std::printf("Simulated instructions: %llu\n", instructions);
+  std::printf("%-12s %12s %14s %12s\n", "Phase", "Calls", "Total us", "ns/instr");
+  for (int i = 0; i < NUM_HOST_PHASES; i++) {
+    double ns = host_phase_ticks[i] * ns_per_tick;
+    std::printf("%-12s %12llu %14.1f %12.1f\n", phase_names[i],
+                host_phase_calls[i], ns / 1000.0,
+                instructions ? ns / instructions : 0.0);
+  }
+}
+
+#endif
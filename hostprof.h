@@ -0,0 +1,79 @@
+#ifndef HOSTPROF_H
+#define HOSTPROF_H
+
+// Host-side self-profiling of the simulator. Built only with
+// -DHOST_PROFILE (see the "profile" make target); otherwise every macro
+// below expands to nothing.
+
+enum HostPhase {
+  HP_LOAD,        // load_program_memory()
+  HP_RUN,         // main loop of run_RISCVsim()
+  HP_FETCH,
+  HP_DECODE,
+  HP_EXECUTE,
+  HP_MEM,
+  HP_WRITEBACK,
+  HP_MEM_ACCESS,  // read_word() / write_word()
+  HP_TRACE,       // per-stage trace printing
+  HP_EXIT,        // register and memory dumps in swi_exit()
+  NUM_HOST_PHASES
+};
+
+#ifdef HOST_PROFILE
+
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+extern unsigned long long host_phase_ticks[NUM_HOST_PHASES];
+extern unsigned long long host_phase_calls[NUM_HOST_PHASES];
+extern unsigned long long host_phase_start[NUM_HOST_PHASES];
+
+// Raw timestamp: the TSC where available, steady_clock nanoseconds otherwise
+inline unsigned long long host_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Adds the lifetime of the enclosing scope to a phase
+struct HostTimer {
+  int phase;
+  unsigned long long start;
+  explicit HostTimer(int p) : phase(p), start(host_ticks()) {}
+  ~HostTimer() {
+    host_phase_ticks[phase] += host_ticks() - start;
+    host_phase_calls[phase]++;
+  }
+};
+
+inline void host_phase_begin(int phase) {
+  host_phase_start[phase] = host_ticks();
+}
+
+inline void host_phase_end(int phase) {
+  host_phase_ticks[phase] += host_ticks() - host_phase_start[phase];
+  host_phase_calls[phase]++;
+}
+
+void host_profile_report(unsigned long long instructions);
+
+#define HOST_TIMER(phase)   HostTimer host_timer(phase)
+#define HOST_BEGIN(phase)   host_phase_begin(phase)
+#define HOST_END(phase)     host_phase_end(phase)
+#define HOST_REPORT(n)      host_profile_report(n)
+
+#else
+
+#define HOST_TIMER(phase)
+#define HOST_BEGIN(phase)
+#define HOST_END(phase)
+#define HOST_REPORT(n)
+
+#endif
+
+#endif
@@ -1,24 +1,352 @@
-
 /* main.cpp 
    Purpose of this file: The file handles the input and output, and
    invokes the simulator
 */
 
 #include "myRISCVSim.h"
+#include "profiler.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "fastsim.h"
+#include "cosim.h"
+#include "ooo.h"
+#include "harts.h"
+#include "coherence.h"
+#include "syscall.h"
+#include "timetravel.h"
+#include "fastdebug.h"
+#include "trace.h"
+#include "replay.h"
+#include "batch.h"
+#include "memprof.h"
+#include "serve.h"
+#include "pipeview.h"
+#include "fuzz.h"
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+
+static void usage() {
+  std::printf("Incorrect number of arguments. Please invoke the simulator as:\n"
+              "\t./myRISCVSim [options] <input mc file>\n"
+              "Options:\n"
+              "\t-q            suppress the per-stage trace\n"
+              "\t-profile      print a hot-spot profile at exit\n"
+              "\t-sym <file>   label file used by the profile report\n"
+              "\t-fast         run the predecoded fast interpreter\n"
+              "\t-max-instrs <n>  stop the fast interpreter or co-simulation after n instructions\n"
+              "\t-break <addr>     stop the fast interpreter or time travel before the instruction at addr\n"
+              "\t-watch <addr>[:len][:r|w|rw]  stop them after an access to the range (default 4 bytes, rw)\n"
+              "\t-batch <file>  run one instance per line of file (x<n>=<v> and <addr>=<v> inputs) in SIMD lanes\n"
+              "\t-batch-show <list>  registers and words printed per instance (default x10)\n"
+              "\t-cosim <a> <b>   run engines a and b (staged, fast, pipeline) in lockstep\n"
+              "\t-cosim-block  compare the co-simulated engines once per basic block\n"
+              "\t-trace-record <file>  run the fast interpreter and write a compressed trace\n"
+              "\t-trace-replay  time the trace given as the input file on the pipeline model\n"
+              "\t-configs <file>  configurations to replay, one per line (default: the pipeline knobs)\n"
+              "\t-memprof <prefix>  write reuse distance, working set and stride CSVs to <prefix>-*.csv\n"
+              "\t-memprof-line <n>  bytes per line of the memory profile (default 32)\n"
+              "\t-memprof-window <n>  instructions per working-set window (default 10000)\n"
+              "\t-serve <socket>  run programs sent to a Unix socket on -host-threads resident instances\n"
+              "\t-submit <socket>  run the input file on a serving simulator and print the reply\n"
+              "\t-submit-mem <list>  words returned by -submit, as <addr>[:<words>],...\n"
+              "\t-fuzz <n>     compare n random RV32IM programs between an engine and a reference model\n"
+              "\t-fuzz-engine <e>  engine to fuzz (staged or fast, default fast)\n"
+              "\t-fuzz-length <n>  instructions per fuzzed program (default 32)\n"
+              "\t-fuzz-ops <list>  mnemonics to draw from, as add,lw,... (default all of RV32IM)\n"
+              "\t-fuzz-seed <n>  seed of the fuzzing run (default 1)\n"
+              "\t-timetravel   step forward and back through the program from stdin commands\n"
+              "\t-snapshot-interval <n>  instructions between time-travel snapshots (default 100000)\n"
+              "\t-undo-log <n>  instructions kept in the time-travel undo log (default 65536)\n"
+              "\t-harts <n>    run n harts (1-8) over shared memory; a0 holds the hart id\n"
+              "\t-quantum <n>  instructions per hart between synchronizations (default 1000)\n"
+              "\t-host-threads <n>  host threads for the harts or the replay (default: one per core)\n"
+              "\t-coherence msi|mesi  coherence protocol of the cost model (default mesi)\n"
+              "\t-pipeline     run the five-stage in-order pipeline model\n"
+              "\t-forwarding   enable operand forwarding in the pipeline\n"
+              "\t-issue-width <n>   instructions per pipeline bundle (1-4, default 1)\n"
+              "\t-mem-ports <n>     loads/stores per bundle (default 1)\n"
+              "\t-muldiv-units <n>  multiplies/divides per bundle (default 1)\n"
+              "\t-div-latency <n>   cycles a DIV/REM spends in the pipeline's EX (default 1)\n"
+              "\t-mem-latency <n>   cycles a load/store spends in the pipeline's MEM (default 1)\n"
+              "\t-no-cycle-skip     simulate idle pipeline cycles one by one\n"
+              "\t-ooo          run the out-of-order timing model\n"
+              "\t-ooo-width <n>     fetch/dispatch/issue/commit width (1-8, default 4)\n"
+              "\t-rob <n> -iq <n> -lsq <n>  ROB, issue queue and load/store queue sizes\n"
+              "\t-alu-units <n>     ALUs of the out-of-order model (default 2)\n"
+              "\t-lat-mul <n> -lat-div <n> -lat-load <n>  functional unit latencies\n"
+              "\t-print-pipeline  trace every pipeline stage\n"
+              "\t-pipeview <file>  write a Konata (Kanata format) pipeline viewer log\n"
+              "\t-pipeview-cycles <first>:<last>  log only instructions fetched in these cycles\n"
+              "\t-print-regs   dump registers after the pipeline run\n"
+              "\t-stats-json <file>  write the pipeline counters as JSON\n"
+              "\t-stats-csv <file>   write the pipeline counters as CSV\n"
+              "\t-stats-interval <cycles> <file>  append counter deltas every N cycles\n");
+  std::exit(1);
+}
 
 int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::printf("Incorrect number of arguments. Please invoke the simulator as:\n\t./myRISCVSim <input mc file>\n");
-        std::exit(1);
+    char *input = nullptr;
+    bool pipeline = false;
+    bool ooo = false;
+    int num_harts = 0;
+    unsigned int quantum = 1000;
+    int host_threads = 0;
+    int protocol = PROTO_MESI;
+    bool fast = false;
+    bool cosim_block = false;
+    bool timetravel = false;
+    const char *trace_file = nullptr;
+    bool replay = false;
+    const char *config_file = nullptr;
+    const char *batch_file = nullptr;
+    const char *batch_show = "x10";
+    const char *memprof_prefix = nullptr;
+    unsigned int memprof_line = 32;
+    unsigned long long memprof_window = 10000;
+    const char *serve_socket = nullptr;
+    const char *submit_socket = nullptr;
+    const char *submit_mem = nullptr;
+    unsigned long long fuzz_count = 0;
+    const char *fuzz_engine = "fast";
+    unsigned int fuzz_length = 32;
+    const char *fuzz_ops = nullptr;
+    unsigned long long fuzz_seed = 1;
+    unsigned long long snapshot_interval = 100000;
+    unsigned long long undo_entries = 65536;
+    const char *cosim_a = nullptr;
+    const char *cosim_b = nullptr;
+    unsigned long long max_instrs = 0;
+    const char *stats_json = nullptr;
+    const char *stats_csv = nullptr;
+    const char *pipeview_file = nullptr;
+    unsigned long long pipeview_first = 0;
+    unsigned long long pipeview_last = ~0ULL;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-q") == 0)
+            trace_enabled = 0;
+        else if (std::strcmp(argv[i], "-profile") == 0)
+            prof_enabled = 1;
+        else if (std::strcmp(argv[i], "-sym") == 0 && i + 1 < argc)
+            profiler_load_symbols(argv[++i]);
+        else if (std::strcmp(argv[i], "-fast") == 0)
+            fast = true;
+        else if (std::strcmp(argv[i], "-max-instrs") == 0 && i + 1 < argc)
+            max_instrs = std::strtoull(argv[++i], nullptr, 0);
+        else if (std::strcmp(argv[i], "-break") == 0 && i + 1 < argc) {
+            if (!debug_option_break(argv[++i])) usage();
+        }
+        else if (std::strcmp(argv[i], "-watch") == 0 && i + 1 < argc) {
+            if (!debug_option_watch(argv[++i])) usage();
+        }
+        else if (std::strcmp(argv[i], "-batch") == 0 && i + 1 < argc)
+            batch_file = argv[++i];
+        else if (std::strcmp(argv[i], "-batch-show") == 0 && i + 1 < argc)
+            batch_show = argv[++i];
+        else if (std::strcmp(argv[i], "-cosim") == 0 && i + 2 < argc) {
+            cosim_a = argv[i + 1];
+            cosim_b = argv[i + 2];
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "-cosim-block") == 0)
+            cosim_block = true;
+        else if (std::strcmp(argv[i], "-trace-record") == 0 && i + 1 < argc)
+            trace_file = argv[++i];
+        else if (std::strcmp(argv[i], "-trace-replay") == 0)
+            replay = true;
+        else if (std::strcmp(argv[i], "-configs") == 0 && i + 1 < argc)
+            config_file = argv[++i];
+        else if (std::strcmp(argv[i], "-memprof") == 0 && i + 1 < argc)
+            memprof_prefix = argv[++i];
+        else if (std::strcmp(argv[i], "-memprof-line") == 0 && i + 1 < argc)
+            memprof_line = (unsigned int)std::strtoul(argv[++i], nullptr, 0);
+        else if (std::strcmp(argv[i], "-memprof-window") == 0 && i + 1 < argc)
+            memprof_window = std::strtoull(argv[++i], nullptr, 0);
+        else if (std::strcmp(argv[i], "-serve") == 0 && i + 1 < argc)
+            serve_socket = argv[++i];
+        else if (std::strcmp(argv[i], "-submit") == 0 && i + 1 < argc)
+            submit_socket = argv[++i];
+        else if (std::strcmp(argv[i], "-submit-mem") == 0 && i + 1 < argc)
+            submit_mem = argv[++i];
+        else if (std::strcmp(argv[i], "-fuzz") == 0 && i + 1 < argc)
+            fuzz_count = std::strtoull(argv[++i], nullptr, 0);
+        else if (std::strcmp(argv[i], "-fuzz-engine") == 0 && i + 1 < argc)
+            fuzz_engine = argv[++i];
+        else if (std::strcmp(argv[i], "-fuzz-length") == 0 && i + 1 < argc)
+            fuzz_length = (unsigned int)std::strtoul(argv[++i], nullptr, 0);
+        else if (std::strcmp(argv[i], "-fuzz-ops") == 0 && i + 1 < argc)
+            fuzz_ops = argv[++i];
+        else if (std::strcmp(argv[i], "-fuzz-seed") == 0 && i + 1 < argc)
+            fuzz_seed = std::strtoull(argv[++i], nullptr, 0);
+        else if (std::strcmp(argv[i], "-timetravel") == 0)
+            timetravel = true;
+        else if (std::strcmp(argv[i], "-snapshot-interval") == 0 && i + 1 < argc)
+            snapshot_interval = std::strtoull(argv[++i], nullptr, 0);
+        else if (std::strcmp(argv[i], "-undo-log") == 0 && i + 1 < argc)
+            undo_entries = std::strtoull(argv[++i], nullptr, 0);
+        else if (std::strcmp(argv[i], "-pipeline") == 0)
+            pipeline = true;
+        else if (std::strcmp(argv[i], "-harts") == 0 && i + 1 < argc)
+            num_harts = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-quantum") == 0 && i + 1 < argc)
+            quantum = (unsigned int)std::strtoul(argv[++i], nullptr, 0);
+        else if (std::strcmp(argv[i], "-host-threads") == 0 && i + 1 < argc)
+            host_threads = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-coherence") == 0 && i + 1 < argc) {
+            protocol = coherence_protocol(argv[++i]);
+            if (protocol < 0) usage();
+        }
+        else if (std::strcmp(argv[i], "-ooo") == 0)
+            ooo = true;
+        else if (std::strcmp(argv[i], "-ooo-width") == 0 && i + 1 < argc)
+            KNOB_OOO_WIDTH = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-rob") == 0 && i + 1 < argc)
+            KNOB_ROB_SIZE = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-iq") == 0 && i + 1 < argc)
+            KNOB_IQ_SIZE = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-lsq") == 0 && i + 1 < argc)
+            KNOB_LSQ_SIZE = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-alu-units") == 0 && i + 1 < argc)
+            KNOB_ALU_UNITS = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-lat-mul") == 0 && i + 1 < argc)
+            KNOB_LAT_MUL = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-lat-div") == 0 && i + 1 < argc)
+            KNOB_LAT_DIV = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-lat-load") == 0 && i + 1 < argc)
+            KNOB_LAT_LOAD = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-forwarding") == 0)
+            KNOB_FORWARDING = true;
+        else if (std::strcmp(argv[i], "-issue-width") == 0 && i + 1 < argc)
+            KNOB_ISSUE_WIDTH = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-mem-ports") == 0 && i + 1 < argc)
+            KNOB_MEM_PORTS = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-muldiv-units") == 0 && i + 1 < argc)
+            KNOB_MULDIV_UNITS = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-div-latency") == 0 && i + 1 < argc)
+            KNOB_DIV_LATENCY = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-mem-latency") == 0 && i + 1 < argc)
+            KNOB_MEM_LATENCY = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-no-cycle-skip") == 0)
+            KNOB_CYCLE_SKIP = false;
+        else if (std::strcmp(argv[i], "-print-pipeline") == 0)
+            KNOB_PRINT_PIPELINE = true;
+        else if (std::strcmp(argv[i], "-pipeview") == 0 && i + 1 < argc)
+            pipeview_file = argv[++i];
+        else if (std::strcmp(argv[i], "-pipeview-cycles") == 0 && i + 1 < argc) {
+            char *end;
+            pipeview_first = std::strtoull(argv[++i], &end, 0);
+            if (*end != ':') usage();
+            pipeview_last = std::strtoull(end + 1, &end, 0);
+            if (*end != '\0' || pipeview_last < pipeview_first) usage();
+        }
+        else if (std::strcmp(argv[i], "-print-regs") == 0)
+            KNOB_PRINT_REGS = true;
+        else if (std::strcmp(argv[i], "-stats-json") == 0 && i + 1 < argc)
+            stats_json = argv[++i];
+        else if (std::strcmp(argv[i], "-stats-csv") == 0 && i + 1 < argc)
+            stats_csv = argv[++i];
+        else if (std::strcmp(argv[i], "-stats-interval") == 0 && i + 2 < argc) {
+            unsigned long long cycles = std::strtoull(argv[i + 1], nullptr, 0);
+            if (cycles == 0) usage();
+            stats_set_interval(cycles, argv[i + 2]);
+            i += 2;
+        }
+        else if (argv[i][0] != '-' && input == nullptr)
+            input = argv[i];
+        else
+            usage();
+    }
+    if (serve_socket != nullptr)
+        return run_serve(serve_socket, host_threads, max_instrs);
+    if (fuzz_count != 0)
+        return run_fuzz(fuzz_engine, fuzz_count, fuzz_length, fuzz_ops, fuzz_seed);
+    if (input == nullptr)
+        usage();
+    if (KNOB_ISSUE_WIDTH < 1 || KNOB_ISSUE_WIDTH > MAX_ISSUE_WIDTH ||
+        KNOB_MEM_PORTS < 1 || KNOB_MULDIV_UNITS < 1 || KNOB_DIV_LATENCY < 1 || KNOB_MEM_LATENCY < 1) {
+        std::printf("Issue width must be 1-%d and unit counts and latencies at least 1\n", MAX_ISSUE_WIDTH);
+        return 1;
+    }
+
+    if (ooo && !ooo_knobs_valid()) {
+        std::printf("Invalid out-of-order configuration (width 1-%d, ROB 1-%d, at most %d mul/div units)\n",
+                    MAX_OOO_WIDTH, MAX_ROB_SIZE, MAX_FU_UNITS);
+        return 1;
+    }
+
+    if (num_harts != 0) {
+        if (num_harts < 1 || num_harts > MAX_HARTS || quantum < 1) {
+            std::printf("Hart count must be 1-%d and the quantum at least 1\n", MAX_HARTS);
+            return 1;
+        }
+        return run_harts(input, num_harts, quantum, host_threads, protocol, max_instrs);
+    }
+
+    if (batch_file != nullptr)
+        return run_batch(input, batch_file, batch_show, max_instrs);
+
+    if (trace_file != nullptr)
+        return trace_record(input, trace_file, max_instrs);
+
+    if (submit_socket != nullptr)
+        return run_submit(submit_socket, input, submit_mem, max_instrs);
+
+    if (memprof_prefix != nullptr)
+        return run_memprof(input, memprof_prefix, memprof_line, memprof_window, max_instrs);
+
+    if (replay)
+        return run_replay(input, config_file, host_threads, stats_json);
+
+    if (timetravel) {
+        if (snapshot_interval < 1 || undo_entries < 1 || undo_entries > 0xFFFFFFFFULL) {
+            std::printf("Snapshot interval and undo log size must be at least 1\n");
+            return 1;
+        }
+        return run_timetravel(input, snapshot_interval, (unsigned int)undo_entries);
+    }
+
+    if (cosim_a != nullptr)
+        return run_cosim(cosim_a, cosim_b, input, cosim_block, max_instrs);
+
+    if (fast) {
+        static FastSim sim;
+        fast_reset(&sim);
+        profiler_reset();
+        fast_load(&sim, input);
+        if (!fast_debug_apply(&sim))
+            return 1;
+        fast_run(&sim, max_instrs);
+        fast_stop_report(&sim);
+        fast_dump(&sim);
+        return sim.fault ? 1 : syscall_exit_code;
+    }
+
+    if (ooo) {
+        reset_ooo();
+        load_ooo_program(input);
+        run_ooo_simulator();
+        if (stats_json) stats_write_json(stats_json);
+        if (stats_csv) stats_write_csv(stats_csv);
+        return syscall_exit_code;
+    }
+
+    if (pipeline) {
+        reset_pipeline();
+        load_pipeline_program(input);
+        if (pipeview_file) pipeview_open(pipeview_file, pipeview_first, pipeview_last);
+        run_pipeline_simulator();
+        pipeview_close();
+        if (stats_json) stats_write_json(stats_json);
+        if (stats_csv) stats_write_csv(stats_csv);
+        return pipeline_faulted() ? 1 : syscall_exit_code;
     }
   
     // Reset the processor state
     reset_proc();
+    profiler_reset();
   
     // Load the program from the .mc file
-    load_program_memory(argv[1]);
+    load_program_memory(input);
   
     // Run the simulator
     run_RISCVsim();
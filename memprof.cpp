@@ -0,0 +1,303 @@
+/* memprof.cpp
+   Memory access characterization (see memprof.h).
+
+   The reuse distance of an access is the number of distinct lines touched
+   since the previous access to its line: the access hits in a fully
+   associative LRU cache of more lines than that. Every access takes the
+   next timestamp, and a Fenwick tree over the timestamps holds a one at
+   the latest access of each line, so the distance is the number of ones
+   after the line's previous timestamp, found in O(log n). When the
+   timestamps run out the live ones are renumbered in order and the tree
+   rebuilt, so its size is a small multiple of the number of lines however
+   long the run is.
+*/
+
+#include "memprof.h"
+#include "fastsim.h"
+#include "syscall.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define NO_TIME       0xFFFFFFFFu
+#define REUSE_BUCKETS 33            // Distance 0, then [2^k, 2^(k+1)) for k = 0..31
+
+static unsigned int line_shift;
+static unsigned int num_lines;
+
+// Reuse distances
+static std::vector<unsigned int> tree;       // Fenwick tree over timestamps, 1-based
+static std::vector<unsigned int> owner;      // Line accessed at each timestamp
+static std::vector<unsigned int> last_time;  // Latest timestamp of each line
+static unsigned int now;
+static unsigned long long reuse_hist[REUSE_BUCKETS];
+static unsigned long long cold;              // First accesses to a line
+static unsigned long long accesses;
+
+// Working set
+static FILE *wss_fp;
+static unsigned long long window_len;
+static unsigned long long window_start;
+static unsigned long long window_id;
+static std::vector<unsigned long long> touched;  // window_id + 1 of the line's last access
+static unsigned long long window_accesses;
+static unsigned long long window_lines;
+static unsigned long long window_new;
+static unsigned long long peak_lines;
+
+// Strides, per instruction slot
+enum AccessKind { KIND_NONE, KIND_LOAD, KIND_STORE, KIND_ATOMIC };
+
+struct StrideInfo {
+  unsigned long long accesses;
+  unsigned long long hits;    // Accesses whose stride repeated the one before
+  unsigned long long votes;   // Majority vote over the strides
+  unsigned int last_addr;
+  int last_stride;
+  int candidate;
+  unsigned char kind;
+};
+
+static StrideInfo strides[FAST_SLOTS];
+
+static int access_kind(unsigned char op) {
+  if ((op >= F_LB && op <= F_LHU) || op == F_LR) return KIND_LOAD;
+  if ((op >= F_SB && op <= F_SW) || op == F_SC) return KIND_STORE;
+  if (op == F_AMO) return KIND_ATOMIC;
+  return KIND_NONE;
+}
+
+// Bytes an access of op covers
+static unsigned int access_size(unsigned char op) {
+  if (op == F_LB || op == F_LBU || op == F_SB) return 1;
+  if (op == F_LH || op == F_LHU || op == F_SH) return 2;
+  return 4;
+}
+
+static const char *kind_name(int kind) {
+  return kind == KIND_LOAD ? "load" : kind == KIND_STORE ? "store" : "atomic";
+}
+
+static void tree_add(unsigned int t, unsigned int v) {
+  for (unsigned int i = t + 1; i < tree.size(); i += i & (0u - i))
+    tree[i] += v;
+}
+
+// Ones at timestamps below t
+static unsigned int tree_sum(unsigned int t) {
+  unsigned int n = 0;
+  for (unsigned int i = t; i > 0; i -= i & (0u - i))
+    n += tree[i];
+  return n;
+}
+
+// Renumbers the latest timestamp of every line to 0..k-1, keeping their
+// order, and rebuilds the tree with ones there
+static void reuse_compact() {
+  unsigned int k = 0;
+  for (unsigned int t = 0; t < now; t++) {
+    unsigned int line = owner[t];
+    if (last_time[line] == t) {
+      owner[k] = line;
+      last_time[line] = k++;
+    }
+  }
+  now = k;
+  std::fill(tree.begin(), tree.end(), 0u);
+  for (unsigned int i = 1; i < tree.size(); i++) {
+    if (i <= k) tree[i]++;
+    unsigned int parent = i + (i & (0u - i));
+    if (parent < tree.size()) tree[parent] += tree[i];
+  }
+}
+
+static int reuse_bucket(unsigned int d) {
+  int b = 0;
+  while (d) {
+    b++;
+    d >>= 1;
+  }
+  return b;
+}
+
+static void reuse_access(unsigned int line) {
+  if (now == tree.size() - 1)
+    reuse_compact();
+  unsigned int last = last_time[line];
+  if (last == NO_TIME) {
+    cold++;
+  } else {
+    reuse_hist[reuse_bucket(tree_sum(now) - tree_sum(last + 1))]++;
+    tree_add(last, 0u - 1);
+  }
+  tree_add(now, 1);
+  owner[now] = line;
+  last_time[line] = now++;
+}
+
+// Writes the row of the current window and starts the next one at instret
+static void wss_flush(unsigned long long instret) {
+  std::fprintf(wss_fp, "%llu,%llu,%llu,%llu,%llu,%llu\n", window_start, instret,
+               window_accesses, window_lines, window_lines << line_shift, window_new);
+  peak_lines = std::max(peak_lines, window_lines);
+  window_start = instret;
+  window_id++;
+  window_accesses = window_lines = window_new = 0;
+}
+
+static void wss_access(unsigned int line, bool first) {
+  window_accesses++;
+  if (touched[line] != window_id + 1) {
+    touched[line] = window_id + 1;
+    window_lines++;
+  }
+  if (first) window_new++;
+}
+
+static void stride_access(unsigned int pc, int kind, unsigned int addr) {
+  StrideInfo &si = strides[pc >> 1];
+  if (si.accesses > 0) {
+    int stride = (int)(addr - si.last_addr);
+    if (si.accesses > 1 && stride == si.last_stride) si.hits++;
+    if (si.votes == 0) {
+      si.candidate = stride;
+      si.votes = 1;
+    } else if (stride == si.candidate) {
+      si.votes++;
+    } else {
+      si.votes--;
+    }
+    si.last_stride = stride;
+  }
+  si.last_addr = addr;
+  si.kind = (unsigned char)kind;
+  si.accesses++;
+}
+
+static FILE *open_csv(const char *prefix, const char *suffix, char *name, size_t size) {
+  std::snprintf(name, size, "%s-%s.csv", prefix, suffix);
+  FILE *fp = std::fopen(name, "w");
+  if (fp == nullptr) {
+    std::printf("Error opening %s for writing\n", name);
+    std::exit(1);
+  }
+  return fp;
+}
+
+// One row per distance bucket up to the largest seen, with the hit rate
+// of an LRU cache just big enough for every distance in it and below
+static void write_reuse(FILE *fp) {
+  int top = 0;
+  for (int b = 0; b < REUSE_BUCKETS; b++)
+    if (reuse_hist[b]) top = b;
+  std::fprintf(fp, "min_distance,max_distance,accesses,fraction,lru_lines,lru_bytes,lru_hit_rate\n");
+  unsigned long long hits = 0;
+  for (int b = 0; b <= top && accesses > cold; b++) {
+    unsigned long long lo = b ? 1ULL << (b - 1) : 0;
+    unsigned long long hi = b ? (1ULL << b) - 1 : 0;
+    hits += reuse_hist[b];
+    std::fprintf(fp, "%llu,%llu,%llu,%.6f,%llu,%llu,%.6f\n", lo, hi, reuse_hist[b],
+                 (double)reuse_hist[b] / accesses, hi + 1, (hi + 1) << line_shift,
+                 (double)hits / accesses);
+  }
+  std::fprintf(fp, "cold,,%llu,%.6f,,,\n", cold, accesses ? (double)cold / accesses : 0.0);
+}
+
+static void write_strides(FILE *fp) {
+  std::fprintf(fp, "pc,kind,accesses,stride,stride_hits,hit_rate,pattern\n");
+  for (int i = 0; i < FAST_SLOTS; i++) {
+    const StrideInfo &si = strides[i];
+    if (si.accesses == 0)
+      continue;
+    // A pattern needs two strides to repeat
+    double rate = si.accesses > 2 ? (double)si.hits / (si.accesses - 2) : 0.0;
+    const char *pattern = si.accesses < 3 ? "short"
+                          : rate < 0.75   ? "irregular"
+                          : si.candidate  ? "strided"
+                                          : "constant";
+    std::fprintf(fp, "0x%X,%s,%llu,%d,%llu,%.4f,%s\n", i << 1, kind_name(si.kind),
+                 si.accesses, si.candidate, si.hits, rate, pattern);
+  }
+}
+
+int run_memprof(const char *file_name, const char *prefix, unsigned int line_bytes,
+                unsigned long long window, unsigned long long max_instrs) {
+  if (line_bytes == 0 || (line_bytes & (line_bytes - 1)) || line_bytes > MEMPROF_MAX_LINE ||
+      window == 0) {
+    std::printf("Line size must be a power of two up to %d and the window at least 1\n",
+                MEMPROF_MAX_LINE);
+    return 1;
+  }
+  static FastSim sim;
+  FastSim *s = &sim;
+  fast_reset(s);
+  fast_load(s, file_name);
+
+  line_shift = 0;
+  while ((1u << line_shift) < line_bytes)
+    line_shift++;
+  num_lines = MEM_SIZE >> line_shift;
+  tree.assign(std::max(2 * num_lines, (unsigned int)MEMPROF_MIN_TREE) + 1, 0u);
+  owner.assign(tree.size(), 0u);
+  last_time.assign(num_lines, NO_TIME);
+  touched.assign(num_lines, 0ULL);
+  now = 0;
+  cold = accesses = 0;
+  std::fill(reuse_hist, reuse_hist + REUSE_BUCKETS, 0ULL);
+  std::fill(strides, strides + FAST_SLOTS, StrideInfo());
+
+  char reuse_name[512], wss_name[512], stride_name[512];
+  FILE *reuse_fp = open_csv(prefix, "reuse", reuse_name, sizeof(reuse_name));
+  wss_fp = open_csv(prefix, "wss", wss_name, sizeof(wss_name));
+  FILE *stride_fp = open_csv(prefix, "stride", stride_name, sizeof(stride_name));
+  std::fprintf(wss_fp, "start_instr,end_instr,accesses,lines,bytes,new_lines\n");
+  window_len = window;
+  window_start = window_id = 0;
+  window_accesses = window_lines = window_new = peak_lines = 0;
+
+  RetireInfo ri;
+  while (max_instrs == 0 || s->instret < max_instrs) {
+    if (s->instret - window_start == window_len)
+      wss_flush(s->instret);
+    // The effective address comes from the registers before the
+    // instruction runs; an access outside MEM faults the step below
+    if (s->PC < TEXT_SIZE && !(s->PC & 1)) {
+      const DecodedInstr &d = fast_decoded(s, s->PC);
+      int kind = access_kind(d.op);
+      if (kind != KIND_NONE) {
+        unsigned int addr = s->R[d.rs1] + (unsigned int)d.imm;
+        int idx = mem_index(addr, access_size(d.op));
+        if (idx >= 0) {
+          unsigned int line = (unsigned int)idx >> line_shift;
+          accesses++;
+          wss_access(line, last_time[line] == NO_TIME);
+          reuse_access(line);
+          stride_access(s->PC, kind, addr);
+        }
+      }
+    }
+    if (!fast_step(s, &ri))
+      break;
+  }
+  syscall_flush();
+  if (s->instret > window_start)
+    wss_flush(s->instret);
+
+  write_reuse(reuse_fp);
+  write_strides(stride_fp);
+  std::fclose(reuse_fp);
+  std::fclose(wss_fp);
+  std::fclose(stride_fp);
+
+  unsigned long long lines_used = 0;
+  for (unsigned int l = 0; l < num_lines; l++)
+    if (last_time[l] != NO_TIME) lines_used++;
+  std::printf("Memory profile: %llu instructions, %llu accesses to %llu lines of %u bytes, "
+              "peak working set %llu lines per %llu instructions\n",
+              s->instret, accesses, lines_used, line_bytes, peak_lines, window_len);
+  std::printf("Wrote %s, %s and %s\n", reuse_name, wss_name, stride_name);
+  if (s->fault)
+    std::printf("FAULT at PC 0x%08X\n", s->PC);
+  return s->fault ? 1 : syscall_exit_code;
+}
@@ -0,0 +1,19 @@
+#ifndef MEMPROF_H
+#define MEMPROF_H
+
+// Memory access characterization of a program run on the fast
+// interpreter: LRU reuse distances, working-set sizes and per-instruction
+// strides of the data accesses (loads, stores and atomics).
+
+#define MEMPROF_MAX_LINE 1024       // Largest line size in bytes
+#define MEMPROF_MIN_TREE 4096       // Smallest timestamp range of the reuse tree
+
+// Runs file_name for up to max_instrs instructions (0 for no limit) and
+// writes <prefix>-reuse.csv, <prefix>-wss.csv and <prefix>-stride.csv.
+// Accesses are tracked per line of line_bytes bytes (a power of two); the
+// working set is measured over windows of window instructions. Returns
+// the exit status of the program, or 1 if it faulted.
+int run_memprof(const char *file_name, const char *prefix, unsigned int line_bytes,
+                unsigned long long window, unsigned long long max_instrs);
+
+#endif
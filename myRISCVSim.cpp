@@ -4,20 +4,22 @@
 */
 
 #include "myRISCVSim.h"
+#include "profiler.h"
+#include "hostprof.h"
+#include "syscall.h"
+#include "rvc.h"
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
 
-#define MEM_SIZE 8192
-#define DATA_OFFSET 0x10000000
-
 // Memory array
 static unsigned char MEM[MEM_SIZE];
 
 // Processor structure grouping registers and state
 struct Processor {
     unsigned int PC;            // Program Counter
-    unsigned int IR;            // Instruction Register
+    unsigned int IR;            // Instruction Register, compressed forms expanded
+    unsigned int instr_len;     // Bytes of the instruction in IR (2 or 4)
     unsigned int R[32];         // Register file
     unsigned int operand1;      // Temporary operand
     unsigned int operand2;      // Temporary operand
@@ -31,24 +33,64 @@ struct Processor {
 // Global processor state
 static Processor cpu;
 
-// Macros to extract instruction fields
-#define OPCODE(x)    ((x) & 0x7F)
-#define RD(x)        (((x) >> 7) & 0x1F)
-#define FUNCT3(x)    (((x) >> 12) & 0x7)
-#define RS1(x)       (((x) >> 15) & 0x1F)
-#define RS2(x)       (((x) >> 20) & 0x1F)
-#define FUNCT7(x)    (((x) >> 25) & 0x7F)
+// State saved by snapshot_proc(), and the pages of MEM written since
+static Processor snapshot_cpu;
+static unsigned char snapshot_MEM[MEM_SIZE];
+static unsigned char dirty[DIRTY_PAGES];
+
+// Per-stage trace messages; cleared by the -q option
+int trace_enabled = 1;
+#define TRACE(...) do { if (trace_enabled) { HOST_TIMER(HP_TRACE); std::printf(__VA_ARGS__); } } while (0)
 
 void run_RISCVsim() {
+  HOST_BEGIN(HP_RUN);
   while (1) {
-    fetch();
-    decode();
-    execute();
-    mem();
-    write_back();
+    if (prof_enabled) profile_pc(cpu.PC);
+    { HOST_TIMER(HP_FETCH); fetch(); }
+    { HOST_TIMER(HP_DECODE); decode(); }
+    { HOST_TIMER(HP_EXECUTE); execute(); }
+    { HOST_TIMER(HP_MEM); mem(); }
+    { HOST_TIMER(HP_WRITEBACK); write_back(); }
     cpu.clock++;
-    std::printf("Clock Cycle = %u\n\n", cpu.clock);
+    TRACE("Clock Cycle = %u\n\n", cpu.clock);
+  }
+}
+
+// Runs one instruction through the five stages and describes it in ri.
+// Returns false, leaving the state untouched, when the exit word or an
+// exit ECALL is fetched; unlike run_RISCVsim() it never calls swi_exit().
+bool step_RISCVsim(RetireInfo *ri) {
+  unsigned int pc = cpu.PC;
+  fetch();
+  if (cpu.IR == 0xEF000011 || ecall_exits(cpu.IR, cpu.R))
+    return false;
+  decode();
+  execute();
+  mem();
+  write_back();
+  cpu.clock++;
+
+  ri->pc = pc;
+  ri->instr = cpu.IR;
+  ri->len = cpu.instr_len;
+  ri->next_pc = cpu.PC;
+  ri->rd = instr_writes_rd(cpu.IR) ? RD(cpu.IR) : 0;
+  ri->rd_value = cpu.R[ri->rd];
+  ri->mem_size = 0;
+  ri->mem_addr = 0;
+  ri->mem_value = 0;
+  if (OPCODE(cpu.IR) == 0x23) {
+    unsigned int funct3 = FUNCT3(cpu.IR);
+    ri->mem_size = (funct3 == 0x0) ? 1 : (funct3 == 0x1) ? 2 : 4;
+    ri->mem_addr = cpu.alu_result;
+    ri->mem_value = (ri->mem_size == 4) ? cpu.operand2
+                                        : cpu.operand2 & ((1u << (8 * ri->mem_size)) - 1);
   }
+  return true;
+}
+
+void get_regs(unsigned int *R) {
+  std::memcpy(R, cpu.R, sizeof(cpu.R));
 }
 
 void reset_proc() {
@@ -58,13 +100,55 @@ void reset_proc() {
       MEM[i] = 0;
   cpu.PC = 0;
   cpu.IR = 0;
+  cpu.instr_len = 4;
   cpu.clock = 0;
   cpu.skip_pc_increment = 0;
 }
 
+static inline void mark_dirty(int index, unsigned int size) {
+  if (index >= 0) {
+    dirty[index >> DIRTY_PAGE_SHIFT] = 1;
+    dirty[(index + size - 1) >> DIRTY_PAGE_SHIFT] = 1;
+  }
+}
+
+void snapshot_proc() {
+  snapshot_cpu = cpu;
+  std::memcpy(snapshot_MEM, MEM, MEM_SIZE);
+  std::memset(dirty, 0, sizeof(dirty));
+}
+
+void restore_proc() {
+  for (unsigned int page = 0; page < DIRTY_PAGES; page++) {
+    if (dirty[page]) {
+      unsigned int first = page << DIRTY_PAGE_SHIFT;
+      std::memcpy(MEM + first, snapshot_MEM + first, 1u << DIRTY_PAGE_SHIFT);
+      dirty[page] = 0;
+    }
+  }
+  cpu = snapshot_cpu;
+}
+
+void poke_word(unsigned int address, unsigned int data) {
+  write_word(reinterpret_cast<char*>(MEM), address, data);
+  mark_dirty(mem_index(address, 4), 4);
+}
+
+const unsigned char *proc_memory() {
+  return MEM;
+}
+
+// Extracts the address and word of one .mc line; anything after the two
+// hex numbers (the assembler's source comment) is ignored. Returns false
+// for blank or comment-only lines.
+bool parse_mc_line(const char *line, unsigned int *address, unsigned int *word) {
+  return std::sscanf(line, " %x %x", address, word) == 2;
+}
+
 // Minimal change here: load_program_memory now supports comments.
-// It reads each line and uses sscanf to extract the two hex numbers.
+// It reads each line and uses parse_mc_line to extract the two hex numbers.
 void load_program_memory(char *file_name) {
+  HOST_TIMER(HP_LOAD);
   FILE *fp = std::fopen(file_name, "r");
   if (fp == nullptr) {
     std::printf("Error opening input mem file\n");
@@ -72,22 +156,30 @@ void load_program_memory(char *file_name) {
   }
   char line[256];
   unsigned int address, instruction;
+  unsigned int data_end = DATA_OFFSET;
   while (std::fgets(line, sizeof(line), fp) != nullptr) {
-    if (std::sscanf(line, " %x %x", &address, &instruction) == 2) {
+    if (parse_mc_line(line, &address, &instruction)) {
       write_word(reinterpret_cast<char*>(MEM), address, instruction);
+      if (address >= DATA_OFFSET && address + 4 > data_end) data_end = address + 4;
     }
   }
   std::fclose(fp);
+  syscall_reset(data_end);
 }
 
 void write_data_memory() {
+  dump_data_memory(reinterpret_cast<char*>(MEM));
+}
+
+// Writes the non-zero words of a memory image's data segment to data_out.mem
+void dump_data_memory(char *mem) {
   FILE *fp = std::fopen("data_out.mem", "w");
   if (fp == nullptr) {
     std::printf("Error opening data_out.mem for writing\n");
     return;
   }
-  for (unsigned int addr = DATA_OFFSET; addr < DATA_OFFSET + (MEM_SIZE - 4096); addr += 4) {
-    unsigned int value = read_word(reinterpret_cast<char*>(MEM), addr);
+  for (unsigned int addr = DATA_OFFSET; addr < DATA_OFFSET + (MEM_SIZE - TEXT_SIZE); addr += 4) {
+    unsigned int value = read_word(mem, addr);
     if (value != 0) {
       std::fprintf(fp, "%08x %08x\n", addr, value);
     }
@@ -95,30 +187,50 @@ void write_data_memory() {
   std::fclose(fp);
 }
 
+void set_PC(unsigned int pc) {
+  cpu.PC = pc;
+}
+
+void set_IR(unsigned int instr) {
+  cpu.IR = instr;
+}
+
 void swi_exit() {
-  write_data_memory();
-  std::printf("\n=== REGISTER DUMP ===\n");
-  for (int i = 0; i < 32; i++) {
-    std::printf("R%-2d = %d\n", i, cpu.R[i]);
-  }
-  std::printf("\nFinal array:\n");
-  for (int i = 0; i < 10; i++) {
-    int addr = DATA_OFFSET + i * 4;
-    int val = read_word(reinterpret_cast<char*>(MEM), addr);
-    std::printf("[%d] = %d\n", i, val);
-  }
-  std::exit(0);
+  HOST_END(HP_RUN);
+  {
+    HOST_TIMER(HP_EXIT);
+    syscall_flush();
+    write_data_memory();
+    std::printf("\n=== REGISTER DUMP ===\n");
+    for (int i = 0; i < 32; i++) {
+      std::printf("R%-2d = %d\n", i, cpu.R[i]);
+    }
+    std::printf("\nFinal array:\n");
+    for (int i = 0; i < 10; i++) {
+      int addr = DATA_OFFSET + i * 4;
+      int val = read_word(reinterpret_cast<char*>(MEM), addr);
+      std::printf("[%d] = %d\n", i, val);
+    }
+  }
+  if (prof_enabled) profiler_report(reinterpret_cast<char*>(MEM));
+  HOST_REPORT(cpu.clock);
+  std::exit(syscall_exit_code);
 }
 
 void fetch() {
-  cpu.IR = read_word(reinterpret_cast<char*>(MEM), cpu.PC);
-  std::printf("FETCH: Fetch instruction 0x%08X from address 0x%08X\n", cpu.IR, cpu.PC);
+  unsigned int parcel = read_word(reinterpret_cast<char*>(MEM), cpu.PC);
+  cpu.IR = rvc_fetch(parcel, &cpu.instr_len);
+  if (cpu.instr_len == 2)
+    TRACE("FETCH: Fetch compressed instruction 0x%04X (0x%08X) from address 0x%08X\n",
+          parcel & 0xFFFF, cpu.IR, cpu.PC);
+  else
+    TRACE("FETCH: Fetch instruction 0x%08X from address 0x%08X\n", cpu.IR, cpu.PC);
 }
 
 void decode() {
   unsigned int opcode = OPCODE(cpu.IR);
   if (cpu.IR == 0xEF000011) {
-    std::printf("DECODE: Exit instruction encountered\n");
+    TRACE("DECODE: Exit instruction encountered\n");
     swi_exit();
   }
   if (opcode == 0x33) { // R-type instructions
@@ -131,52 +243,76 @@ void decode() {
     cpu.operand2 = cpu.R[rs2];
     cpu.dest_reg = rd;
     if (funct3 == 0x0 && funct7 == 0x00) {
-      std::printf("DECODE: Operation is ADD, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is ADD, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x0 && funct7 == 0x20) {
-      std::printf("DECODE: Operation is SUB, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is SUB, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x7 && funct7 == 0x00) {
-      std::printf("DECODE: Operation is AND, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is AND, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x6 && funct7 == 0x00) {
-      std::printf("DECODE: Operation is OR, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is OR, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x1 && funct7 == 0x00) {
-      std::printf("DECODE: Operation is SLL, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is SLL, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x5 && funct7 == 0x00) {
-      std::printf("DECODE: Operation is SRL, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is SRL, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x4 && funct7 == 0x00) {
-      std::printf("DECODE: Operation is XOR, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is XOR, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x2 && funct7 == 0x00) {
-      std::printf("DECODE: Operation is SLT, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is SLT, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x5 && funct7 == 0x20) {
-      std::printf("DECODE: Operation is SRA, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is SRA, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x0 && funct7 == 0x01) {
-      std::printf("DECODE: Operation is MUL, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is MUL, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x4 && funct7 == 0x01) {
-      std::printf("DECODE: Operation is DIV, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is DIV, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x6 && funct7 == 0x01) {
-      std::printf("DECODE: Operation is REM, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is REM, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+    }
+    else if (funct3 == 0x3 && funct7 == 0x00) {
+      TRACE("DECODE: Operation is SLTU, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+    }
+    else if (funct3 == 0x1 && funct7 == 0x01) {
+      TRACE("DECODE: Operation is MULH, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+    }
+    else if (funct3 == 0x2 && funct7 == 0x01) {
+      TRACE("DECODE: Operation is MULHSU, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+    }
+    else if (funct3 == 0x3 && funct7 == 0x01) {
+      TRACE("DECODE: Operation is MULHU, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+    }
+    else if (funct3 == 0x5 && funct7 == 0x01) {
+      TRACE("DECODE: Operation is DIVU, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+    }
+    else if (funct3 == 0x7 && funct7 == 0x01) {
+      TRACE("DECODE: Operation is REMU, operands R%d and R%d, destination R%d\n", rs1, rs2, rd);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
   }
   else if (opcode == 0x13) {  // I-type
@@ -189,36 +325,43 @@ void decode() {
       cpu.operand2 = shamt;
       cpu.dest_reg = rd;
       if (funct3 == 0x1) {
-         std::printf("DECODE: Operation is SLLI, source R%d, shamt %d, dest R%d\n", rs1, shamt, rd);
+         TRACE("DECODE: Operation is SLLI, source R%d, shamt %d, dest R%d\n", rs1, shamt, rd);
       } else {
          unsigned int funct7 = (cpu.IR >> 25) & 0x7F;
          if (funct7 == 0x00) {
-           std::printf("DECODE: Operation is SRLI, source R%d, shamt %d, dest R%d\n", rs1, shamt, rd);
+           TRACE("DECODE: Operation is SRLI, source R%d, shamt %d, dest R%d\n", rs1, shamt, rd);
          } else if (funct7 == 0x20) {
-           std::printf("DECODE: Operation is SRAI, source R%d, shamt %d, dest R%d\n", rs1, shamt, rd);
+           TRACE("DECODE: Operation is SRAI, source R%d, shamt %d, dest R%d\n", rs1, shamt, rd);
          }
       }
     } else {
-       int imm = (cpu.IR >> 20) & 0xFFF;
-       if (imm & 0x800) imm |= 0xFFFFF000;
+       int imm = imm_i(cpu.IR);
        cpu.operand1 = cpu.R[rs1];
        cpu.operand2 = imm;
        cpu.dest_reg = rd;
        if (funct3 == 0x0) {
-         std::printf("DECODE: Operation is ADDI, R%d + %d -> R%d\n", rs1, imm, rd);
-         std::printf("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
+         TRACE("DECODE: Operation is ADDI, R%d + %d -> R%d\n", rs1, imm, rd);
+         TRACE("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
        }
        else if (funct3 == 0x2) {
-         std::printf("DECODE: Operation is SLTI, compare R%d < %d, dest R%d\n", rs1, imm, rd);
-         std::printf("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
+         TRACE("DECODE: Operation is SLTI, compare R%d < %d, dest R%d\n", rs1, imm, rd);
+         TRACE("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
        }
        else if (funct3 == 0x7) {
-         std::printf("DECODE: Operation is ANDI, R%d & %d -> R%d\n", rs1, imm, rd);
-         std::printf("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
+         TRACE("DECODE: Operation is ANDI, R%d & %d -> R%d\n", rs1, imm, rd);
+         TRACE("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
        }
        else if (funct3 == 0x6) {
-         std::printf("DECODE: Operation is ORI, R%d | %d -> R%d\n", rs1, imm, rd);
-         std::printf("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
+         TRACE("DECODE: Operation is ORI, R%d | %d -> R%d\n", rs1, imm, rd);
+         TRACE("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
+       }
+       else if (funct3 == 0x3) {
+         TRACE("DECODE: Operation is SLTIU, compare R%d < %u, dest R%d\n", rs1, imm, rd);
+         TRACE("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
+       }
+       else if (funct3 == 0x4) {
+         TRACE("DECODE: Operation is XORI, R%d ^ %d -> R%d\n", rs1, imm, rd);
+         TRACE("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
        }
     }
   }
@@ -226,112 +369,120 @@ void decode() {
     unsigned int rd = RD(cpu.IR);
     unsigned int funct3 = FUNCT3(cpu.IR);
     unsigned int rs1 = RS1(cpu.IR);
-    int imm = (int)(cpu.IR >> 20);
+    int imm = imm_i(cpu.IR);
     cpu.operand1 = cpu.R[rs1];
     cpu.operand2 = imm;
     cpu.dest_reg = rd;
     if (funct3 == 0x2) {
-      std::printf("DECODE: Operation is LW, base R%d, offset %d, dest R%d\n", rs1, imm, rd);
-      std::printf("DECODE: Read base R%d = %d\n", rs1, cpu.operand1);
+      TRACE("DECODE: Operation is LW, base R%d, offset %d, dest R%d\n", rs1, imm, rd);
+      TRACE("DECODE: Read base R%d = %d\n", rs1, cpu.operand1);
     }
     else if (funct3 == 0x0) {
-      std::printf("DECODE: Operation is LB, base R%d, offset %d, dest R%d\n", rs1, imm, rd);
-      std::printf("DECODE: Read base R%d = %d\n", rs1, cpu.operand1);
+      TRACE("DECODE: Operation is LB, base R%d, offset %d, dest R%d\n", rs1, imm, rd);
+      TRACE("DECODE: Read base R%d = %d\n", rs1, cpu.operand1);
     }
     else if (funct3 == 0x1) {
-      std::printf("DECODE: Operation is LH, base R%d, offset %d, dest R%d\n", rs1, imm, rd);
-      std::printf("DECODE: Read base R%d = %d\n", rs1, cpu.operand1);
+      TRACE("DECODE: Operation is LH, base R%d, offset %d, dest R%d\n", rs1, imm, rd);
+      TRACE("DECODE: Read base R%d = %d\n", rs1, cpu.operand1);
+    }
+    else if (funct3 == 0x4) {
+      TRACE("DECODE: Operation is LBU, base R%d, offset %d, dest R%d\n", rs1, imm, rd);
+      TRACE("DECODE: Read base R%d = %d\n", rs1, cpu.operand1);
+    }
+    else if (funct3 == 0x5) {
+      TRACE("DECODE: Operation is LHU, base R%d, offset %d, dest R%d\n", rs1, imm, rd);
+      TRACE("DECODE: Read base R%d = %d\n", rs1, cpu.operand1);
     }
   }
   else if (opcode == 0x23) {  // Store
-    unsigned int imm4_0  = (cpu.IR >> 7) & 0x1F;
-    unsigned int funct3  = (cpu.IR >> 12) & 0x07;
-    unsigned int rs1     = (cpu.IR >> 15) & 0x1F;
-    unsigned int rs2     = (cpu.IR >> 20) & 0x1F;
-    unsigned int imm11_5 = (cpu.IR >> 25) & 0x7F;
-    int imm = ((imm11_5 << 5) | imm4_0);
-    if (imm & 0x800) imm |= 0xFFFFF000;
+    unsigned int funct3 = FUNCT3(cpu.IR);
+    unsigned int rs1 = RS1(cpu.IR);
+    unsigned int rs2 = RS2(cpu.IR);
+    int imm = imm_s(cpu.IR);
     cpu.operand1 = cpu.R[rs1];
     cpu.operand2 = cpu.R[rs2];
     cpu.alu_result = imm;
     cpu.dest_reg = 0;
     if (funct3 == 0x2) {
-      std::printf("DECODE: Operation is SW, base R%d, source R%d, offset %d\n", rs1, rs2, imm);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is SW, base R%d, source R%d, offset %d\n", rs1, rs2, imm);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x0) {
-      std::printf("DECODE: Operation is SB, base R%d, source R%d, offset %d\n", rs1, rs2, imm);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is SB, base R%d, source R%d, offset %d\n", rs1, rs2, imm);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x1) {
-      std::printf("DECODE: Operation is SH, base R%d, source R%d, offset %d\n", rs1, rs2, imm);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is SH, base R%d, source R%d, offset %d\n", rs1, rs2, imm);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
   }
   else if (opcode == 0x63) {  // Branch
     unsigned int funct3 = FUNCT3(cpu.IR);
     unsigned int rs1 = RS1(cpu.IR);
     unsigned int rs2 = RS2(cpu.IR);
-    int imm = ((cpu.IR >> 31) & 0x1) << 12 |
-              ((cpu.IR >> 25) & 0x3F) << 5 |
-              ((cpu.IR >> 8) & 0xF) << 1 |
-              ((cpu.IR >> 7) & 0x1) << 11;
-    if (imm & 0x1000) imm |= 0xFFFFE000;
+    int imm = imm_b(cpu.IR);
     cpu.operand1 = cpu.R[rs1];
     cpu.operand2 = cpu.R[rs2];
     cpu.alu_result = imm;
     cpu.dest_reg = 0;
     if (funct3 == 0x0) {
-      std::printf("DECODE: Operation is BEQ, compare R%d and R%d, offset %d\n", rs1, rs2, imm);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is BEQ, compare R%d and R%d, offset %d\n", rs1, rs2, imm);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     } else if (funct3 == 0x1) {
-      std::printf("DECODE: Operation is BNE, compare R%d and R%d, offset %d\n", rs1, rs2, imm);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is BNE, compare R%d and R%d, offset %d\n", rs1, rs2, imm);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x4) {
-      std::printf("DECODE: Operation is BLT, compare R%d < R%d, offset %d\n", rs1, rs2, imm);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is BLT, compare R%d < R%d, offset %d\n", rs1, rs2, imm);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
     else if (funct3 == 0x5) {
-      std::printf("DECODE: Operation is BGE, compare R%d >= R%d, offset %d\n", rs1, rs2, imm);
-      std::printf("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+      TRACE("DECODE: Operation is BGE, compare R%d >= R%d, offset %d\n", rs1, rs2, imm);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+    }
+    else if (funct3 == 0x6) {
+      TRACE("DECODE: Operation is BLTU, compare R%d < R%d, offset %d\n", rs1, rs2, imm);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
+    }
+    else if (funct3 == 0x7) {
+      TRACE("DECODE: Operation is BGEU, compare R%d >= R%d, offset %d\n", rs1, rs2, imm);
+      TRACE("DECODE: Read R%d = %d, R%d = %d\n", rs1, cpu.operand1, rs2, cpu.operand2);
     }
   }
   else if (opcode == 0x6F) {  // JAL
     unsigned int rd = RD(cpu.IR);
-    int imm = ((cpu.IR >> 31) & 0x1) << 20 |
-              ((cpu.IR >> 21) & 0x3FF) << 1 |
-              ((cpu.IR >> 20) & 0x1) << 11 |
-              ((cpu.IR >> 12) & 0xFF) << 12;
-    if (imm & (1 << 20)) imm |= 0xFFF00000;
+    int imm = imm_j(cpu.IR);
     cpu.alu_result = imm;
     cpu.dest_reg = rd;
     cpu.operand1 = cpu.PC;
-    std::printf("DECODE: Operation is JAL, dest R%d, offset %d\n", rd, imm);
+    TRACE("DECODE: Operation is JAL, dest R%d, offset %d\n", rd, imm);
   }
   else if (opcode == 0x67) {  // JALR
     unsigned int rd = RD(cpu.IR);
     unsigned int rs1 = RS1(cpu.IR);
-    int imm = (int)(cpu.IR >> 20);
+    int imm = imm_i(cpu.IR);
     cpu.operand1 = cpu.R[rs1];
     cpu.operand2 = imm;
     cpu.dest_reg = rd;
-    std::printf("DECODE: Operation is JALR, dest R%d, base R%d, offset %d\n", rd, rs1, imm);
-    std::printf("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
+    TRACE("DECODE: Operation is JALR, dest R%d, base R%d, offset %d\n", rd, rs1, imm);
+    TRACE("DECODE: Read R%d = %d\n", rs1, cpu.operand1);
   }
   else if (opcode == 0x37) {  // LUI
     unsigned int rd = RD(cpu.IR);
-    int imm = (int)(cpu.IR & 0xFFFFF000);
+    int imm = imm_u(cpu.IR);
     cpu.alu_result = imm;
     cpu.dest_reg = rd;
-    std::printf("DECODE: Operation is LUI, immediate %d, dest R%d\n", imm, rd);
+    TRACE("DECODE: Operation is LUI, immediate %d, dest R%d\n", imm, rd);
   }
   else if (opcode == 0x17) {  // AUIPC
     unsigned int rd = RD(cpu.IR);
-    int imm = (int)(cpu.IR & 0xFFFFF000);
+    int imm = imm_u(cpu.IR);
     cpu.alu_result = cpu.PC + imm;
     cpu.dest_reg = rd;
-    std::printf("DECODE: Operation is AUIPC, PC %d + imm %d -> R%d\n", cpu.PC, imm, rd);
+    TRACE("DECODE: Operation is AUIPC, PC %d + imm %d -> R%d\n", cpu.PC, imm, rd);
+  }
+  else if (cpu.IR == ECALL_INSTR) {
+    TRACE("DECODE: Operation is ECALL, system call a7 = %d\n", cpu.R[17]);
   }
 }
 
@@ -341,189 +492,354 @@ void execute() {
   unsigned int funct7 = FUNCT7(cpu.IR);
   if (opcode == 0x33 && funct3 == 0x0 && funct7 == 0x00) {
     cpu.alu_result = cpu.operand1 + cpu.operand2;
-    std::printf("EXECUTE: ADD %d + %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    TRACE("EXECUTE: ADD %d + %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x33 && funct3 == 0x0 && funct7 == 0x20) {
     cpu.alu_result = cpu.operand1 - cpu.operand2;
-    std::printf("EXECUTE: SUB %d - %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    TRACE("EXECUTE: SUB %d - %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x13 && FUNCT3(cpu.IR) == 0x0) {
     cpu.alu_result = cpu.operand1 + cpu.operand2;
-    std::printf("EXECUTE: ADDI %d + %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    TRACE("EXECUTE: ADDI %d + %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x13 && (FUNCT3(cpu.IR) == 0x1 || FUNCT3(cpu.IR) == 0x5)) {
     if (FUNCT3(cpu.IR) == 0x1) {
       cpu.alu_result = cpu.operand1 << (cpu.operand2 & 0x1F);
-      std::printf("EXECUTE: SLLI %d << %d = %d\n", cpu.operand1, cpu.operand2 & 0x1F, cpu.alu_result);
+      TRACE("EXECUTE: SLLI %d << %d = %d\n", cpu.operand1, cpu.operand2 & 0x1F, cpu.alu_result);
     } else if (FUNCT3(cpu.IR) == 0x5) {
       if (funct7 == 0x00) {
         cpu.alu_result = cpu.operand1 >> (cpu.operand2 & 0x1F);
-        std::printf("EXECUTE: SRLI %d >> %d = %d\n", cpu.operand1, cpu.operand2 & 0x1F, cpu.alu_result);
+        TRACE("EXECUTE: SRLI %d >> %d = %d\n", cpu.operand1, cpu.operand2 & 0x1F, cpu.alu_result);
       } else if (funct7 == 0x20) {
         cpu.alu_result = ((int)cpu.operand1) >> (cpu.operand2 & 0x1F);
-        std::printf("EXECUTE: SRAI %d >> %d = %d\n", cpu.operand1, cpu.operand2 & 0x1F, cpu.alu_result);
+        TRACE("EXECUTE: SRAI %d >> %d = %d\n", cpu.operand1, cpu.operand2 & 0x1F, cpu.alu_result);
       }
     }
   }
   else if (opcode == 0x03 && funct3 == 0x2) {
     cpu.alu_result = cpu.operand1 + cpu.operand2;
-    std::printf("EXECUTE: LW address = %d\n", cpu.alu_result);
+    TRACE("EXECUTE: LW address = %d\n", cpu.alu_result);
   }
-  else if (opcode == 0x23 && FUNCT3(cpu.IR) == 0x2) {
+  else if (opcode == 0x23) {
     cpu.alu_result = cpu.operand1 + cpu.alu_result;
-    std::printf("EXECUTE: SW address = %d\n", cpu.alu_result);
+    TRACE("EXECUTE: %s address = %d\n", (funct3 == 0x0) ? "SB" : (funct3 == 0x1) ? "SH" : "SW",
+          cpu.alu_result);
   }
   else if (opcode == 0x63 && funct3 == 0x0) {
     if (cpu.operand1 == cpu.operand2) {
-        std::printf("EXECUTE: BEQ taken, PC += %d\n", cpu.alu_result);
+        TRACE("EXECUTE: BEQ taken, PC += %d\n", cpu.alu_result);
         cpu.PC = cpu.PC + cpu.alu_result;
         cpu.skip_pc_increment = 1;
     } else {
-        std::printf("EXECUTE: BEQ not taken\n");
+        TRACE("EXECUTE: BEQ not taken\n");
     }
   }
   else if (opcode == 0x63 && funct3 == 0x1) {
     if (cpu.operand1 != cpu.operand2) {
-        std::printf("EXECUTE: BNE taken, PC += %d\n", cpu.alu_result);
+        TRACE("EXECUTE: BNE taken, PC += %d\n", cpu.alu_result);
         cpu.PC += cpu.alu_result;
         cpu.skip_pc_increment = 1;
     } else {
-        std::printf("EXECUTE: BNE not taken\n");
+        TRACE("EXECUTE: BNE not taken\n");
     }
   }
   else if (opcode == 0x33 && funct3 == 0x7 && funct7 == 0x00) {
     cpu.alu_result = cpu.operand1 & cpu.operand2;
-    std::printf("EXECUTE: AND %d & %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    TRACE("EXECUTE: AND %d & %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x6F) {
     if (cpu.dest_reg != 0) {
-      cpu.R[cpu.dest_reg] = cpu.operand1 + 4;
-      std::printf("EXECUTE: JAL store return addr %d in R%d\n", cpu.operand1 + 4, cpu.dest_reg);
+      cpu.R[cpu.dest_reg] = cpu.operand1 + cpu.instr_len;
+      TRACE("EXECUTE: JAL store return addr %d in R%d\n", cpu.operand1 + cpu.instr_len, cpu.dest_reg);
     }
     cpu.PC += cpu.alu_result;
-    std::printf("EXECUTE: JAL jump to PC = %d\n", cpu.PC);
+    TRACE("EXECUTE: JAL jump to PC = %d\n", cpu.PC);
     cpu.skip_pc_increment = 1;
   }
   else if (opcode == 0x33 && funct3 == 0x6 && funct7 == 0x00) {
     cpu.alu_result = cpu.operand1 | cpu.operand2;
-    std::printf("EXECUTE: OR %d | %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    TRACE("EXECUTE: OR %d | %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x33 && funct3 == 0x1 && funct7 == 0x00) {
     cpu.alu_result = cpu.operand1 << (cpu.operand2 & 0x1F);
-    std::printf("EXECUTE: SLL %d << %d = %d\n", cpu.operand1, cpu.operand2 & 0x1F, cpu.alu_result);
+    TRACE("EXECUTE: SLL %d << %d = %d\n", cpu.operand1, cpu.operand2 & 0x1F, cpu.alu_result);
   }
   else if (opcode == 0x33 && funct3 == 0x5 && funct7 == 0x00) {
     cpu.alu_result = cpu.operand1 >> (cpu.operand2 & 0x1F);
-    std::printf("EXECUTE: SRL %d >> %d = %d\n", cpu.operand1, cpu.operand2 & 0x1F, cpu.alu_result);
+    TRACE("EXECUTE: SRL %d >> %d = %d\n", cpu.operand1, cpu.operand2 & 0x1F, cpu.alu_result);
   }
   else if (opcode == 0x33 && funct3 == 0x4 && funct7 == 0x00) {
     cpu.alu_result = cpu.operand1 ^ cpu.operand2;
-    std::printf("EXECUTE: XOR %d ^ %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    TRACE("EXECUTE: XOR %d ^ %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x67) {
     if (cpu.dest_reg != 0) {
-      cpu.R[cpu.dest_reg] = cpu.PC + 4;
-      std::printf("EXECUTE: JALR store return addr %d in R%d\n", cpu.PC + 4, cpu.dest_reg);
+      cpu.R[cpu.dest_reg] = cpu.PC + cpu.instr_len;
+      TRACE("EXECUTE: JALR store return addr %d in R%d\n", cpu.PC + cpu.instr_len, cpu.dest_reg);
     }
     unsigned int target = (cpu.operand1 + cpu.operand2) & ~1;
-    std::printf("EXECUTE: JALR jump to addr %d\n", target);
+    TRACE("EXECUTE: JALR jump to addr %d\n", target);
     cpu.PC = target;
     cpu.skip_pc_increment = 1;
   }
   else if (opcode == 0x13 && FUNCT3(cpu.IR) == 0x2) {
     cpu.alu_result = ((int)cpu.operand1 < (int)cpu.operand2) ? 1 : 0;
-    std::printf("EXECUTE: SLTI %d < %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    TRACE("EXECUTE: SLTI %d < %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x33 && FUNCT3(cpu.IR) == 0x2 && funct7 == 0x00) {
     cpu.alu_result = ((int)cpu.operand1 < (int)cpu.operand2) ? 1 : 0;
-    std::printf("EXECUTE: SLT %d < %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    TRACE("EXECUTE: SLT %d < %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x13 && FUNCT3(cpu.IR) == 0x7) {
     cpu.alu_result = cpu.operand1 & cpu.operand2;
-    std::printf("EXECUTE: ANDI %d & %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    TRACE("EXECUTE: ANDI %d & %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x13 && FUNCT3(cpu.IR) == 0x6) {
     cpu.alu_result = cpu.operand1 | cpu.operand2;
-    std::printf("EXECUTE: ORI %d | %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    TRACE("EXECUTE: ORI %d | %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x33 && FUNCT3(cpu.IR) == 0x0 && funct7 == 0x01) {
-    cpu.alu_result = cpu.operand1 * cpu.operand2;
-    std::printf("EXECUTE: MUL %d * %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    cpu.alu_result = alu_compute(cpu.IR, cpu.operand1, cpu.operand2);
+    TRACE("EXECUTE: MUL %d * %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x33 && FUNCT3(cpu.IR) == 0x4 && funct7 == 0x01) {
-    if (cpu.operand2 != 0) {
-      cpu.alu_result = (int)cpu.operand1 / (int)cpu.operand2;
-      std::printf("EXECUTE: DIV %d / %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+    cpu.alu_result = alu_compute(cpu.IR, cpu.operand1, cpu.operand2);
+    TRACE("EXECUTE: DIV %d / %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  }
+  else if (opcode == 0x33 && FUNCT3(cpu.IR) == 0x6 && funct7 == 0x01) {
+    cpu.alu_result = alu_compute(cpu.IR, cpu.operand1, cpu.operand2);
+    TRACE("EXECUTE: REM %d %% %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  }
+  else if (opcode == 0x33 && funct3 == 0x5 && funct7 == 0x20) {
+    cpu.alu_result = alu_compute(cpu.IR, cpu.operand1, cpu.operand2);
+    TRACE("EXECUTE: SRA %d >> %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  }
+  else if (opcode == 0x33 && funct3 == 0x3 && funct7 == 0x00) {
+    cpu.alu_result = alu_compute(cpu.IR, cpu.operand1, cpu.operand2);
+    TRACE("EXECUTE: SLTU %d < %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  }
+  else if (opcode == 0x33 && funct3 == 0x1 && funct7 == 0x01) {
+    cpu.alu_result = alu_compute(cpu.IR, cpu.operand1, cpu.operand2);
+    TRACE("EXECUTE: MULH %d * %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  }
+  else if (opcode == 0x33 && funct3 == 0x2 && funct7 == 0x01) {
+    cpu.alu_result = alu_compute(cpu.IR, cpu.operand1, cpu.operand2);
+    TRACE("EXECUTE: MULHSU %d * %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  }
+  else if (opcode == 0x33 && funct3 == 0x3 && funct7 == 0x01) {
+    cpu.alu_result = alu_compute(cpu.IR, cpu.operand1, cpu.operand2);
+    TRACE("EXECUTE: MULHU %d * %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  }
+  else if (opcode == 0x33 && funct3 == 0x5 && funct7 == 0x01) {
+    cpu.alu_result = alu_compute(cpu.IR, cpu.operand1, cpu.operand2);
+    TRACE("EXECUTE: DIVU %d / %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  }
+  else if (opcode == 0x33 && funct3 == 0x7 && funct7 == 0x01) {
+    cpu.alu_result = alu_compute(cpu.IR, cpu.operand1, cpu.operand2);
+    TRACE("EXECUTE: REMU %d %% %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  }
+  else if (opcode == 0x13 && FUNCT3(cpu.IR) == 0x3) {
+    cpu.alu_result = (cpu.operand1 < cpu.operand2) ? 1 : 0;
+    TRACE("EXECUTE: SLTIU %u < %u = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  }
+  else if (opcode == 0x13 && FUNCT3(cpu.IR) == 0x4) {
+    cpu.alu_result = cpu.operand1 ^ cpu.operand2;
+    TRACE("EXECUTE: XORI %d ^ %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  }
+  else if (opcode == 0x63 && funct3 == 0x4) {
+    if (branch_taken(cpu.IR, cpu.operand1, cpu.operand2)) {
+        TRACE("EXECUTE: BLT taken, PC += %d\n", cpu.alu_result);
+        cpu.PC += cpu.alu_result;
+        cpu.skip_pc_increment = 1;
     } else {
-      cpu.alu_result = 0;
-      std::printf("EXECUTE: DIV by zero, result set to 0\n");
+        TRACE("EXECUTE: BLT not taken\n");
     }
   }
-  else if (opcode == 0x33 && FUNCT3(cpu.IR) == 0x6 && funct7 == 0x01) {
-    if (cpu.operand2 != 0) {
-      cpu.alu_result = (int)cpu.operand1 % (int)cpu.operand2;
-      std::printf("EXECUTE: REM %d %% %d = %d\n", cpu.operand1, cpu.operand2, cpu.alu_result);
+  else if (opcode == 0x63 && funct3 == 0x5) {
+    if (branch_taken(cpu.IR, cpu.operand1, cpu.operand2)) {
+        TRACE("EXECUTE: BGE taken, PC += %d\n", cpu.alu_result);
+        cpu.PC += cpu.alu_result;
+        cpu.skip_pc_increment = 1;
+    } else {
+        TRACE("EXECUTE: BGE not taken\n");
+    }
+  }
+  else if (opcode == 0x63 && funct3 == 0x6) {
+    if (branch_taken(cpu.IR, cpu.operand1, cpu.operand2)) {
+        TRACE("EXECUTE: BLTU taken, PC += %d\n", cpu.alu_result);
+        cpu.PC += cpu.alu_result;
+        cpu.skip_pc_increment = 1;
+    } else {
+        TRACE("EXECUTE: BLTU not taken\n");
+    }
+  }
+  else if (opcode == 0x63 && funct3 == 0x7) {
+    if (branch_taken(cpu.IR, cpu.operand1, cpu.operand2)) {
+        TRACE("EXECUTE: BGEU taken, PC += %d\n", cpu.alu_result);
+        cpu.PC += cpu.alu_result;
+        cpu.skip_pc_increment = 1;
     } else {
-      cpu.alu_result = 0;
-      std::printf("EXECUTE: REM by zero, result set to 0\n");
+        TRACE("EXECUTE: BGEU not taken\n");
     }
   }
+  else if (cpu.IR == ECALL_INSTR) {
+    TRACE("EXECUTE: ECALL %d\n", cpu.R[17]);
+    // A system call may write anywhere in memory
+    std::memset(dirty, 1, sizeof(dirty));
+    if (!syscall_dispatch(cpu.R, MEM, cpu.clock))
+      swi_exit();
+  }
 }
 
 void mem() {
   unsigned int opcode = OPCODE(cpu.IR);
   unsigned int funct3 = FUNCT3(cpu.IR);
   if (opcode == 0x33) {
-    std::printf("MEMORY: No memory operation\n");
+    TRACE("MEMORY: No memory operation\n");
   }
   else if (opcode == 0x03 && FUNCT3(cpu.IR) == 0x2) {
     cpu.alu_result = read_word(reinterpret_cast<char*>(MEM), cpu.alu_result);
-    std::printf("MEMORY: Load value %d from addr %d\n", cpu.alu_result, cpu.operand1 + cpu.operand2);
+    TRACE("MEMORY: Load value %d from addr %d\n", cpu.alu_result, cpu.operand1 + cpu.operand2);
   }
   else if (opcode == 0x23 && FUNCT3(cpu.IR) == 0x2) {
     write_word(reinterpret_cast<char*>(MEM), cpu.alu_result, cpu.operand2);
-    std::printf("MEMORY: Stored value %d at addr %d\n", cpu.operand2, cpu.alu_result);
+    mark_dirty(mem_index(cpu.alu_result, 4), 4);
+    TRACE("MEMORY: Stored value %d at addr %d\n", cpu.operand2, cpu.alu_result);
   }
   else if (opcode == 0x03 && funct3 == 0x0) {
-    cpu.alu_result = MEM[cpu.operand1 + cpu.operand2];
+    int idx = mem_index(cpu.operand1 + cpu.operand2, 1);
+    cpu.alu_result = (idx >= 0) ? MEM[idx] : 0;
     if (cpu.alu_result & 0x80) cpu.alu_result |= 0xFFFFFF00;
-    std::printf("MEMORY: LB value %d from addr %d\n", cpu.alu_result, cpu.operand1 + cpu.operand2);
+    TRACE("MEMORY: LB value %d from addr %d\n", cpu.alu_result, cpu.operand1 + cpu.operand2);
   }
   else if (opcode == 0x03 && funct3 == 0x1) {
-    cpu.alu_result = *(short*)(MEM + cpu.operand1 + cpu.operand2);
-    std::printf("MEMORY: LH value %d from addr %d\n", cpu.alu_result, cpu.operand1 + cpu.operand2);
+    int idx = mem_index(cpu.operand1 + cpu.operand2, 2);
+    cpu.alu_result = (idx >= 0) ? *(short*)(MEM + idx) : 0;
+    TRACE("MEMORY: LH value %d from addr %d\n", cpu.alu_result, cpu.operand1 + cpu.operand2);
+  }
+  else if (opcode == 0x03 && funct3 == 0x4) {
+    int idx = mem_index(cpu.operand1 + cpu.operand2, 1);
+    cpu.alu_result = (idx >= 0) ? MEM[idx] : 0;
+    TRACE("MEMORY: LBU value %d from addr %d\n", cpu.alu_result, cpu.operand1 + cpu.operand2);
+  }
+  else if (opcode == 0x03 && funct3 == 0x5) {
+    int idx = mem_index(cpu.operand1 + cpu.operand2, 2);
+    cpu.alu_result = (idx >= 0) ? *(unsigned short*)(MEM + idx) : 0;
+    TRACE("MEMORY: LHU value %d from addr %d\n", cpu.alu_result, cpu.operand1 + cpu.operand2);
   }
   else if (opcode == 0x23 && funct3 == 0x0) {
-    MEM[cpu.alu_result] = cpu.operand2 & 0xFF;
-    std::printf("MEMORY: SB value %d at addr %d\n", cpu.operand2 & 0xFF, cpu.alu_result);
+    int idx = mem_index(cpu.alu_result, 1);
+    if (idx >= 0) MEM[idx] = cpu.operand2 & 0xFF;
+    mark_dirty(idx, 1);
+    TRACE("MEMORY: SB value %d at addr %d\n", cpu.operand2 & 0xFF, cpu.alu_result);
   }
   else if (opcode == 0x23 && funct3 == 0x1) {
-    *(short*)(MEM + cpu.alu_result) = cpu.operand2 & 0xFFFF;
-    std::printf("MEMORY: SH value %d at addr %d\n", cpu.operand2 & 0xFFFF, cpu.alu_result);
+    int idx = mem_index(cpu.alu_result, 2);
+    if (idx >= 0) *(short*)(MEM + idx) = cpu.operand2 & 0xFFFF;
+    mark_dirty(idx, 2);
+    TRACE("MEMORY: SH value %d at addr %d\n", cpu.operand2 & 0xFFFF, cpu.alu_result);
   }
 }
 
 void write_back() {
   unsigned int opcode = OPCODE(cpu.IR);
-  if (opcode == 0x33 || opcode == 0x13 || opcode == 0x03 || opcode == 0x17 || opcode == 0x37) {
+  if ((opcode == 0x33 || opcode == 0x13 || opcode == 0x03 || opcode == 0x17 || opcode == 0x37) &&
+      cpu.dest_reg != 0) {
     cpu.R[cpu.dest_reg] = cpu.alu_result;
-    std::printf("WRITEBACK: Write %d to R%d\n", cpu.alu_result, cpu.dest_reg);
+    TRACE("WRITEBACK: Write %d to R%d\n", cpu.alu_result, cpu.dest_reg);
   }
   if (!cpu.skip_pc_increment) {
-    cpu.PC += 4;
+    cpu.PC += cpu.instr_len;
   }
   cpu.skip_pc_increment = 0;
-  std::printf("WRITEBACK: PC = 0x%08X\n", cpu.PC);
+  TRACE("WRITEBACK: PC = 0x%08X\n", cpu.PC);
 }
 
+// A word outside MEM reads as 0, and writing one does nothing
 int read_word(char *mem, unsigned int address) {
-  int index = (address >= DATA_OFFSET) ? (address - DATA_OFFSET + 4096) : address;
+  HOST_TIMER(HP_MEM_ACCESS);
+  int index = mem_index(address, 4);
+  if (index < 0) return 0;
   int *data = (int*)(mem + index);
   return *data;
 }
 
 void write_word(char *mem, unsigned int address, unsigned int data) {
-  int index = (address >= DATA_OFFSET) ? (address - DATA_OFFSET + 4096) : address;
+  HOST_TIMER(HP_MEM_ACCESS);
+  int index = mem_index(address, 4);
+  if (index < 0) return;
   int *data_p = (int*)(mem + index);
   *data_p = data;
 }
+
+// Result of an OP / OP-IMM instruction (RV32IM) for operands a and b.
+// Division follows the RISC-V rules for a zero divisor and overflow.
+unsigned int alu_compute(unsigned int instr, unsigned int a, unsigned int b) {
+  unsigned int funct3 = FUNCT3(instr);
+  unsigned int funct7 = FUNCT7(instr);
+  bool reg = (OPCODE(instr) == 0x33);
+  if (reg && funct7 == 0x01) {
+    switch (funct3) {
+      case 0x0: return a * b;
+      case 0x1: return (unsigned int)(((long long)(int)a * (long long)(int)b) >> 32);
+      case 0x2: return (unsigned int)(((long long)(int)a * (long long)b) >> 32);
+      case 0x3: return (unsigned int)(((unsigned long long)a * b) >> 32);
+      case 0x4:
+        if (b == 0) return 0xFFFFFFFF;
+        if (a == 0x80000000 && b == 0xFFFFFFFF) return a;
+        return (unsigned int)((int)a / (int)b);
+      case 0x5: return (b == 0) ? 0xFFFFFFFF : a / b;
+      case 0x6:
+        if (b == 0) return a;
+        if (a == 0x80000000 && b == 0xFFFFFFFF) return 0;
+        return (unsigned int)((int)a % (int)b);
+      default:  return (b == 0) ? a : a % b;
+    }
+  }
+  switch (funct3) {
+    case 0x0: return (reg && funct7 == 0x20) ? a - b : a + b;
+    case 0x1: return a << (b & 0x1F);
+    case 0x2: return ((int)a < (int)b) ? 1 : 0;
+    case 0x3: return (a < b) ? 1 : 0;
+    case 0x4: return a ^ b;
+    case 0x5: return (funct7 & 0x20) ? (unsigned int)((int)a >> (b & 0x1F)) : a >> (b & 0x1F);
+    case 0x6: return a | b;
+    default:  return a & b;
+  }
+}
+
+// Condition of a BRANCH instruction for operands a and b
+bool branch_taken(unsigned int instr, unsigned int a, unsigned int b) {
+  switch (FUNCT3(instr)) {
+    case 0x0: return a == b;
+    case 0x1: return a != b;
+    case 0x4: return (int)a < (int)b;
+    case 0x5: return (int)a >= (int)b;
+    case 0x6: return a < b;
+    case 0x7: return a >= b;
+    default:  return false;
+  }
+}
+
+int instr_class(unsigned int instr) {
+  switch (OPCODE(instr)) {
+    case 0x33: return (FUNCT7(instr) == 0x01) ? CLASS_MULDIV : CLASS_ALU;
+    case 0x13: return CLASS_ALU_IMM;
+    case 0x03: return CLASS_LOAD;
+    case 0x23: return CLASS_STORE;
+    case 0x63: return CLASS_BRANCH;
+    case 0x6F:
+    case 0x67: return CLASS_JUMP;
+    case 0x37:
+    case 0x17: return CLASS_UPPER;
+    case 0x2F: return CLASS_ATOMIC;
+    default:   return CLASS_OTHER;
+  }
+}
+
+const char *instr_class_name(int cls) {
+  static const char *names[NUM_INSTR_CLASSES] = {
+    "alu", "alu-imm", "mul/div", "load", "store", "branch", "jump", "upper", "atomic", "other"
+  };
+  return (cls >= 0 && cls < NUM_INSTR_CLASSES) ? names[cls] : "?";
+}
@@ -1,10 +1,126 @@
 #ifndef MYRISCVSIM_H
 #define MYRISCVSIM_H
 
+#define MEM_SIZE 8192
+#define TEXT_SIZE 4096
+#define DATA_OFFSET 0x10000000
+#define MAX_ISSUE_WIDTH 4    // Widest bundle of the pipeline model
+
+// Pages of MEM tracked by the dirty-page snapshots of the staged and fast
+// engines (snapshot_proc(), fast_snapshot())
+#define DIRTY_PAGE_SHIFT 6
+#define DIRTY_PAGES (MEM_SIZE >> DIRTY_PAGE_SHIFT)
+
+// Byte index into MEM of [address, address + size), data addresses being
+// remapped from DATA_OFFSET to just above the text, or -1 if any of it
+// falls outside MEM
+inline int mem_index(unsigned int address, unsigned int size) {
+  unsigned int idx = (address >= DATA_OFFSET) ? (address - DATA_OFFSET + TEXT_SIZE) : address;
+  return (size <= MEM_SIZE && idx <= MEM_SIZE - size) ? (int)idx : -1;
+}
+
+// Macros to extract instruction fields
+#define OPCODE(x)    ((x) & 0x7F)
+#define RD(x)        (((x) >> 7) & 0x1F)
+#define FUNCT3(x)    (((x) >> 12) & 0x7)
+#define RS1(x)       (((x) >> 15) & 0x1F)
+#define RS2(x)       (((x) >> 20) & 0x1F)
+#define FUNCT7(x)    (((x) >> 25) & 0x7F)
+
+// Sign-extended immediates of each instruction format
+inline int imm_i(unsigned int instr) {
+  return (int)instr >> 20;
+}
+
+inline int imm_s(unsigned int instr) {
+  int imm = ((instr >> 25) & 0x7F) << 5 | ((instr >> 7) & 0x1F);
+  if (imm & 0x800) imm |= 0xFFFFF000;
+  return imm;
+}
+
+inline int imm_b(unsigned int instr) {
+  int imm = ((instr >> 31) & 0x1) << 12 |
+            ((instr >> 25) & 0x3F) << 5 |
+            ((instr >> 8) & 0xF) << 1 |
+            ((instr >> 7) & 0x1) << 11;
+  if (imm & 0x1000) imm |= 0xFFFFE000;
+  return imm;
+}
+
+inline int imm_j(unsigned int instr) {
+  int imm = ((instr >> 31) & 0x1) << 20 |
+            ((instr >> 21) & 0x3FF) << 1 |
+            ((instr >> 20) & 0x1) << 11 |
+            ((instr >> 12) & 0xFF) << 12;
+  if (imm & (1 << 20)) imm |= 0xFFF00000;
+  return imm;
+}
+
+inline int imm_u(unsigned int instr) {
+  return (int)(instr & 0xFFFFF000);
+}
+
+// Instruction classes used by the statistics and profiling reports
+enum InstrClass {
+  CLASS_ALU,      // R-type integer ops
+  CLASS_ALU_IMM,  // I-type integer ops
+  CLASS_MULDIV,   // M extension
+  CLASS_LOAD,
+  CLASS_STORE,
+  CLASS_BRANCH,
+  CLASS_JUMP,     // JAL / JALR
+  CLASS_UPPER,    // LUI / AUIPC
+  CLASS_ATOMIC,   // A extension: LR/SC and AMOs
+  CLASS_OTHER,
+  NUM_INSTR_CLASSES
+};
+
+// One retired instruction, as reported by the step function of every
+// engine and compared by the co-simulation checker
+struct RetireInfo {
+  unsigned int pc;
+  unsigned int instr;       // Expanded if compressed
+  unsigned int len;         // Instruction size in bytes, 2 or 4
+  unsigned int next_pc;
+  unsigned int rd;          // 0 when no register is written
+  unsigned int rd_value;
+  unsigned int mem_size;    // Bytes stored, 0 when not a store
+  unsigned int mem_addr;
+  unsigned int mem_value;
+};
+
+// True if the instruction writes a register other than x0
+inline bool instr_writes_rd(unsigned int instr) {
+  unsigned int opcode = OPCODE(instr);
+  return RD(instr) != 0 &&
+         (opcode == 0x33 || opcode == 0x13 || opcode == 0x03 || opcode == 0x37 ||
+          opcode == 0x17 || opcode == 0x6F || opcode == 0x67 || opcode == 0x2F);
+}
+
+// Set to 0 to suppress the per-stage trace messages
+extern int trace_enabled;
+
 void run_RISCVsim();
+bool step_RISCVsim(RetireInfo *ri);
+void get_regs(unsigned int *R);
 void reset_proc();
+
+// Dirty-page snapshot of the processor and memory, for running many short
+// programs without a reset_proc() between them: restore_proc() returns to
+// the last snapshot_proc(), copying back only the pages written since.
+// poke_word() writes a word (of the next program) the same way. The
+// system call state is not part of the snapshot.
+void snapshot_proc();
+void restore_proc();
+void poke_word(unsigned int address, unsigned int data);
+const unsigned char *proc_memory();
+
 void load_program_memory(char *file_name);
+bool parse_mc_line(const char *line, unsigned int *address, unsigned int *word);
+void set_PC(unsigned int pc);
+void set_IR(unsigned int instr);
 void write_data_memory();
+void dump_data_memory(char *mem);
 void swi_exit();
 void fetch();
 void decode();
@@ -13,5 +129,9 @@ void mem();
 void write_back();
 int read_word(char *mem, unsigned int address);
 void write_word(char *mem, unsigned int address, unsigned int data);
+unsigned int alu_compute(unsigned int instr, unsigned int a, unsigned int b);
+bool branch_taken(unsigned int instr, unsigned int a, unsigned int b);
+int instr_class(unsigned int instr);
+const char *instr_class_name(int cls);
 
 #endif
@@ -0,0 +1,366 @@
+/* ooo.cpp
+   Out-of-order core timing model. The fast interpreter supplies the
+   committed instruction stream, so results and retirement order are those
+   of the functional semantics; this file only models when each instruction
+   is fetched, renamed, issued, completed and committed.
+
+   Each cycle the stages are evaluated from commit to fetch. The ROB and
+   fetch queue are ring buffers indexed by sequence number, and the issue
+   queue and load/store queue are occupancy counters over ROB entries, so
+   nothing is allocated per instruction. Wrong-path instructions are not
+   modelled: after a misprediction fetch waits until the branch has
+   executed.
+*/
+
+#include "ooo.h"
+#include "fastsim.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "syscall.h"
+#include <cstdio>
+#include <cstring>
+
+int KNOB_OOO_WIDTH = 4;
+int KNOB_ROB_SIZE = 64;
+int KNOB_IQ_SIZE = 32;
+int KNOB_LSQ_SIZE = 16;
+int KNOB_ALU_UNITS = 2;
+int KNOB_LAT_MUL = 3;
+int KNOB_LAT_DIV = 20;
+int KNOB_LAT_LOAD = 2;
+
+#define OOO_PRED_SIZE 256
+#define FETCH_QUEUE_SIZE (2 * MAX_OOO_WIDTH)
+
+// FU_ATOMIC is an LR/SC or AMO: it reads and writes memory through a
+// load/store port and holds an LSQ entry like the other memory ops
+enum FuKind { FU_ALU, FU_MUL, FU_DIV, FU_LOAD, FU_STORE, FU_ATOMIC };
+
+struct FetchEntry {
+  RetireInfo ri;
+  unsigned int addr;            // Load or store address
+  bool mispredicted;
+};
+
+struct RobEntry {
+  RetireInfo ri;
+  unsigned int addr;
+  unsigned long long src[2];    // Sequence numbers of the producers, 0 if none
+  unsigned long long done;      // Cycle the result is available
+  unsigned char fu;
+  bool issued;
+  bool mispredicted;
+};
+
+static FastSim sim;
+
+static RobEntry rob[MAX_ROB_SIZE];
+static unsigned long long rob_head;     // Sequence number of the oldest entry
+static unsigned long long next_seq;     // Sequence number of the next dispatch
+static unsigned long long rat[32];      // Latest producer of each register
+static int iq_count;
+static int lsq_count;
+static int max_rob_count;
+
+static FetchEntry fetch_queue[FETCH_QUEUE_SIZE];
+static int fq_head, fq_count;
+static bool frontend_done;              // Exit word or fault reached
+static bool redirect_pending;           // Mispredicted branch not yet executed
+static unsigned long long fetch_resume; // First cycle fetch may resume
+
+static bool PHT[OOO_PRED_SIZE];
+static unsigned int BTB[OOO_PRED_SIZE];
+
+static unsigned long long muldiv_free[MAX_FU_UNITS];  // Cycle each unit is free again
+static unsigned long long cycle;
+
+bool ooo_knobs_valid() {
+  return KNOB_OOO_WIDTH >= 1 && KNOB_OOO_WIDTH <= MAX_OOO_WIDTH &&
+         KNOB_ROB_SIZE >= 1 && KNOB_ROB_SIZE <= MAX_ROB_SIZE &&
+         KNOB_IQ_SIZE >= 1 && KNOB_LSQ_SIZE >= 1 && KNOB_ALU_UNITS >= 1 &&
+         KNOB_MULDIV_UNITS <= MAX_FU_UNITS &&
+         KNOB_LAT_MUL >= 1 && KNOB_LAT_DIV >= 1 && KNOB_LAT_LOAD >= 1;
+}
+
+void reset_ooo() {
+  fast_reset(&sim);
+  std::memset(rob, 0, sizeof(rob));
+  std::memset(rat, 0, sizeof(rat));
+  std::memset(PHT, 0, sizeof(PHT));
+  std::memset(BTB, 0, sizeof(BTB));
+  std::memset(muldiv_free, 0, sizeof(muldiv_free));
+  rob_head = next_seq = 1;
+  iq_count = lsq_count = max_rob_count = 0;
+  fq_head = fq_count = 0;
+  frontend_done = redirect_pending = false;
+  fetch_resume = 0;
+  cycle = 0;
+  stats_reset(STATS_OOO);
+}
+
+void load_ooo_program(const char *file_name) {
+  fast_load(&sim, file_name);
+}
+
+static inline RobEntry &rob_entry(unsigned long long seq) {
+  return rob[seq % KNOB_ROB_SIZE];
+}
+
+static inline bool uses_rs1(unsigned int opcode) {
+  return opcode == 0x33 || opcode == 0x13 || opcode == 0x03 ||
+         opcode == 0x23 || opcode == 0x63 || opcode == 0x67 || opcode == 0x2F;
+}
+
+static inline bool uses_rs2(unsigned int opcode) {
+  return opcode == 0x33 || opcode == 0x23 || opcode == 0x63 || opcode == 0x2F;
+}
+
+static inline bool is_mem(unsigned char fu) {
+  return fu == FU_LOAD || fu == FU_STORE || fu == FU_ATOMIC;
+}
+
+static unsigned char fu_kind(unsigned int instr) {
+  switch (instr_class(instr)) {
+    case CLASS_MULDIV: return (FUNCT3(instr) < 4) ? FU_MUL : FU_DIV;
+    case CLASS_LOAD:   return FU_LOAD;
+    case CLASS_STORE:  return FU_STORE;
+    case CLASS_ATOMIC: return FU_ATOMIC;
+    default:           return FU_ALU;
+  }
+}
+
+// A producer that has committed, or has executed by this cycle, is ready
+static inline bool src_ready(unsigned long long seq) {
+  if (seq < rob_head)
+    return true;
+  const RobEntry &p = rob_entry(seq);
+  return p.issued && p.done <= cycle;
+}
+
+// Commits up to KNOB_OOO_WIDTH completed instructions in program order
+static void commit_stage() {
+  for (int n = 0; n < KNOB_OOO_WIDTH && rob_head < next_seq; n++) {
+    const RobEntry &e = rob_entry(rob_head);
+    if (!e.issued || e.done > cycle)
+      break;
+    if (is_mem(e.fu))
+      lsq_count--;
+    stat_inc(STAT_INSTRS);
+    stat_inc(STAT_RETIRED_CLASS + instr_class(e.ri.instr));
+    rob_head++;
+  }
+}
+
+// True if a load or atomic may issue this cycle. Addresses are known from
+// the functional run, so disambiguation is perfect: a load only waits for
+// older stores and atomics to the same word, and takes its data from the
+// youngest of them once that one has executed.
+static bool load_can_issue(unsigned long long seq, bool *forwarded) {
+  unsigned int word = rob_entry(seq).addr >> 2;
+  *forwarded = false;
+  for (unsigned long long s = seq - 1; s >= rob_head; s--) {
+    const RobEntry &st = rob_entry(s);
+    if ((st.fu != FU_STORE && st.fu != FU_ATOMIC) || (st.addr >> 2) != word)
+      continue;
+    if (!st.issued || st.done > cycle)
+      return false;
+    *forwarded = true;
+    break;
+  }
+  return true;
+}
+
+// Issues up to KNOB_OOO_WIDTH ready instructions, oldest first, subject
+// to the number of functional units of each kind
+static void issue_stage() {
+  int issued = 0, alu_used = 0, mem_used = 0;
+
+  for (unsigned long long seq = rob_head; seq < next_seq && issued < KNOB_OOO_WIDTH; seq++) {
+    RobEntry &e = rob_entry(seq);
+    if (e.issued || !src_ready(e.src[0]) || !src_ready(e.src[1]))
+      continue;
+
+    int latency = 1;
+    int unit = -1;
+    bool forwarded = false;
+    switch (e.fu) {
+      case FU_ALU:
+        if (alu_used == KNOB_ALU_UNITS) continue;
+        alu_used++;
+        break;
+      case FU_MUL:
+      case FU_DIV:
+        for (int u = 0; u < KNOB_MULDIV_UNITS && unit < 0; u++) {
+          if (muldiv_free[u] <= cycle) unit = u;
+        }
+        if (unit < 0) continue;
+        latency = (e.fu == FU_MUL) ? KNOB_LAT_MUL : KNOB_LAT_DIV;
+        muldiv_free[unit] = (e.fu == FU_MUL) ? cycle + 1 : cycle + latency;
+        break;
+      case FU_LOAD:
+        if (mem_used == KNOB_MEM_PORTS || !load_can_issue(seq, &forwarded)) continue;
+        mem_used++;
+        if (forwarded)
+          stat_inc(STAT_OOO_LOAD_FORWARDS);
+        else
+          latency = KNOB_LAT_LOAD;
+        break;
+      case FU_STORE:
+        if (mem_used == KNOB_MEM_PORTS) continue;
+        mem_used++;
+        break;
+      case FU_ATOMIC:
+        // Reads memory like a load but never takes forwarded data
+        if (mem_used == KNOB_MEM_PORTS || !load_can_issue(seq, &forwarded)) continue;
+        mem_used++;
+        latency = KNOB_LAT_LOAD;
+        break;
+    }
+
+    e.issued = true;
+    e.done = cycle + latency;
+    iq_count--;
+    issued++;
+
+    // Fetch restarts on the correct path once the branch has executed
+    if (e.mispredicted) {
+      redirect_pending = false;
+      fetch_resume = e.done;
+    }
+  }
+}
+
+// Renames and dispatches up to KNOB_OOO_WIDTH instructions from the fetch
+// queue into the ROB, issue queue and load/store queue
+static void dispatch_stage() {
+  int n = 0;
+  for (; n < KNOB_OOO_WIDTH && fq_count > 0; n++) {
+    const FetchEntry &f = fetch_queue[fq_head];
+    unsigned char fu = fu_kind(f.ri.instr);
+    bool mem = is_mem(fu);
+
+    if (next_seq - rob_head == (unsigned long long)KNOB_ROB_SIZE) {
+      stat_inc(STAT_OOO_STALL_ROB);
+      break;
+    }
+    if (iq_count == KNOB_IQ_SIZE) {
+      stat_inc(STAT_OOO_STALL_IQ);
+      break;
+    }
+    if (mem && lsq_count == KNOB_LSQ_SIZE) {
+      stat_inc(STAT_OOO_STALL_LSQ);
+      break;
+    }
+
+    unsigned long long seq = next_seq++;
+    RobEntry &e = rob_entry(seq);
+    unsigned int opcode = OPCODE(f.ri.instr);
+    e.ri = f.ri;
+    e.addr = f.addr;
+    e.fu = fu;
+    e.issued = false;
+    e.mispredicted = f.mispredicted;
+    e.done = 0;
+    e.src[0] = uses_rs1(opcode) ? rat[RS1(f.ri.instr)] : 0;
+    e.src[1] = uses_rs2(opcode) ? rat[RS2(f.ri.instr)] : 0;
+    if (f.ri.rd != 0)
+      rat[f.ri.rd] = seq;
+
+    iq_count++;
+    if (mem) lsq_count++;
+    fq_head = (fq_head + 1) % FETCH_QUEUE_SIZE;
+    fq_count--;
+  }
+
+  if (n == 0 && fq_count == 0 && !frontend_done)
+    stat_inc(STAT_OOO_STALL_FRONTEND);
+
+  int rob_count = (int)(next_seq - rob_head);
+  stat_inc(STAT_OOO_ROB_OCCUPANCY, rob_count);
+  if (rob_count > max_rob_count)
+    max_rob_count = rob_count;
+}
+
+// Pulls up to KNOB_OOO_WIDTH instructions from the functional model. The
+// bundle ends at a transfer predicted taken; a misprediction blocks fetch
+// until the branch executes.
+static void fetch_stage() {
+  if (frontend_done)
+    return;
+  if (redirect_pending || cycle < fetch_resume) {
+    stat_inc(STAT_STALL_CONTROL, KNOB_OOO_WIDTH);
+    return;
+  }
+
+  for (int n = 0; n < KNOB_OOO_WIDTH && fq_count < FETCH_QUEUE_SIZE; n++) {
+    FetchEntry &f = fetch_queue[(fq_head + fq_count) % FETCH_QUEUE_SIZE];
+
+    // The load or atomic address is formed from registers the step
+    // overwrites
+    unsigned int load_addr = 0;
+    if (sim.PC < TEXT_SIZE && (sim.PC & 1) == 0) {
+      const DecodedInstr &d = sim.code[sim.PC >> 1];
+      load_addr = sim.R[d.rs1] + d.imm;
+    }
+    if (!fast_step(&sim, &f.ri)) {
+      frontend_done = true;
+      return;
+    }
+    fq_count++;
+
+    unsigned int opcode = OPCODE(f.ri.instr);
+    f.addr = (opcode == 0x03 || opcode == 0x2F) ? load_addr : f.ri.mem_addr;
+    f.mispredicted = false;
+
+    if (opcode == 0x63 || opcode == 0x6F || opcode == 0x67) {
+      int index = (f.ri.pc >> 1) % OOO_PRED_SIZE;
+      unsigned int predicted = PHT[index] ? BTB[index] : f.ri.pc + f.ri.len;
+      bool taken = (opcode != 0x63) || f.ri.next_pc != f.ri.pc + f.ri.len;
+
+      stat_inc(STAT_BP_LOOKUPS);
+      if (PHT[index])
+        stat_inc(STAT_BP_TAKEN);
+      stat_inc(STAT_CONTROL_HAZARDS);
+
+      // The outcome is already known here, so the predictor is trained at fetch
+      PHT[index] = taken;
+      BTB[index] = f.ri.next_pc;
+
+      if (predicted != f.ri.next_pc) {
+        stat_inc(STAT_BP_MISPREDICTS);
+        stat_inc(STAT_FLUSHES);
+        f.mispredicted = true;
+        redirect_pending = true;
+        return;
+      }
+      if (taken)
+        return;
+    }
+  }
+}
+
+void run_ooo_simulator() {
+  while (!frontend_done || fq_count > 0 || rob_head < next_seq) {
+    commit_stage();
+    issue_stage();
+    dispatch_stage();
+    fetch_stage();
+    stats_end_cycle();
+    cycle++;
+  }
+
+  syscall_flush();
+  if (sim.fault)
+    std::printf("\nFAULT at PC 0x%08X\n", sim.PC);
+  std::printf("\nSimulation completed in %llu cycles.\n", stats[STAT_CYCLES]);
+  stats_print();
+  std::printf("ROB occupancy: average %.2f, max %d of %d\n",
+              stats[STAT_CYCLES] ? (double)stats[STAT_OOO_ROB_OCCUPANCY] / stats[STAT_CYCLES] : 0.0,
+              max_rob_count, KNOB_ROB_SIZE);
+
+  if (KNOB_PRINT_REGS) {
+    std::printf("\n=== REGISTER DUMP ===\n");
+    for (int i = 0; i < 32; i++)
+      std::printf("R%d = %d\n", i, (int)sim.R[i]);
+  }
+}
@@ -0,0 +1,27 @@
+#ifndef OOO_H
+#define OOO_H
+
+#include "myRISCVSim.h"
+
+#define MAX_OOO_WIDTH 8
+#define MAX_ROB_SIZE 512
+#define MAX_FU_UNITS 8
+
+// Control knobs of the out-of-order model. The number of load/store ports
+// and mul/div units is shared with the pipeline model (KNOB_MEM_PORTS,
+// KNOB_MULDIV_UNITS in pipeline.h).
+extern int KNOB_OOO_WIDTH;    // Fetch, dispatch, issue and commit width
+extern int KNOB_ROB_SIZE;
+extern int KNOB_IQ_SIZE;
+extern int KNOB_LSQ_SIZE;
+extern int KNOB_ALU_UNITS;
+extern int KNOB_LAT_MUL;      // Pipelined
+extern int KNOB_LAT_DIV;      // DIV/REM, occupies its unit for the whole latency
+extern int KNOB_LAT_LOAD;
+
+bool ooo_knobs_valid();
+void reset_ooo();
+void load_ooo_program(const char *file_name);
+void run_ooo_simulator();
+
+#endif
@@ -0,0 +1,834 @@
+/* pipeline.cpp
+   Five-stage in-order pipeline model (phase 3) with data hazard detection,
+   optional forwarding and a 1-bit branch predictor. Each cycle the stages
+   are evaluated from write-back to fetch, so every stage consumes the
+   latch its predecessor filled in the previous cycle.
+
+   Every latch holds a bundle of up to KNOB_ISSUE_WIDTH instructions in
+   program order (slot 0 is the oldest). Decode issues the longest prefix
+   of IF/ID that has no hazard on older instructions, no dependency on an
+   earlier slot of the same bundle and fits the load/store and mul/div
+   limits; the rest waits in IF/ID and fetch refills the free slots.
+
+   A bundle with a DIV/REM stays in EX, and one with a load or store stays
+   in MEM, for the configured latency; the stages behind it stall. When
+   nothing but those latency counters can change, the model jumps the
+   cycle counter straight to the next cycle that does something.
+
+   An ECALL runs its system call at write-back, where the registers and
+   memory are up to date, and nothing behind it issues until it has
+   retired. An instruction the model cannot execute (including the zero
+   words fetched past the text) or a load or store outside memory faults
+   when it reaches write-back.
+*/
+
+#include "pipeline.h"
+#include "myRISCVSim.h"
+#include "stats.h"
+#include "rvc.h"
+#include "pipeview.h"
+#include "syscall.h"
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Branch Predictor Table (1-bit): index by PC >> 1
+#define PRED_SIZE 256
+static bool PHT[PRED_SIZE];            // Prediction table (1-bit)
+static unsigned int BTB[PRED_SIZE];    // Branch Target Buffer
+
+// Hash function for indexing predictor tables
+static int predictor_index(unsigned int pc) {
+    return (pc >> 1) % PRED_SIZE;
+}
+
+// Control knobs
+bool KNOB_PIPELINE = true;
+bool KNOB_FORWARDING = false;
+bool KNOB_PRINT_REGS = false;
+bool KNOB_PRINT_PIPELINE = false;
+int  KNOB_TRACE_INSTR = -1;  // e.g. 10 for 10th instruction
+int  KNOB_ISSUE_WIDTH = 1;   // Instructions per bundle, up to MAX_ISSUE_WIDTH
+int  KNOB_MEM_PORTS = 1;     // Loads/stores per bundle
+int  KNOB_MULDIV_UNITS = 1;  // Multiplies/divides per bundle
+int  KNOB_DIV_LATENCY = 1;   // Cycles a DIV/REM bundle spends in EX
+int  KNOB_MEM_LATENCY = 1;   // Cycles a load/store bundle spends in MEM
+bool KNOB_CYCLE_SKIP = true; // Jump over idle cycles in bulk
+
+// Memory
+static unsigned char MEM[MEM_SIZE];
+
+struct PipelineCPU {
+    unsigned int PC = 0;
+    unsigned int R[32] = {0};
+};
+
+static PipelineCPU cpu;
+static bool fetch_halted = false;   // Exit word fetched, stop fetching
+static bool exit_retired = false;   // Exit word reached write-back
+static bool faulted = false;        // An unsupported instruction or bad access reached write-back
+static unsigned int fault_pc = 0;
+static bool stalled = false;        // stalled_pc waited on a data hazard last cycle
+static unsigned int stalled_pc = 0;
+
+// Multi-cycle EX and MEM: the remaining bubble cycles before the bundle in
+// ID/EX (EX/MEM) can move on, and whether its latency has been charged
+static int ex_wait = 0;
+static bool ex_started = false;
+static int mem_wait = 0;
+static bool mem_started = false;
+static bool mem_held = false;       // MEM kept its bundle this cycle
+
+// Instructions retired in the current cycle, for pipeline_step()
+static RetireInfo retired[MAX_ISSUE_WIDTH];
+static int retired_count = 0;
+static int retired_head = 0;
+
+// Pipeline registers
+struct IF_ID_Reg {
+    bool valid = false;
+    unsigned int instr = 0;         // Expanded if compressed
+    unsigned int len = 4;           // Instruction size in bytes
+    unsigned int pc = 0;
+    unsigned int pred_pc = 0;       // Next PC chosen by the predictor
+    unsigned int view = 0;          // Pipeline viewer id, see pipeview.h
+    bool view_stalled = false;      // Its wait in IF/ID has been logged
+};
+
+struct ID_EX_Reg {
+    bool valid = false;
+    unsigned int instr = 0;
+    unsigned int len = 4;
+    unsigned int pc = 0;
+    unsigned int pred_pc = 0;
+    unsigned int rs1_val = 0, rs2_val = 0;
+    unsigned int rs1 = 0, rs2 = 0;
+    unsigned int rd = 0;
+    int imm = 0;
+    unsigned int opcode = 0;
+    unsigned int view = 0;
+};
+
+struct EX_MEM_Reg {
+    bool valid = false;
+    unsigned int instr = 0;
+    unsigned int len = 4;
+    unsigned int pc = 0;
+    unsigned int next_pc = 0;
+    unsigned int alu_result = 0;
+    unsigned int rs2_val = 0;
+    unsigned int rd = 0;
+    unsigned int opcode = 0;
+    unsigned int view = 0;
+};
+
+struct MEM_WB_Reg {
+    bool valid = false;
+    unsigned int instr = 0;
+    unsigned int len = 4;
+    unsigned int pc = 0;
+    unsigned int next_pc = 0;
+    unsigned int store_size = 0;    // Bytes stored by a store, else 0
+    unsigned int store_value = 0;
+    unsigned int mem_data = 0;
+    bool bad_addr = false;          // Load/store outside MEM; faults at write-back
+    unsigned int alu_result = 0;
+    unsigned int rd = 0;
+    unsigned int opcode = 0;
+    unsigned int view = 0;
+};
+
+static IF_ID_Reg IF_ID[MAX_ISSUE_WIDTH];
+static ID_EX_Reg ID_EX[MAX_ISSUE_WIDTH];
+static EX_MEM_Reg EX_MEM[MAX_ISSUE_WIDTH];
+static MEM_WB_Reg MEM_WB[MAX_ISSUE_WIDTH];
+
+// True if an instruction with this opcode writes rd
+static bool writes_rd(unsigned int opcode, unsigned int rd) {
+    if (rd == 0) return false;
+    return opcode == 0x33 || opcode == 0x13 || opcode == 0x03 || opcode == 0x37 ||
+           opcode == 0x17 || opcode == 0x6F || opcode == 0x67;
+}
+
+static bool uses_rs1(unsigned int opcode) {
+    return opcode == 0x33 || opcode == 0x13 || opcode == 0x03 ||
+           opcode == 0x23 || opcode == 0x63 || opcode == 0x67;
+}
+
+static bool uses_rs2(unsigned int opcode) {
+    return opcode == 0x33 || opcode == 0x23 || opcode == 0x63;
+}
+
+// Value an instruction in MEM/WB will write back
+static unsigned int wb_value(const MEM_WB_Reg &r) {
+    return (r.opcode == 0x03) ? r.mem_data : r.alu_result;
+}
+
+// RAW hazard between an instruction in IF/ID and older instructions that
+// have not written back yet. With forwarding only a load immediately
+// followed by a dependent instruction has to wait.
+static bool detect_data_hazard(unsigned int instr) {
+    unsigned int opcode = OPCODE(instr);
+    unsigned int rs1 = uses_rs1(opcode) ? RS1(instr) : 0;
+    unsigned int rs2 = uses_rs2(opcode) ? RS2(instr) : 0;
+
+    for (int i = 0; i < KNOB_ISSUE_WIDTH; i++) {
+        const EX_MEM_Reg &ex = EX_MEM[i];
+        if (ex.valid && writes_rd(ex.opcode, ex.rd) &&
+            (!KNOB_FORWARDING || ex.opcode == 0x03) &&
+            (rs1 == ex.rd || rs2 == ex.rd))
+            return true;
+
+        const MEM_WB_Reg &wb = MEM_WB[i];
+        if (!KNOB_FORWARDING && wb.valid && writes_rd(wb.opcode, wb.rd) &&
+            (rs1 == wb.rd || rs2 == wb.rd))
+            return true;
+    }
+    return false;
+}
+
+// True if instr reads a register written by one of the first n slots of
+// IF/ID. Results are only forwarded between bundles, so such a pair
+// cannot issue together.
+static bool depends_on_bundle(unsigned int instr, int n) {
+    unsigned int opcode = OPCODE(instr);
+    unsigned int rs1 = uses_rs1(opcode) ? RS1(instr) : 0;
+    unsigned int rs2 = uses_rs2(opcode) ? RS2(instr) : 0;
+
+    for (int i = 0; i < n; i++) {
+        unsigned int older = IF_ID[i].instr;
+        unsigned int rd = RD(older);
+        if (writes_rd(OPCODE(older), rd) && (rs1 == rd || rs2 == rd))
+            return true;
+    }
+    return false;
+}
+
+// True if the model can execute instr, the exit word aside
+static bool supported(unsigned int instr) {
+    unsigned int funct3 = FUNCT3(instr);
+    unsigned int funct7 = FUNCT7(instr);
+    switch (OPCODE(instr)) {
+        case 0x33:
+            return funct7 == 0x00 || funct7 == 0x01 ||
+                   (funct7 == 0x20 && (funct3 == 0x0 || funct3 == 0x5));
+        case 0x13:
+            if (funct3 == 0x1) return funct7 == 0x00;
+            if (funct3 == 0x5) return funct7 == 0x00 || funct7 == 0x20;
+            return true;
+        case 0x03: return funct3 != 0x3 && funct3 <= 0x5;
+        case 0x23: return funct3 <= 0x2;
+        case 0x63: return funct3 != 0x2 && funct3 != 0x3;
+        case 0x67: return funct3 == 0x0;
+        case 0x6F: case 0x37: case 0x17: return true;
+        default:   return instr == ECALL_INSTR;
+    }
+}
+
+// True if an ECALL has issued and not yet retired
+static bool ecall_in_flight() {
+    for (int i = 0; i < KNOB_ISSUE_WIDTH; i++) {
+        if ((ID_EX[i].valid && ID_EX[i].instr == ECALL_INSTR) ||
+            (EX_MEM[i].valid && EX_MEM[i].instr == ECALL_INSTR) ||
+            (MEM_WB[i].valid && MEM_WB[i].instr == ECALL_INSTR))
+            return true;
+    }
+    return false;
+}
+
+// Stall logic by freezing IF and ID stage
+static void insert_stall() {
+    stat_inc(STAT_STALL_DATA);
+
+    if (KNOB_PRINT_PIPELINE)
+        std::cout << "[STALL] Data hazard detected, inserting stall\n";
+}
+
+// Load program; accepts the same commented .mc format as the functional
+// simulator
+void load_pipeline_program(const char* filename) {
+    FILE *fp = std::fopen(filename, "r");
+    if (fp == nullptr) {
+        std::printf("Error opening input mem file\n");
+        std::exit(1);
+    }
+    char line[256];
+    unsigned int addr, instr;
+    unsigned int data_end = DATA_OFFSET;
+    while (std::fgets(line, sizeof(line), fp) != nullptr) {
+        if (parse_mc_line(line, &addr, &instr)) {
+            write_word(reinterpret_cast<char*>(MEM), addr, instr);
+            if (addr >= DATA_OFFSET && addr + 4 > data_end) data_end = addr + 4;
+        }
+    }
+    std::fclose(fp);
+    syscall_reset(data_end);
+}
+
+void reset_pipeline() {
+    std::memset(MEM, 0, sizeof(MEM));
+    std::memset(PHT, 0, sizeof(PHT));
+    std::memset(BTB, 0, sizeof(BTB));
+    cpu = PipelineCPU();
+    for (int i = 0; i < MAX_ISSUE_WIDTH; i++) {
+        IF_ID[i] = IF_ID_Reg();
+        ID_EX[i] = ID_EX_Reg();
+        EX_MEM[i] = EX_MEM_Reg();
+        MEM_WB[i] = MEM_WB_Reg();
+    }
+    fetch_halted = false;
+    exit_retired = false;
+    faulted = false;
+    fault_pc = 0;
+    stalled = false;
+    stalled_pc = 0;
+    ex_wait = mem_wait = 0;
+    ex_started = mem_started = mem_held = false;
+    retired_count = retired_head = 0;
+    stats_reset(STATS_PIPELINE);
+}
+
+// Fetch stage; fills the free slots of IF/ID with sequential instructions
+// and ends the bundle after a control transfer predicted taken
+static void fetch_stage() {
+    int slot = 0;
+    while (slot < KNOB_ISSUE_WIDTH && IF_ID[slot].valid)
+        slot++;
+
+    for (; slot < KNOB_ISSUE_WIDTH && !fetch_halted; slot++) {
+        IF_ID_Reg &f = IF_ID[slot];
+        f.valid = true;
+        f.pc = cpu.PC;
+        f.len = 4;
+        f.instr = (cpu.PC < TEXT_SIZE)
+            ? rvc_fetch(read_word(reinterpret_cast<char*>(MEM), cpu.PC), &f.len) : 0;
+
+        unsigned int opcode = OPCODE(f.instr);
+
+        if (opcode == 0x63 || opcode == 0x6F || opcode == 0x67) { // Branches/JAL/JALR
+            int index = predictor_index(cpu.PC);
+            bool prediction = PHT[index];
+            unsigned int predicted_target = BTB[index];
+
+            stat_inc(STAT_BP_LOOKUPS);
+            if (prediction)
+                stat_inc(STAT_BP_TAKEN);
+
+            if (KNOB_PRINT_PIPELINE || KNOB_PRINT_REGS ||
+                KNOB_TRACE_INSTR == (int)(stats[STAT_INSTRS] + 1)) {
+                std::cout << "[BP] Prediction for PC 0x" << std::hex << cpu.PC << ": "
+                          << (prediction ? "TAKEN" : "NOT TAKEN") << ", target = 0x"
+                          << predicted_target << std::dec << std::endl;
+            }
+
+            // Speculative PC update
+            cpu.PC = prediction ? predicted_target : cpu.PC + f.len;
+        } else {
+            cpu.PC += f.len;
+        }
+        f.pred_pc = cpu.PC;
+        f.view = pipeview_enabled ? pipeview_fetch(f.pc, f.instr) : 0;
+        f.view_stalled = false;
+
+        if (f.instr == 0xEF000011)
+            fetch_halted = true;
+        if (f.pred_pc != f.pc + f.len)
+            break;
+    }
+}
+
+// Number of leading IF/ID slots that can issue this cycle. A data hazard
+// on an older instruction stalls the slot that has it and everything
+// behind it.
+static int issue_count() {
+    int n = 0;
+    int mem_ops = 0, muldiv_ops = 0;
+    bool data_stall = false;
+
+    for (; n < KNOB_ISSUE_WIDTH && IF_ID[n].valid; n++) {
+        unsigned int instr = IF_ID[n].instr;
+        if (n > 0 && IF_ID[n - 1].instr == ECALL_INSTR)
+            break;
+        if (n == 0 && ecall_in_flight()) {
+            stat_inc(STAT_STALL_SYSCALL);
+            break;
+        }
+        if (!KNOB_PIPELINE)
+            continue;
+
+        if (detect_data_hazard(instr)) {
+            data_stall = true;
+            break;
+        }
+        if (depends_on_bundle(instr, n)) {
+            stat_inc(STAT_ISSUE_INTRA_DEP);
+            break;
+        }
+        int cls = instr_class(instr);
+        if (cls == CLASS_LOAD || cls == CLASS_STORE) {
+            if (mem_ops == KNOB_MEM_PORTS) {
+                stat_inc(STAT_ISSUE_STRUCTURAL);
+                break;
+            }
+            mem_ops++;
+        } else if (cls == CLASS_MULDIV) {
+            if (muldiv_ops == KNOB_MULDIV_UNITS) {
+                stat_inc(STAT_ISSUE_STRUCTURAL);
+                break;
+            }
+            muldiv_ops++;
+        }
+    }
+
+    // A hazard is counted once, not once per stall cycle
+    if (data_stall && !(stalled && stalled_pc == IF_ID[n].pc))
+        stat_inc(STAT_DATA_HAZARDS);
+    stalled = data_stall;
+    stalled_pc = data_stall ? IF_ID[n].pc : 0;
+    if (data_stall && n == 0)
+        insert_stall();
+    return n;
+}
+
+// Decode stage; issues the first n slots of IF/ID into ID/EX and moves
+// the remaining ones to the front of IF/ID
+static void decode_stage(int n) {
+    for (int i = 0; i < KNOB_ISSUE_WIDTH; i++) {
+        ID_EX_Reg &d = ID_EX[i];
+        if (i >= n) {
+            d.valid = false;
+            continue;
+        }
+        const IF_ID_Reg &f = IF_ID[i];
+        stat_inc(STAT_ISSUE_SLOT + i);
+
+        d.valid = true;
+        d.instr = f.instr;
+        d.len = f.len;
+        d.pc = f.pc;
+        d.pred_pc = f.pred_pc;
+        d.view = f.view;
+        pipeview_stage(d.view, "D");
+
+        d.opcode = OPCODE(d.instr);
+        d.rd = RD(d.instr);
+        d.rs1 = RS1(d.instr);
+        d.rs2 = RS2(d.instr);
+
+        d.rs1_val = cpu.R[d.rs1];
+        d.rs2_val = cpu.R[d.rs2];
+
+        // Slots are in program order and EX/MEM holds the younger
+        // producers, so later matches override earlier ones
+        if (KNOB_FORWARDING) {
+            for (int j = 0; j < KNOB_ISSUE_WIDTH; j++) {
+                const MEM_WB_Reg &wb = MEM_WB[j];
+                if (wb.valid && writes_rd(wb.opcode, wb.rd)) {
+                    if (d.rs1 == wb.rd) d.rs1_val = wb_value(wb);
+                    if (d.rs2 == wb.rd) d.rs2_val = wb_value(wb);
+                }
+            }
+            for (int j = 0; j < KNOB_ISSUE_WIDTH; j++) {
+                const EX_MEM_Reg &ex = EX_MEM[j];
+                if (ex.valid && writes_rd(ex.opcode, ex.rd)) {
+                    if (d.rs1 == ex.rd) d.rs1_val = ex.alu_result;
+                    if (d.rs2 == ex.rd) d.rs2_val = ex.alu_result;
+                }
+            }
+        }
+
+        switch (d.opcode) {
+            case 0x13: case 0x03: case 0x67: d.imm = imm_i(d.instr); break;
+            case 0x23: d.imm = imm_s(d.instr); break;
+            case 0x63: d.imm = imm_b(d.instr); break;
+            case 0x6F: d.imm = imm_j(d.instr); break;
+            case 0x37: case 0x17: d.imm = imm_u(d.instr); break;
+            default: d.imm = 0; break;
+        }
+
+        if (KNOB_PRINT_PIPELINE)
+            std::cout << "[ID] Decoding instr 0x" << std::hex << d.instr
+                      << ", rs1: R" << std::dec << d.rs1 << "=" << d.rs1_val
+                      << ", rs2: R" << d.rs2 << "=" << d.rs2_val << std::endl;
+    }
+
+    int i = 0;
+    for (; n + i < KNOB_ISSUE_WIDTH && IF_ID[n + i].valid; i++)
+        IF_ID[i] = IF_ID[n + i];
+    for (; i < KNOB_ISSUE_WIDTH; i++)
+        IF_ID[i].valid = false;
+}
+
+static bool is_div_rem(unsigned int instr) {
+    return OPCODE(instr) == 0x33 && FUNCT7(instr) == 0x01 && FUNCT3(instr) >= 0x4;
+}
+
+// Cycles the bundle in ID/EX needs in EX
+static int ex_latency() {
+    for (int i = 0; i < KNOB_ISSUE_WIDTH; i++) {
+        if (ID_EX[i].valid && is_div_rem(ID_EX[i].instr))
+            return KNOB_DIV_LATENCY;
+    }
+    return 1;
+}
+
+// Cycles the bundle in EX/MEM needs in MEM
+static int mem_latency() {
+    for (int i = 0; i < KNOB_ISSUE_WIDTH; i++) {
+        if (EX_MEM[i].valid && (EX_MEM[i].opcode == 0x03 || EX_MEM[i].opcode == 0x23))
+            return KNOB_MEM_LATENCY;
+    }
+    return 1;
+}
+
+// Execute stage; resolves branches and jumps against the prediction made
+// at fetch. A misprediction squashes the younger slots of the bundle
+// along with IF/ID.
+static void execute_stage() {
+    bool squash = false;
+
+    if (ID_EX[0].valid && !ex_started) {
+        ex_started = true;
+        ex_wait = ex_latency() - 1;
+        for (int i = 0; i < KNOB_ISSUE_WIDTH; i++) {
+            if (ID_EX[i].valid)
+                pipeview_stage(ID_EX[i].view, "X");
+        }
+    }
+    if (ex_wait > 0) {
+        ex_wait--;
+        stat_inc(STAT_STALL_EXECUTE);
+        if (!mem_held) {
+            for (int i = 0; i < KNOB_ISSUE_WIDTH; i++)
+                EX_MEM[i].valid = false;
+        }
+        return;
+    }
+    // EX/MEM is still occupied
+    if (mem_held)
+        return;
+    ex_started = false;
+
+    for (int i = 0; i < KNOB_ISSUE_WIDTH; i++) {
+        ID_EX_Reg &d = ID_EX[i];
+        EX_MEM_Reg &e = EX_MEM[i];
+        if (!d.valid || squash) {
+            if (d.valid) {
+                stat_inc(STAT_FLUSHED_INSTRS);
+                pipeview_flush(d.view);
+            }
+            d.valid = false;
+            e.valid = false;
+            continue;
+        }
+        d.valid = false;
+
+        unsigned int a = d.rs1_val;
+        unsigned int b = d.rs2_val;
+        unsigned int result = 0;
+        unsigned int next_pc = d.pc + d.len;
+        bool taken = false;
+
+        switch (d.opcode) {
+            case 0x33: result = alu_compute(d.instr, a, b); break;
+            case 0x13: result = alu_compute(d.instr, a, d.imm); break;
+            case 0x03: case 0x23: result = a + d.imm; break;
+            case 0x37: result = d.imm; break;
+            case 0x17: result = d.pc + d.imm; break;
+            case 0x6F:
+                result = d.pc + d.len;
+                next_pc = d.pc + d.imm;
+                taken = true;
+                break;
+            case 0x67:
+                result = d.pc + d.len;
+                next_pc = (a + d.imm) & ~1u;
+                taken = true;
+                break;
+            case 0x63:
+                taken = branch_taken(d.instr, a, b);
+                if (taken) next_pc = d.pc + d.imm;
+                break;
+        }
+
+        // Control hazard detection
+        if (d.opcode == 0x63 || d.opcode == 0x6F || d.opcode == 0x67) {
+            stat_inc(STAT_CONTROL_HAZARDS);
+
+            if (next_pc != d.pred_pc) {
+                stat_inc(STAT_BP_MISPREDICTS);
+                stat_inc(STAT_FLUSHES);
+                // Decode gets nothing from the squashed IF/ID for a cycle
+                stat_inc(STAT_STALL_CONTROL, KNOB_ISSUE_WIDTH);
+                for (int j = 0; j < KNOB_ISSUE_WIDTH; j++) {
+                    if (IF_ID[j].valid) {
+                        stat_inc(STAT_FLUSHED_INSTRS);
+                        pipeview_flush(IF_ID[j].view);
+                    }
+                    IF_ID[j].valid = false;
+                }
+
+                if (KNOB_PRINT_PIPELINE)
+                    std::cout << "[BP] MISPREDICTION! Flushing pipeline at PC = 0x" << std::hex
+                              << d.pc << std::dec << std::endl;
+
+                // Flush the wrong-path fetch and restart from the actual target
+                cpu.PC = next_pc;
+                fetch_halted = false;
+                squash = true;
+            }
+
+            // Update predictor
+            int index = predictor_index(d.pc);
+            PHT[index] = taken;
+            BTB[index] = next_pc;
+        }
+
+        e.valid = true;
+        e.instr = d.instr;
+        e.len = d.len;
+        e.pc = d.pc;
+        e.next_pc = next_pc;
+        e.alu_result = result;
+        e.rs2_val = b;
+        e.rd = d.rd;
+        e.opcode = d.opcode;
+        e.view = d.view;
+    }
+}
+
+// Memory; the slots access memory in program order
+static void memory_stage() {
+    if (!mem_started) {
+        mem_started = true;
+        mem_wait = mem_latency() - 1;
+        for (int i = 0; i < KNOB_ISSUE_WIDTH; i++) {
+            if (EX_MEM[i].valid)
+                pipeview_stage(EX_MEM[i].view, "M");
+        }
+    }
+    mem_held = mem_wait > 0;
+    if (mem_held) {
+        mem_wait--;
+        stat_inc(STAT_STALL_MEMORY);
+        for (int i = 0; i < KNOB_ISSUE_WIDTH; i++)
+            MEM_WB[i].valid = false;
+        return;
+    }
+    mem_started = false;
+
+    for (int i = 0; i < KNOB_ISSUE_WIDTH; i++) {
+        const EX_MEM_Reg &e = EX_MEM[i];
+        MEM_WB_Reg &m = MEM_WB[i];
+        if (!e.valid) {
+            m.valid = false;
+            continue;
+        }
+
+        m.valid = true;
+        m.instr = e.instr;
+        m.len = e.len;
+        m.pc = e.pc;
+        m.next_pc = e.next_pc;
+        m.store_size = 0;
+        m.store_value = 0;
+        m.rd = e.rd;
+        m.opcode = e.opcode;
+        m.alu_result = e.alu_result;
+        m.view = e.view;
+
+        unsigned int addr = e.alu_result;
+        int idx = mem_index(addr, 1u << (FUNCT3(e.instr) & 0x3));
+        m.bad_addr = (e.opcode == 0x03 || e.opcode == 0x23) && idx < 0;
+        if (m.bad_addr)
+            continue;
+        if (e.opcode == 0x03) {
+            switch (FUNCT3(e.instr)) {
+                case 0x0: m.mem_data = (unsigned int)(signed char)MEM[idx]; break;
+                case 0x1: m.mem_data = (unsigned int)(short)(MEM[idx] | MEM[idx + 1] << 8); break;
+                case 0x4: m.mem_data = MEM[idx]; break;
+                case 0x5: m.mem_data = MEM[idx] | MEM[idx + 1] << 8; break;
+                default:  m.mem_data = read_word(reinterpret_cast<char*>(MEM), addr); break;
+            }
+            if (KNOB_PRINT_PIPELINE)
+                std::cout << "[MEM] Loaded " << m.mem_data << " from " << addr << std::endl;
+        } else if (e.opcode == 0x23) {
+            switch (FUNCT3(e.instr)) {
+                case 0x0:
+                    MEM[idx] = e.rs2_val & 0xFF;
+                    m.store_size = 1;
+                    m.store_value = e.rs2_val & 0xFF;
+                    break;
+                case 0x1:
+                    MEM[idx] = e.rs2_val & 0xFF;
+                    MEM[idx + 1] = (e.rs2_val >> 8) & 0xFF;
+                    m.store_size = 2;
+                    m.store_value = e.rs2_val & 0xFFFF;
+                    break;
+                default:
+                    write_word(reinterpret_cast<char*>(MEM), addr, e.rs2_val);
+                    m.store_size = 4;
+                    m.store_value = e.rs2_val;
+                    break;
+            }
+            if (KNOB_PRINT_PIPELINE)
+                std::cout << "[MEM] Stored " << e.rs2_val << " at " << addr << std::endl;
+        }
+    }
+}
+
+// Write-back; this is where instructions retire, oldest slot first
+static void write_back_stage() {
+    retired_count = retired_head = 0;
+
+    for (int i = 0; i < KNOB_ISSUE_WIDTH; i++) {
+        MEM_WB_Reg &m = MEM_WB[i];
+        if (!m.valid) continue;
+        m.valid = false;
+        pipeview_stage(m.view, "W");
+        pipeview_retire(m.view);
+
+        if (m.instr == 0xEF000011) {
+            exit_retired = true;
+            return;
+        }
+        if (!supported(m.instr) || m.bad_addr) {
+            faulted = exit_retired = true;
+            fault_pc = m.pc;
+            return;
+        }
+        if (m.instr == ECALL_INSTR && !syscall_dispatch(cpu.R, MEM, stats[STAT_INSTRS])) {
+            exit_retired = true;
+            return;
+        }
+
+        if (writes_rd(m.opcode, m.rd)) {
+            cpu.R[m.rd] = wb_value(m);
+            if (KNOB_PRINT_PIPELINE)
+                std::cout << "[WB] Wrote " << cpu.R[m.rd] << " to R" << m.rd << std::endl;
+        }
+
+        stat_inc(STAT_INSTRS);
+        stat_inc(STAT_RETIRED_CLASS + instr_class(m.instr));
+
+        RetireInfo &r = retired[retired_count++];
+        r.pc = m.pc;
+        r.instr = m.instr;
+        r.len = m.len;
+        r.next_pc = m.next_pc;
+        r.rd = writes_rd(m.opcode, m.rd) ? m.rd : 0;
+        r.rd_value = cpu.R[r.rd];
+        r.mem_size = m.store_size;
+        r.mem_addr = m.store_size ? m.alu_result : 0;
+        r.mem_value = m.store_value;
+    }
+}
+
+// Jumps over the cycles in which only the EX and MEM latency counters
+// would change: nothing to write back, MEM busy or empty, EX busy or
+// blocked by MEM, decode blocked by the held ID/EX and no free IF/ID slot
+// to fetch into. Returns false if the next cycle does real work.
+static bool skip_idle_cycles() {
+    if (ex_wait == 0 && mem_wait == 0)
+        return false;
+    for (int i = 0; i < KNOB_ISSUE_WIDTH; i++) {
+        if (MEM_WB[i].valid || (mem_wait == 0 && EX_MEM[i].valid))
+            return false;
+        if (!fetch_halted && !IF_ID[i].valid)
+            return false;
+    }
+    if (!ID_EX[0].valid || !ex_started)
+        return false;
+
+    unsigned long long n;
+    if (ex_wait > 0 && mem_wait > 0)
+        n = (ex_wait < mem_wait) ? ex_wait : mem_wait;
+    else
+        n = (ex_wait > 0) ? ex_wait : mem_wait;
+    if (n > stats_cycles_to_interval())
+        n = stats_cycles_to_interval();
+
+    if (ex_wait > 0) {
+        ex_wait -= (int)n;
+        stat_inc(STAT_STALL_EXECUTE, n);
+    }
+    if (mem_wait > 0) {
+        mem_wait -= (int)n;
+        stat_inc(STAT_STALL_MEMORY, n);
+    }
+    stat_inc(STAT_SKIPPED_CYCLES, n);
+    stats_end_cycles(n);
+    return true;
+}
+
+// Logs the instructions left in IF/ID after decode as waiting there
+static void log_waiting() {
+    for (int i = 0; i < KNOB_ISSUE_WIDTH && IF_ID[i].valid; i++) {
+        if (!IF_ID[i].view_stalled) {
+            pipeview_stage(IF_ID[i].view, "Ds");
+            IF_ID[i].view_stalled = true;
+        }
+    }
+}
+
+// Advances the model by one clock cycle, or by a run of idle cycles
+static void pipeline_cycle() {
+    if (KNOB_CYCLE_SKIP && skip_idle_cycles())
+        return;
+    write_back_stage();
+    if (exit_retired) {
+        stats_end_cycle();
+        return;
+    }
+    memory_stage();
+    execute_stage();
+
+    // Detect hazards *before* decode; stalled slots stay in IF/ID. A bundle
+    // still held in ID/EX blocks decode entirely.
+    if (!ID_EX[0].valid)
+        decode_stage(issue_count());
+    if (pipeview_enabled)
+        log_waiting();
+    fetch_stage();
+    stats_end_cycle();
+}
+
+// Main simulator loop
+void run_pipeline_simulator() {
+    while (!exit_retired)
+        pipeline_cycle();
+
+    syscall_flush();
+    if (faulted)
+        std::printf("\nFAULT at PC 0x%08X\n", fault_pc);
+    std::cout << "\nSimulation completed in " << stats[STAT_CYCLES] << " cycles.\n";
+    stats_print();
+
+    if (KNOB_PRINT_REGS) {
+        std::cout << "\n=== REGISTER DUMP ===\n";
+        for (int i = 0; i < 32; i++)
+            std::cout << "R" << i << " = " << (int)cpu.R[i] << "\n";
+    }
+}
+
+// Clocks the model until the next instruction retires and describes it in
+// ri. Returns false once the exit word or an exit ECALL has retired, or
+// the model faulted.
+bool pipeline_step(RetireInfo *ri) {
+    while (retired_head == retired_count) {
+        if (exit_retired)
+            return false;
+        pipeline_cycle();
+    }
+    *ri = retired[retired_head++];
+    return true;
+}
+
+void pipeline_regs(unsigned int *R) {
+    std::memcpy(R, cpu.R, sizeof(cpu.R));
+}
+
+bool pipeline_faulted() {
+    return faulted;
+}
@@ -0,0 +1,28 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "myRISCVSim.h"
+
+// Control knobs of the pipeline model
+extern bool KNOB_PIPELINE;
+extern bool KNOB_FORWARDING;
+extern bool KNOB_PRINT_REGS;
+extern bool KNOB_PRINT_PIPELINE;
+extern int  KNOB_TRACE_INSTR;
+extern int  KNOB_ISSUE_WIDTH;
+extern int  KNOB_MEM_PORTS;
+extern int  KNOB_MULDIV_UNITS;
+extern int  KNOB_DIV_LATENCY;
+extern int  KNOB_MEM_LATENCY;
+extern bool KNOB_CYCLE_SKIP;
+
+void reset_pipeline();
+void load_pipeline_program(const char* filename);
+void run_pipeline_simulator();
+bool pipeline_step(RetireInfo *ri);
+void pipeline_regs(unsigned int *R);
+
+// True if the last run stopped on an instruction the model cannot execute
+bool pipeline_faulted();
+
+#endif
@@ -0,0 +1,185 @@
+/* pipeview.cpp
+   Pipeline viewer log (see pipeview.h). The Kanata records used, with
+   tab-separated fields:
+     Kanata 0004          header
+     C= <cycle>           cycle of the first record
+     C <n>                n cycles pass
+     I <id> <seq> 0       instruction id enters the log
+     L <id> 0 <text>      its label: PC and instruction word
+     S <id> 0 <stage>     it starts stage, ending the one before
+     R <id> <n> 0|1       it retires as the n-th logged, or is flushed
+   Records are encoded by hand into a large buffer that is written out
+   when it fills, so an event costs a few byte stores instead of a
+   formatted stream write. Idle cycles skipped by the model only cost one
+   C record.
+*/
+
+#include "pipeview.h"
+#include "myRISCVSim.h"
+#include "stats.h"
+#include <cstdio>
+#include <cstdlib>
+
+bool pipeview_enabled = false;
+
+static FILE *view_fp;
+static char buf[PIPEVIEW_BUF_SIZE];
+static size_t buf_len;
+static unsigned long long first_cycle, last_cycle;
+static unsigned long long view_cycle;   // Cycle of the last record
+static bool started;
+static unsigned int next_id;
+static unsigned long long retired_count;
+
+// Instructions written back this cycle; their retire records go out when
+// the cycle ends, so W lasts one cycle in the viewer
+static unsigned int retiring[MAX_ISSUE_WIDTH];
+static int num_retiring;
+
+// Longest record: a label with two numbers and two hex words
+#define MAX_RECORD 96
+
+static void put_char(char c) {
+  buf[buf_len++] = c;
+}
+
+static void put_str(const char *s) {
+  while (*s)
+    buf[buf_len++] = *s++;
+}
+
+static void put_uint(unsigned long long v) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  while (n > 0)
+    buf[buf_len++] = digits[--n];
+}
+
+static void put_hex(unsigned int v) {
+  static const char hex[] = "0123456789abcdef";
+  for (int shift = 28; shift >= 0; shift -= 4)
+    buf[buf_len++] = hex[(v >> shift) & 0xF];
+}
+
+static void flush_buf() {
+  std::fwrite(buf, 1, buf_len, view_fp);
+  buf_len = 0;
+}
+
+// Makes room for one record
+static void reserve() {
+  if (buf_len > PIPEVIEW_BUF_SIZE - MAX_RECORD)
+    flush_buf();
+}
+
+static void put_cycles(unsigned long long n) {
+  reserve();
+  put_str("C\t");
+  put_uint(n);
+  put_char('\n');
+}
+
+static void put_retire(unsigned int id, unsigned long long n, bool flushed) {
+  reserve();
+  put_str("R\t");
+  put_uint(id);
+  put_char('\t');
+  put_uint(n);
+  put_str(flushed ? "\t1\n" : "\t0\n");
+}
+
+// Brings the log up to cycle, retiring last cycle's write-backs on the way
+static void advance(unsigned long long cycle) {
+  if (!started) {
+    started = true;
+    view_cycle = cycle;
+    reserve();
+    put_str("C=\t");
+    put_uint(cycle);
+    put_char('\n');
+    return;
+  }
+  if (cycle == view_cycle)
+    return;
+  if (num_retiring) {
+    put_cycles(1);
+    view_cycle++;
+    for (int i = 0; i < num_retiring; i++)
+      put_retire(retiring[i], retired_count++, false);
+    num_retiring = 0;
+  }
+  if (cycle > view_cycle)
+    put_cycles(cycle - view_cycle);
+  view_cycle = cycle;
+}
+
+void pipeview_open(const char *file_name, unsigned long long first, unsigned long long last) {
+  view_fp = std::fopen(file_name, "w");
+  if (view_fp == nullptr) {
+    std::printf("Error opening %s for writing\n", file_name);
+    std::exit(1);
+  }
+  first_cycle = first;
+  last_cycle = last;
+  buf_len = 0;
+  started = false;
+  next_id = 0;
+  retired_count = 0;
+  num_retiring = 0;
+  put_str("Kanata\t0004\n");
+  pipeview_enabled = true;
+}
+
+void pipeview_close() {
+  if (!pipeview_enabled)
+    return;
+  if (num_retiring)
+    advance(view_cycle + 1);
+  flush_buf();
+  std::fclose(view_fp);
+  pipeview_enabled = false;
+}
+
+unsigned int pipeview_fetch(unsigned int pc, unsigned int instr) {
+  unsigned long long cycle = stats[STAT_CYCLES];
+  if (cycle < first_cycle || cycle > last_cycle)
+    return 0;
+  advance(cycle);
+  unsigned int id = next_id++;
+  reserve();
+  put_str("I\t");
+  put_uint(id);
+  put_char('\t');
+  put_uint(id);
+  put_str("\t0\nL\t");
+  put_uint(id);
+  put_str("\t0\t");
+  put_hex(pc);
+  put_str(": ");
+  put_hex(instr);
+  put_char('\n');
+  pipeview_event(id + 1, "F");
+  return id + 1;
+}
+
+void pipeview_event(unsigned int view, const char *stage) {
+  advance(stats[STAT_CYCLES]);
+  reserve();
+  put_str("S\t");
+  put_uint(view - 1);
+  put_str("\t0\t");
+  put_str(stage);
+  put_char('\n');
+}
+
+void pipeview_end(unsigned int view, bool flushed) {
+  advance(stats[STAT_CYCLES]);
+  if (flushed)
+    put_retire(view - 1, 0, true);
+  else
+    retiring[num_retiring++] = view - 1;
+}
@@ -0,0 +1,45 @@
+#ifndef PIPEVIEW_H
+#define PIPEVIEW_H
+
+// Pipeline viewer log of the pipeline model, in the Kanata format read by
+// the Konata viewer. Every instruction fetched in the cycle range gets a
+// log id; the pipeline registers carry it (plus one, so 0 means "not
+// logged") and each stage reports the instruction entering it:
+//   F  fetched into IF/ID          X  executing (or waiting for MEM)
+//   Ds waiting in IF/ID            M  in MEM
+//   D  decoded into ID/EX          W  written back, retiring next cycle
+// Flushed instructions end with a flush record instead of a retire.
+
+#define PIPEVIEW_BUF_SIZE (1 << 20)
+
+extern bool pipeview_enabled;
+
+// Starts the log in file_name for the instructions fetched in cycles
+// first..last; exits if the file cannot be written
+void pipeview_open(const char *file_name, unsigned long long first, unsigned long long last);
+
+// Writes out the rest of the log and closes it
+void pipeview_close();
+
+// Logs the fetch of instr at pc in the current cycle. Returns the view
+// id to carry with it, 0 outside the cycle range.
+unsigned int pipeview_fetch(unsigned int pc, unsigned int instr);
+
+void pipeview_event(unsigned int view, const char *stage);
+void pipeview_end(unsigned int view, bool flushed);
+
+// The instruction with view id view enters stage
+inline void pipeview_stage(unsigned int view, const char *stage) {
+  if (view) pipeview_event(view, stage);
+}
+
+// The instruction leaves the pipeline at write-back
+inline void pipeview_retire(unsigned int view) {
+  if (view) pipeview_end(view, false);
+}
+
+inline void pipeview_flush(unsigned int view) {
+  if (view) pipeview_end(view, true);
+}
+
+#endif
@@ -0,0 +1,233 @@
+/* profiler.cpp
+   Execution profiler: counts executions per PC and, at exit, reports the
+   hottest instructions, basic blocks and labels plus the instruction mix.
+*/
+
+#include "profiler.h"
+#include "rvc.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#define MAX_SYMBOLS 256
+#define REPORT_TOP 10
+
+int prof_enabled = 0;
+unsigned long long prof_pc_count[PROF_SLOTS];
+
+struct Symbol {
+  unsigned int addr;
+  char name[64];
+};
+
+static Symbol symbols[MAX_SYMBOLS];
+static int num_symbols = 0;
+
+// A row of one of the hot-spot tables
+struct ProfEntry {
+  unsigned int start;         // First PC of the entry
+  unsigned int last;          // PC of the last instruction of the entry
+  unsigned long long entries; // Executions of the first instruction
+  unsigned long long count;   // Instructions executed inside the entry
+};
+
+static bool by_count(const ProfEntry &a, const ProfEntry &b) {
+  return a.count > b.count;
+}
+
+static bool by_addr(const Symbol &a, const Symbol &b) {
+  return a.addr < b.addr;
+}
+
+void profiler_reset() {
+  std::memset(prof_pc_count, 0, sizeof(prof_pc_count));
+}
+
+// Symbol files hold one "<address> <label>" pair per line, as written by
+// the assembler next to output.mc.
+void profiler_load_symbols(const char *file_name) {
+  FILE *fp = std::fopen(file_name, "r");
+  if (fp == nullptr) {
+    std::printf("Error opening symbol file %s\n", file_name);
+    std::exit(1);
+  }
+  char line[256];
+  num_symbols = 0;
+  while (std::fgets(line, sizeof(line), fp) != nullptr && num_symbols < MAX_SYMBOLS) {
+    Symbol &sym = symbols[num_symbols];
+    if (std::sscanf(line, " %x %63s", &sym.addr, sym.name) == 2)
+      num_symbols++;
+  }
+  std::fclose(fp);
+  std::sort(symbols, symbols + num_symbols, by_addr);
+}
+
+// Index of the last symbol at or below pc, or -1
+static int find_symbol(unsigned int pc) {
+  int found = -1;
+  for (int i = 0; i < num_symbols && symbols[i].addr <= pc; i++)
+    found = i;
+  return found;
+}
+
+static void print_location(unsigned int pc) {
+  int s = find_symbol(pc);
+  if (s < 0)
+    return;
+  if (symbols[s].addr == pc)
+    std::printf("  %s", symbols[s].name);
+  else
+    std::printf("  %s+%u", symbols[s].name, pc - symbols[s].addr);
+}
+
+// Instruction at pc, expanded if compressed, and its size in bytes
+static unsigned int instr_at(char *mem, unsigned int pc, unsigned int *len) {
+  return rvc_fetch(read_word(mem, pc), len);
+}
+
+// Instruction bits at pc as written in the program: 4 hex digits for a
+// compressed instruction, 8 otherwise
+static const char *format_instr(char *mem, unsigned int pc) {
+  static char buf[16];
+  unsigned int len, word = read_word(mem, pc);
+  instr_at(mem, pc, &len);
+  if (len == 2)
+    std::snprintf(buf, sizeof(buf), "0x%04X", word & 0xFFFF);
+  else
+    std::snprintf(buf, sizeof(buf), "0x%08X", word);
+  return buf;
+}
+
+// Walks the text segment one instruction at a time, marking the slot of
+// every instruction in start and the first instruction of every basic
+// block in leader: branch and jump targets, the instruction after any
+// control transfer, and any executed instruction whose predecessor never
+// ran (and vice versa).
+static void find_leaders(char *mem, unsigned int last_slot, bool *start, bool *leader) {
+  leader[0] = true;
+  unsigned int prev = 0, len;
+  for (unsigned int i = 0; i <= last_slot; i += len / 2) {
+    unsigned int pc = i << 1;
+    unsigned int instr = instr_at(mem, pc, &len);
+    unsigned int opcode = OPCODE(instr);
+    unsigned int target = TEXT_SIZE;
+    start[i] = true;
+    if (opcode == 0x63)
+      target = pc + imm_b(instr);
+    else if (opcode == 0x6F)
+      target = pc + imm_j(instr);
+    if (target < TEXT_SIZE)
+      leader[target >> 1] = true;
+    if ((opcode == 0x63 || opcode == 0x6F || opcode == 0x67) && i + len / 2 < PROF_SLOTS)
+      leader[i + len / 2] = true;
+    if (i > 0 && (prof_pc_count[i] != 0) != (prof_pc_count[prev] != 0))
+      leader[i] = true;
+    prev = i;
+  }
+}
+
+void profiler_report(char *mem) {
+  static ProfEntry rows[PROF_SLOTS];
+  static bool start[PROF_SLOTS];
+  static bool leader[PROF_SLOTS];
+  unsigned long long total = 0;
+  unsigned long long mix[NUM_INSTR_CLASSES] = {0};
+  unsigned int last_slot = 0;
+  int n = 0;
+
+  for (unsigned int i = 0; i < PROF_SLOTS; i++) {
+    if (prof_pc_count[i] == 0)
+      continue;
+    unsigned int len;
+    unsigned int instr = instr_at(mem, i << 1, &len);
+    total += prof_pc_count[i];
+    mix[instr_class(instr)] += prof_pc_count[i];
+    last_slot = i;
+    rows[n].start = i << 1;
+    rows[n].last = i << 1;
+    rows[n].entries = prof_pc_count[i];
+    rows[n].count = prof_pc_count[i];
+    n++;
+  }
+
+  std::printf("\n=== PROFILE ===\n");
+  std::printf("Instructions executed: %llu\n", total);
+  if (total == 0)
+    return;
+
+  std::printf("\nHot instructions:\n");
+  std::printf("  %-10s  %-10s  %12s  %6s\n", "PC", "Instr", "Count", "%");
+  std::sort(rows, rows + n, by_count);
+  for (int i = 0; i < n && i < REPORT_TOP; i++) {
+    std::printf("  0x%08X  %-10s  %12llu  %5.1f%%", rows[i].start,
+                format_instr(mem, rows[i].start), rows[i].count,
+                100.0 * rows[i].count / total);
+    print_location(rows[i].start);
+    std::printf("\n");
+  }
+
+  std::memset(start, 0, sizeof(start));
+  std::memset(leader, 0, sizeof(leader));
+  find_leaders(mem, last_slot, start, leader);
+  n = 0;
+  for (unsigned int i = 0; i <= last_slot; ) {
+    unsigned int j = i + 1;
+    while (j <= last_slot && !leader[j])
+      j++;
+    unsigned long long count = 0;
+    unsigned int last = i;
+    for (unsigned int k = i; k < j; k++) {
+      count += prof_pc_count[k];
+      if (start[k]) last = k;
+    }
+    if (count != 0) {
+      rows[n].start = i << 1;
+      rows[n].last = last << 1;
+      rows[n].entries = prof_pc_count[i];
+      rows[n].count = count;
+      n++;
+    }
+    i = j;
+  }
+  std::printf("\nHot basic blocks:\n");
+  std::printf("  %-23s  %10s  %12s  %6s\n", "Range", "Entries", "Instrs", "%");
+  std::sort(rows, rows + n, by_count);
+  for (int i = 0; i < n && i < REPORT_TOP; i++) {
+    std::printf("  0x%08X-0x%08X  %10llu  %12llu  %5.1f%%", rows[i].start,
+                rows[i].last, rows[i].entries, rows[i].count,
+                100.0 * rows[i].count / total);
+    print_location(rows[i].start);
+    std::printf("\n");
+  }
+
+  if (num_symbols > 0) {
+    n = 0;
+    for (int s = 0; s < num_symbols; s++) {
+      unsigned int end = (s + 1 < num_symbols) ? symbols[s + 1].addr : TEXT_SIZE;
+      unsigned long long count = 0;
+      for (unsigned int pc = symbols[s].addr; pc < end && pc < TEXT_SIZE; pc += 2)
+        count += prof_pc_count[pc >> 1];
+      if (count == 0)
+        continue;
+      rows[n].start = s;
+      rows[n].count = count;
+      n++;
+    }
+    std::printf("\nHot labels:\n");
+    std::printf("  %-20s  %12s  %6s\n", "Label", "Instrs", "%");
+    std::sort(rows, rows + n, by_count);
+    for (int i = 0; i < n && i < REPORT_TOP; i++) {
+      std::printf("  %-20s  %12llu  %5.1f%%\n", symbols[rows[i].start].name,
+                  rows[i].count, 100.0 * rows[i].count / total);
+    }
+  }
+
+  std::printf("\nInstruction mix:\n");
+  for (int c = 0; c < NUM_INSTR_CLASSES; c++) {
+    if (mix[c] == 0)
+      continue;
+    std::printf("  %-8s  %12llu  %5.1f%%\n", instr_class_name(c), mix[c],
+                100.0 * mix[c] / total);
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "myRISCVSim.h"
+
+// One counter per instruction slot of the text segment
+#define PROF_SLOTS (TEXT_SIZE >> 1)
+
+extern int prof_enabled;
+extern unsigned long long prof_pc_count[PROF_SLOTS];
+
+// Count one execution of the instruction at pc
+inline void profile_pc(unsigned int pc) {
+  if (pc < TEXT_SIZE) prof_pc_count[pc >> 1]++;
+}
+
+void profiler_reset();
+void profiler_load_symbols(const char *file_name);
+void profiler_report(char *mem);
+
+#endif
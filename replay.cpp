@@ -0,0 +1,639 @@
+/* replay.cpp
+   Trace-driven timing replay. A recorded trace (see trace.h) is read and
+   decompressed once, then a pool of host threads takes the configurations
+   one at a time and runs each through a private instance of the pipeline
+   timing model. Nothing is shared between the instances except the
+   read-only trace.
+
+   The model follows pipeline.cpp cycle for cycle: the same latches,
+   bundles, hazard and structural rules, 1-bit predictor, EX/MEM latencies
+   and idle cycle skipping, so with the pipeline's knobs it reports the
+   same counters as -pipeline. No values are computed: branch outcomes,
+   JALR targets and effective addresses come from the trace. Fetch follows
+   the predictor through the program text and leaves the trace after a
+   misprediction; those wrong-path instructions take issue slots and are
+   flushed as in the pipeline, and fetch rejoins the trace when the branch
+   resolves.
+*/
+
+#include "replay.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "syscall.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// One instruction in a latch of the model
+struct ReplaySlot {
+  bool valid;
+  bool last;                  // Where the trace ends; retiring it ends the run
+  bool taken;
+  unsigned int pc;
+  unsigned int instr;         // Expanded if compressed
+  unsigned int len;
+  unsigned int pred_pc;       // Next PC chosen by the predictor
+  unsigned int next_pc;       // Actual next PC; pc + len on the wrong path
+  unsigned int addr;
+};
+
+// Complete state of one model instance
+struct ReplayModel {
+  const ReplayConfig *cfg;
+  const Trace *trace;
+  size_t pos;                 // Trace entry of the next on-path fetch
+  bool on_trace;              // Fetch has not left the trace since the last flush
+  unsigned int fetch_pc;
+  bool fetch_halted;
+  bool exit_retired;
+  bool stalled;
+  unsigned int stalled_pc;
+  int ex_wait;
+  bool ex_started;
+  int mem_wait;
+  bool mem_started;
+  bool mem_held;
+  std::vector<unsigned char> PHT;
+  std::vector<unsigned int> BTB;
+  std::vector<unsigned int> tags;       // Line number + 1 per cache way, 0 when empty
+  std::vector<unsigned long long> used; // Last access of each way, for LRU
+  unsigned int cache_sets;
+  unsigned long long cache_accesses;
+  unsigned long long cache_misses;
+  unsigned long long stats[NUM_STATS];
+  ReplaySlot IF_ID[MAX_ISSUE_WIDTH];
+  ReplaySlot ID_EX[MAX_ISSUE_WIDTH];
+  ReplaySlot EX_MEM[MAX_ISSUE_WIDTH];
+  ReplaySlot MEM_WB[MAX_ISSUE_WIDTH];
+};
+
+// Counters of one finished configuration
+struct ReplayResult {
+  unsigned long long stats[NUM_STATS];
+  unsigned long long cache_accesses;
+  unsigned long long cache_misses;
+};
+
+static Trace trace;
+static ReplayConfig configs[MAX_REPLAY_CONFIGS];
+static ReplayResult results[MAX_REPLAY_CONFIGS];
+static int num_configs = 0;
+static std::atomic<int> next_config(0);
+
+static bool writes_rd(unsigned int opcode, unsigned int rd) {
+  if (rd == 0) return false;
+  return opcode == 0x33 || opcode == 0x13 || opcode == 0x03 || opcode == 0x37 ||
+         opcode == 0x17 || opcode == 0x6F || opcode == 0x67;
+}
+
+static bool uses_rs1(unsigned int opcode) {
+  return opcode == 0x33 || opcode == 0x13 || opcode == 0x03 ||
+         opcode == 0x23 || opcode == 0x63 || opcode == 0x67;
+}
+
+static bool uses_rs2(unsigned int opcode) {
+  return opcode == 0x33 || opcode == 0x23 || opcode == 0x63;
+}
+
+static bool is_div_rem(unsigned int instr) {
+  return OPCODE(instr) == 0x33 && FUNCT7(instr) == 0x01 && FUNCT3(instr) >= 0x4;
+}
+
+static void model_reset(ReplayModel *m, const ReplayConfig *cfg) {
+  m->cfg = cfg;
+  m->trace = &trace;
+  m->pos = 0;
+  m->on_trace = true;
+  m->fetch_pc = 0;
+  m->fetch_halted = m->exit_retired = m->stalled = false;
+  m->stalled_pc = 0;
+  m->ex_wait = m->mem_wait = 0;
+  m->ex_started = m->mem_started = m->mem_held = false;
+  m->PHT.assign(cfg->pred_entries, 0);
+  m->BTB.assign(cfg->pred_entries, 0);
+  m->cache_sets = cfg->cache_size ? cfg->cache_size / (cfg->cache_line * cfg->cache_ways) : 0;
+  m->tags.assign((size_t)m->cache_sets * cfg->cache_ways, 0);
+  m->used.assign(m->tags.size(), 0);
+  m->cache_accesses = m->cache_misses = 0;
+  std::memset(m->stats, 0, sizeof(m->stats));
+  std::memset(m->IF_ID, 0, sizeof(m->IF_ID));
+  std::memset(m->ID_EX, 0, sizeof(m->ID_EX));
+  std::memset(m->EX_MEM, 0, sizeof(m->EX_MEM));
+  std::memset(m->MEM_WB, 0, sizeof(m->MEM_WB));
+}
+
+// Looks addr up in the data cache, filling the line on a miss. Returns
+// true on a hit.
+static bool cache_access(ReplayModel *m, unsigned int addr) {
+  unsigned int line = addr / m->cfg->cache_line;
+  unsigned int ways = m->cfg->cache_ways;
+  unsigned int base = (line % m->cache_sets) * ways;
+  unsigned int victim = base;
+  m->cache_accesses++;
+  for (unsigned int w = base; w < base + ways; w++) {
+    if (m->tags[w] == line + 1) {
+      m->used[w] = m->cache_accesses;
+      return true;
+    }
+    if (m->used[w] < m->used[victim])
+      victim = w;
+  }
+  m->cache_misses++;
+  m->tags[victim] = line + 1;
+  m->used[victim] = m->cache_accesses;
+  return false;
+}
+
+static bool detect_data_hazard(const ReplayModel *m, unsigned int instr) {
+  unsigned int opcode = OPCODE(instr);
+  unsigned int rs1 = uses_rs1(opcode) ? RS1(instr) : 0;
+  unsigned int rs2 = uses_rs2(opcode) ? RS2(instr) : 0;
+
+  for (int i = 0; i < m->cfg->issue_width; i++) {
+    const ReplaySlot &ex = m->EX_MEM[i];
+    unsigned int rd = RD(ex.instr);
+    if (ex.valid && writes_rd(OPCODE(ex.instr), rd) &&
+        (!m->cfg->forwarding || OPCODE(ex.instr) == 0x03) && (rs1 == rd || rs2 == rd))
+      return true;
+
+    const ReplaySlot &wb = m->MEM_WB[i];
+    rd = RD(wb.instr);
+    if (!m->cfg->forwarding && wb.valid && writes_rd(OPCODE(wb.instr), rd) &&
+        (rs1 == rd || rs2 == rd))
+      return true;
+  }
+  return false;
+}
+
+static bool depends_on_bundle(const ReplayModel *m, unsigned int instr, int n) {
+  unsigned int opcode = OPCODE(instr);
+  unsigned int rs1 = uses_rs1(opcode) ? RS1(instr) : 0;
+  unsigned int rs2 = uses_rs2(opcode) ? RS2(instr) : 0;
+
+  for (int i = 0; i < n; i++) {
+    unsigned int older = m->IF_ID[i].instr;
+    unsigned int rd = RD(older);
+    if (writes_rd(OPCODE(older), rd) && (rs1 == rd || rs2 == rd))
+      return true;
+  }
+  return false;
+}
+
+static void fetch_stage(ReplayModel *m) {
+  const std::vector<TraceEntry> &entries = m->trace->entries;
+  int width = m->cfg->issue_width;
+  int slot = 0;
+  while (slot < width && m->IF_ID[slot].valid)
+    slot++;
+
+  for (; slot < width && !m->fetch_halted; slot++) {
+    ReplaySlot &f = m->IF_ID[slot];
+    f.valid = true;
+    f.pc = m->fetch_pc;
+    f.instr = trace_instr(m->trace, f.pc, &f.len);
+    f.last = false;
+    f.taken = false;
+    f.next_pc = f.pc + f.len;
+    f.addr = 0;
+    if (m->on_trace) {
+      if (m->pos < entries.size()) {
+        const TraceEntry &e = entries[m->pos++];
+        f.taken = e.taken;
+        f.addr = e.addr;
+        f.next_pc = (m->pos < entries.size()) ? entries[m->pos].pc : m->trace->end_pc;
+      } else {
+        f.last = true;
+      }
+    }
+
+    unsigned int opcode = OPCODE(f.instr);
+    if (opcode == 0x63 || opcode == 0x6F || opcode == 0x67) {
+      int index = (f.pc >> 1) % m->cfg->pred_entries;
+      m->stats[STAT_BP_LOOKUPS]++;
+      if (m->PHT[index]) {
+        m->stats[STAT_BP_TAKEN]++;
+        m->fetch_pc = m->BTB[index];
+      } else {
+        m->fetch_pc = f.pc + f.len;
+      }
+    } else {
+      m->fetch_pc = f.pc + f.len;
+    }
+    f.pred_pc = m->fetch_pc;
+
+    if (m->on_trace && !f.last && f.pred_pc != f.next_pc)
+      m->on_trace = false;
+    if (f.instr == 0xEF000011 || f.last)
+      m->fetch_halted = true;
+    if (f.pred_pc != f.pc + f.len)
+      break;
+  }
+}
+
+static bool ecall_in_flight(const ReplayModel *m) {
+  for (int i = 0; i < m->cfg->issue_width; i++) {
+    if ((m->ID_EX[i].valid && m->ID_EX[i].instr == ECALL_INSTR) ||
+        (m->EX_MEM[i].valid && m->EX_MEM[i].instr == ECALL_INSTR) ||
+        (m->MEM_WB[i].valid && m->MEM_WB[i].instr == ECALL_INSTR))
+      return true;
+  }
+  return false;
+}
+
+static int issue_count(ReplayModel *m) {
+  const ReplayConfig *cfg = m->cfg;
+  int n = 0;
+  int mem_ops = 0, muldiv_ops = 0;
+  bool data_stall = false;
+
+  for (; n < cfg->issue_width && m->IF_ID[n].valid; n++) {
+    unsigned int instr = m->IF_ID[n].instr;
+    if (n > 0 && m->IF_ID[n - 1].instr == ECALL_INSTR)
+      break;
+    if (n == 0 && ecall_in_flight(m)) {
+      m->stats[STAT_STALL_SYSCALL]++;
+      break;
+    }
+    if (detect_data_hazard(m, instr)) {
+      data_stall = true;
+      break;
+    }
+    if (depends_on_bundle(m, instr, n)) {
+      m->stats[STAT_ISSUE_INTRA_DEP]++;
+      break;
+    }
+    int cls = instr_class(instr);
+    if (cls == CLASS_LOAD || cls == CLASS_STORE) {
+      if (mem_ops == cfg->mem_ports) {
+        m->stats[STAT_ISSUE_STRUCTURAL]++;
+        break;
+      }
+      mem_ops++;
+    } else if (cls == CLASS_MULDIV) {
+      if (muldiv_ops == cfg->muldiv_units) {
+        m->stats[STAT_ISSUE_STRUCTURAL]++;
+        break;
+      }
+      muldiv_ops++;
+    }
+  }
+
+  if (data_stall && !(m->stalled && m->stalled_pc == m->IF_ID[n].pc))
+    m->stats[STAT_DATA_HAZARDS]++;
+  m->stalled = data_stall;
+  m->stalled_pc = data_stall ? m->IF_ID[n].pc : 0;
+  if (data_stall && n == 0)
+    m->stats[STAT_STALL_DATA]++;
+  return n;
+}
+
+static void decode_stage(ReplayModel *m, int n) {
+  int width = m->cfg->issue_width;
+  for (int i = 0; i < width; i++) {
+    if (i >= n) {
+      m->ID_EX[i].valid = false;
+      continue;
+    }
+    m->stats[STAT_ISSUE_SLOT + i]++;
+    m->ID_EX[i] = m->IF_ID[i];
+  }
+
+  int i = 0;
+  for (; n + i < width && m->IF_ID[n + i].valid; i++)
+    m->IF_ID[i] = m->IF_ID[n + i];
+  for (; i < width; i++)
+    m->IF_ID[i].valid = false;
+}
+
+static int ex_latency(const ReplayModel *m) {
+  for (int i = 0; i < m->cfg->issue_width; i++) {
+    if (m->ID_EX[i].valid && is_div_rem(m->ID_EX[i].instr))
+      return m->cfg->div_latency;
+  }
+  return 1;
+}
+
+// Cycles the bundle in EX/MEM needs in MEM: the longest of its accesses,
+// which go through the data cache in program order
+static int mem_latency(ReplayModel *m) {
+  int latency = 1;
+  for (int i = 0; i < m->cfg->issue_width; i++) {
+    const ReplaySlot &e = m->EX_MEM[i];
+    unsigned int opcode = OPCODE(e.instr);
+    if (!e.valid || (opcode != 0x03 && opcode != 0x23))
+      continue;
+    int l = m->cfg->mem_latency;
+    if (m->cache_sets && !cache_access(m, e.addr))
+      l += m->cfg->miss_latency;
+    if (l > latency)
+      latency = l;
+  }
+  return latency;
+}
+
+static void execute_stage(ReplayModel *m) {
+  int width = m->cfg->issue_width;
+  bool squash = false;
+
+  if (m->ID_EX[0].valid && !m->ex_started) {
+    m->ex_started = true;
+    m->ex_wait = ex_latency(m) - 1;
+  }
+  if (m->ex_wait > 0) {
+    m->ex_wait--;
+    m->stats[STAT_STALL_EXECUTE]++;
+    if (!m->mem_held) {
+      for (int i = 0; i < width; i++)
+        m->EX_MEM[i].valid = false;
+    }
+    return;
+  }
+  if (m->mem_held)
+    return;
+  m->ex_started = false;
+
+  for (int i = 0; i < width; i++) {
+    ReplaySlot &d = m->ID_EX[i];
+    ReplaySlot &e = m->EX_MEM[i];
+    if (!d.valid || squash) {
+      if (d.valid)
+        m->stats[STAT_FLUSHED_INSTRS]++;
+      d.valid = false;
+      e.valid = false;
+      continue;
+    }
+    e = d;
+    d.valid = false;
+
+    unsigned int opcode = OPCODE(d.instr);
+    if (opcode == 0x63 || opcode == 0x6F || opcode == 0x67) {
+      m->stats[STAT_CONTROL_HAZARDS]++;
+      if (d.next_pc != d.pred_pc) {
+        m->stats[STAT_BP_MISPREDICTS]++;
+        m->stats[STAT_FLUSHES]++;
+        m->stats[STAT_STALL_CONTROL] += width;
+        for (int j = 0; j < width; j++) {
+          if (m->IF_ID[j].valid)
+            m->stats[STAT_FLUSHED_INSTRS]++;
+          m->IF_ID[j].valid = false;
+        }
+        m->fetch_pc = d.next_pc;
+        m->fetch_halted = false;
+        m->on_trace = true;
+        squash = true;
+      }
+      int index = (d.pc >> 1) % m->cfg->pred_entries;
+      m->PHT[index] = d.taken;
+      m->BTB[index] = d.next_pc;
+    }
+  }
+}
+
+static void memory_stage(ReplayModel *m) {
+  int width = m->cfg->issue_width;
+  if (!m->mem_started) {
+    m->mem_started = true;
+    m->mem_wait = mem_latency(m) - 1;
+  }
+  m->mem_held = m->mem_wait > 0;
+  if (m->mem_held) {
+    m->mem_wait--;
+    m->stats[STAT_STALL_MEMORY]++;
+    for (int i = 0; i < width; i++)
+      m->MEM_WB[i].valid = false;
+    return;
+  }
+  m->mem_started = false;
+  for (int i = 0; i < width; i++)
+    m->MEM_WB[i] = m->EX_MEM[i];
+}
+
+static void write_back_stage(ReplayModel *m) {
+  for (int i = 0; i < m->cfg->issue_width; i++) {
+    ReplaySlot &w = m->MEM_WB[i];
+    if (!w.valid) continue;
+    w.valid = false;
+    if (w.last) {
+      m->exit_retired = true;
+      return;
+    }
+    m->stats[STAT_INSTRS]++;
+    m->stats[STAT_RETIRED_CLASS + instr_class(w.instr)]++;
+  }
+}
+
+static bool skip_idle_cycles(ReplayModel *m) {
+  if (m->ex_wait == 0 && m->mem_wait == 0)
+    return false;
+  for (int i = 0; i < m->cfg->issue_width; i++) {
+    if (m->MEM_WB[i].valid || (m->mem_wait == 0 && m->EX_MEM[i].valid))
+      return false;
+    if (!m->fetch_halted && !m->IF_ID[i].valid)
+      return false;
+  }
+  if (!m->ID_EX[0].valid || !m->ex_started)
+    return false;
+
+  int n;
+  if (m->ex_wait > 0 && m->mem_wait > 0)
+    n = (m->ex_wait < m->mem_wait) ? m->ex_wait : m->mem_wait;
+  else
+    n = (m->ex_wait > 0) ? m->ex_wait : m->mem_wait;
+  if (m->ex_wait > 0) {
+    m->ex_wait -= n;
+    m->stats[STAT_STALL_EXECUTE] += n;
+  }
+  if (m->mem_wait > 0) {
+    m->mem_wait -= n;
+    m->stats[STAT_STALL_MEMORY] += n;
+  }
+  m->stats[STAT_SKIPPED_CYCLES] += n;
+  m->stats[STAT_CYCLES] += n;
+  return true;
+}
+
+static void model_cycle(ReplayModel *m) {
+  if (m->cfg->cycle_skip && skip_idle_cycles(m))
+    return;
+  write_back_stage(m);
+  if (!m->exit_retired) {
+    memory_stage(m);
+    execute_stage(m);
+    if (!m->ID_EX[0].valid)
+      decode_stage(m, issue_count(m));
+    fetch_stage(m);
+  }
+  m->stats[STAT_CYCLES]++;
+}
+
+static void run_config(int c) {
+  ReplayModel m;
+  model_reset(&m, &configs[c]);
+  while (!m.exit_retired)
+    model_cycle(&m);
+  ReplayResult &r = results[c];
+  std::memcpy(r.stats, m.stats, sizeof(r.stats));
+  r.cache_accesses = m.cache_accesses;
+  r.cache_misses = m.cache_misses;
+}
+
+static void replay_worker() {
+  for (;;) {
+    int c = next_config++;
+    if (c >= num_configs) return;
+    run_config(c);
+  }
+}
+
+static bool is_power_of_two(int v) {
+  return v > 0 && (v & (v - 1)) == 0;
+}
+
+static bool config_valid(const ReplayConfig *c) {
+  if (c->issue_width < 1 || c->issue_width > MAX_ISSUE_WIDTH || c->mem_ports < 1 ||
+      c->muldiv_units < 1 || c->div_latency < 1 || c->mem_latency < 1 || c->pred_entries < 1)
+    return false;
+  if (c->cache_size == 0)
+    return true;
+  return c->cache_size > 0 && is_power_of_two(c->cache_line) && c->cache_ways >= 1 &&
+         c->cache_size % (c->cache_line * c->cache_ways) == 0 && c->miss_latency >= 0;
+}
+
+// The configuration the pipeline knobs describe
+static void knob_config(ReplayConfig *c) {
+  std::memset(c, 0, sizeof(*c));
+  std::strcpy(c->name, "default");
+  c->forwarding = KNOB_FORWARDING;
+  c->issue_width = KNOB_ISSUE_WIDTH;
+  c->mem_ports = KNOB_MEM_PORTS;
+  c->muldiv_units = KNOB_MULDIV_UNITS;
+  c->div_latency = KNOB_DIV_LATENCY;
+  c->mem_latency = KNOB_MEM_LATENCY;
+  c->cycle_skip = KNOB_CYCLE_SKIP;
+  c->pred_entries = REPLAY_PRED_SIZE;
+  c->cache_line = 32;
+  c->cache_ways = 1;
+  c->miss_latency = 10;
+}
+
+// Parses "<name> key=value ..." over the knob configuration
+static bool parse_config(char *line, ReplayConfig *c) {
+  char *tok = std::strtok(line, " \t\r\n");
+  knob_config(c);
+  if (tok == nullptr || std::strlen(tok) >= sizeof(c->name))
+    return false;
+  std::strcpy(c->name, tok);
+  while ((tok = std::strtok(nullptr, " \t\r\n")) != nullptr) {
+    char *eq = std::strchr(tok, '=');
+    char *end;
+    if (eq == nullptr)
+      return false;
+    *eq = '\0';
+    int v = (int)std::strtol(eq + 1, &end, 0);
+    if (end == eq + 1 || *end != '\0')
+      return false;
+    if (std::strcmp(tok, "forwarding") == 0) c->forwarding = (v != 0);
+    else if (std::strcmp(tok, "issue-width") == 0) c->issue_width = v;
+    else if (std::strcmp(tok, "mem-ports") == 0) c->mem_ports = v;
+    else if (std::strcmp(tok, "muldiv-units") == 0) c->muldiv_units = v;
+    else if (std::strcmp(tok, "div-latency") == 0) c->div_latency = v;
+    else if (std::strcmp(tok, "mem-latency") == 0) c->mem_latency = v;
+    else if (std::strcmp(tok, "cycle-skip") == 0) c->cycle_skip = (v != 0);
+    else if (std::strcmp(tok, "pred-entries") == 0) c->pred_entries = v;
+    else if (std::strcmp(tok, "cache-size") == 0) c->cache_size = v;
+    else if (std::strcmp(tok, "cache-line") == 0) c->cache_line = v;
+    else if (std::strcmp(tok, "cache-ways") == 0) c->cache_ways = v;
+    else if (std::strcmp(tok, "miss-latency") == 0) c->miss_latency = v;
+    else return false;
+  }
+  return config_valid(c);
+}
+
+static void load_configs(const char *config_file) {
+  FILE *fp = std::fopen(config_file, "r");
+  if (fp == nullptr) {
+    std::printf("Error opening configuration file %s\n", config_file);
+    std::exit(1);
+  }
+  char line[256];
+  int line_no = 0;
+  while (std::fgets(line, sizeof(line), fp) != nullptr) {
+    line_no++;
+    char *p = line + std::strspn(line, " \t\r\n");
+    if (*p == '\0' || *p == '#')
+      continue;
+    if (num_configs == MAX_REPLAY_CONFIGS) {
+      std::printf("More than %d configurations in %s\n", MAX_REPLAY_CONFIGS, config_file);
+      std::exit(1);
+    }
+    if (!parse_config(p, &configs[num_configs])) {
+      std::printf("Invalid configuration on line %d of %s\n", line_no, config_file);
+      std::exit(1);
+    }
+    num_configs++;
+  }
+  std::fclose(fp);
+}
+
+int run_replay(const char *trace_file, const char *config_file, int host_threads,
+               const char *stats_json) {
+  num_configs = 0;
+  if (config_file != nullptr) {
+    load_configs(config_file);
+  } else {
+    knob_config(&configs[0]);
+    num_configs = 1;
+  }
+  if (num_configs == 0) {
+    std::printf("No configurations in %s\n", config_file);
+    return 1;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  trace_read(trace_file, &trace);
+  std::chrono::steady_clock::time_point read = std::chrono::steady_clock::now();
+
+  if (host_threads <= 0) {
+    host_threads = (int)std::thread::hardware_concurrency();
+    if (host_threads <= 0) host_threads = 1;
+  }
+  int num_threads = (host_threads < num_configs) ? host_threads : num_configs;
+  next_config = 0;
+  std::vector<std::thread> workers;
+  for (int t = 1; t < num_threads; t++)
+    workers.emplace_back(replay_worker);
+  replay_worker();
+  for (size_t t = 0; t < workers.size(); t++)
+    workers[t].join();
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+  double read_ms = std::chrono::duration<double, std::milli>(read - start).count();
+  double run_ms = std::chrono::duration<double, std::milli>(end - read).count();
+  std::printf("=== REPLAY (%llu instructions, %d configurations, %d host threads) ===\n",
+              (unsigned long long)trace.entries.size(), num_configs, num_threads);
+  std::printf("Trace read in %.3f ms, configurations replayed in %.3f ms\n\n", read_ms, run_ms);
+  std::printf("%-16s %12s %7s %12s %12s %12s %12s %8s\n", "config", "cycles", "CPI",
+              "data stalls", "mispredicts", "flushed", "mem stalls", "d-miss");
+  for (int c = 0; c < num_configs; c++) {
+    const ReplayResult &r = results[c];
+    unsigned long long instrs = r.stats[STAT_INSTRS];
+    char miss[16] = "-";
+    if (configs[c].cache_size)
+      std::snprintf(miss, sizeof(miss), "%.2f%%",
+                    r.cache_accesses ? 100.0 * r.cache_misses / r.cache_accesses : 0.0);
+    std::printf("%-16s %12llu %7.3f %12llu %12llu %12llu %12llu %8s\n", configs[c].name,
+                r.stats[STAT_CYCLES], instrs ? (double)r.stats[STAT_CYCLES] / instrs : 0.0,
+                r.stats[STAT_STALL_DATA], r.stats[STAT_BP_MISPREDICTS],
+                r.stats[STAT_FLUSHED_INSTRS], r.stats[STAT_STALL_MEMORY], miss);
+  }
+  if (stats_json != nullptr) {
+    stats_reset(STATS_PIPELINE);
+    std::memcpy(stats, results[0].stats, sizeof(stats));
+    stats_write_json(stats_json);
+  }
+  return 0;
+}
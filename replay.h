@@ -0,0 +1,38 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "trace.h"
+
+#define MAX_REPLAY_CONFIGS 256
+#define REPLAY_PRED_SIZE   256     // Default predictor entries, as in the pipeline model
+
+// One configuration of the trace-driven pipeline model. The fields follow
+// the pipeline knobs, plus the predictor size and an optional data cache.
+struct ReplayConfig {
+  char name[32];
+  bool forwarding;
+  int issue_width;
+  int mem_ports;
+  int muldiv_units;
+  int div_latency;
+  int mem_latency;            // Cycles of a load/store in MEM, cache hit included
+  bool cycle_skip;            // Jump over idle cycles in bulk
+  int pred_entries;           // Entries of the 1-bit PHT and of the BTB
+  int cache_size;             // Bytes of data cache, 0 for none (every access hits)
+  int cache_line;
+  int cache_ways;
+  int miss_latency;           // Cycles a cache miss adds to MEM
+};
+
+// Replays trace_file through the configurations listed in config_file
+// (one per line, "<name> key=value ..."; keys are the option names of the
+// pipeline knobs (cycle-skip=0 for -no-cycle-skip) plus pred-entries, cache-size, cache-line, cache-ways and
+// miss-latency). Without a file, the single configuration is the one set
+// by the pipeline knobs. The configurations run on host_threads threads
+// (0 for one per core) and one results row is printed per configuration.
+// With stats_json, the counters of the first configuration are written
+// there in the format of -stats-json.
+int run_replay(const char *trace_file, const char *config_file, int host_threads,
+               const char *stats_json);
+
+#endif
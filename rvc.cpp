@@ -0,0 +1,158 @@
+/* rvc.cpp
+   RV32C expansion. The expansion of every possible 16-bit parcel is
+   computed once at startup into rvc_table, so decoding a compressed
+   instruction is a single table lookup.
+*/
+
+#include "rvc.h"
+
+unsigned int rvc_table[1 << 16];
+
+// Bits hi..lo of x, shifted down
+static unsigned int bits(unsigned int x, int hi, int lo) {
+  return (x >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+static int sign_extend(unsigned int x, int width) {
+  return (int)(x << (32 - width)) >> (32 - width);
+}
+
+static unsigned int enc_r(unsigned int funct7, unsigned int rs2, unsigned int rs1,
+                          unsigned int funct3, unsigned int rd, unsigned int opcode) {
+  return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+static unsigned int enc_i(int imm, unsigned int rs1, unsigned int funct3, unsigned int rd,
+                          unsigned int opcode) {
+  return ((unsigned int)imm & 0xFFF) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+static unsigned int enc_s(int imm, unsigned int rs2, unsigned int rs1, unsigned int funct3) {
+  unsigned int u = (unsigned int)imm;
+  return bits(u, 11, 5) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | bits(u, 4, 0) << 7 | 0x23;
+}
+
+static unsigned int enc_b(int imm, unsigned int rs2, unsigned int rs1, unsigned int funct3) {
+  unsigned int u = (unsigned int)imm;
+  return bits(u, 12, 12) << 31 | bits(u, 10, 5) << 25 | rs2 << 20 | rs1 << 15 |
+         funct3 << 12 | bits(u, 4, 1) << 8 | bits(u, 11, 11) << 7 | 0x63;
+}
+
+static unsigned int enc_j(int imm, unsigned int rd) {
+  unsigned int u = (unsigned int)imm;
+  return bits(u, 20, 20) << 31 | bits(u, 10, 1) << 21 | bits(u, 11, 11) << 20 |
+         bits(u, 19, 12) << 12 | rd << 7 | 0x6F;
+}
+
+// Offset of C.J / C.JAL
+static int cj_offset(unsigned int h) {
+  unsigned int off = bits(h, 12, 12) << 11 | bits(h, 11, 11) << 4 | bits(h, 10, 9) << 8 |
+                     bits(h, 8, 8) << 10 | bits(h, 7, 7) << 6 | bits(h, 6, 6) << 7 |
+                     bits(h, 5, 3) << 1 | bits(h, 2, 2) << 5;
+  return sign_extend(off, 12);
+}
+
+// Offset of C.BEQZ / C.BNEZ
+static int cb_offset(unsigned int h) {
+  unsigned int off = bits(h, 12, 12) << 8 | bits(h, 11, 10) << 3 | bits(h, 6, 5) << 6 |
+                     bits(h, 4, 3) << 1 | bits(h, 2, 2) << 5;
+  return sign_extend(off, 9);
+}
+
+static unsigned int expand(unsigned int h) {
+  unsigned int funct3 = bits(h, 15, 13);
+  unsigned int rd = bits(h, 11, 7);           // Also rs1 of the full-register forms
+  unsigned int rs2 = bits(h, 6, 2);
+  unsigned int rd_p = bits(h, 4, 2) + 8;      // rd' / rs2' of the x8-x15 forms
+  unsigned int rs1_p = bits(h, 9, 7) + 8;     // rs1' / rd'
+  int imm6 = sign_extend(bits(h, 12, 12) << 5 | bits(h, 6, 2), 6);
+
+  if (h == 0)
+    return 0;
+
+  switch (bits(h, 1, 0)) {
+    case 0:
+      switch (funct3) {
+        case 0: {  // C.ADDI4SPN
+          unsigned int imm = bits(h, 12, 11) << 4 | bits(h, 10, 7) << 6 |
+                             bits(h, 6, 6) << 2 | bits(h, 5, 5) << 3;
+          return imm ? enc_i(imm, 2, 0, rd_p, 0x13) : 0;
+        }
+        case 2: case 6: {  // C.LW, C.SW
+          unsigned int imm = bits(h, 12, 10) << 3 | bits(h, 6, 6) << 2 | bits(h, 5, 5) << 6;
+          return (funct3 == 2) ? enc_i(imm, rs1_p, 2, rd_p, 0x03) : enc_s(imm, rd_p, rs1_p, 2);
+        }
+      }
+      return 0;
+
+    case 1:
+      switch (funct3) {
+        case 0: return enc_i(imm6, rd, 0, rd, 0x13);                 // C.ADDI, C.NOP
+        case 1: return enc_j(cj_offset(h), 1);                       // C.JAL
+        case 2: return enc_i(imm6, 0, 0, rd, 0x13);                  // C.LI
+        case 3:
+          if (rd == 2) {                                             // C.ADDI16SP
+            unsigned int imm = bits(h, 12, 12) << 9 | bits(h, 6, 6) << 4 | bits(h, 5, 5) << 6 |
+                               bits(h, 4, 3) << 7 | bits(h, 2, 2) << 5;
+            return imm ? enc_i(sign_extend(imm, 10), 2, 0, 2, 0x13) : 0;
+          }
+          if (imm6 == 0) return 0;                                   // C.LUI
+          return ((unsigned int)imm6 & 0xFFFFF) << 12 | rd << 7 | 0x37;
+        case 4: {
+          unsigned int shamt = bits(h, 6, 2);
+          switch (bits(h, 11, 10)) {
+            case 0:                                                  // C.SRLI
+              return bits(h, 12, 12) ? 0 : enc_r(0x00, shamt, rs1_p, 5, rs1_p, 0x13);
+            case 1:                                                  // C.SRAI
+              return bits(h, 12, 12) ? 0 : enc_r(0x20, shamt, rs1_p, 5, rs1_p, 0x13);
+            case 2:                                                  // C.ANDI
+              return enc_i(imm6, rs1_p, 7, rs1_p, 0x13);
+          }
+          if (bits(h, 12, 12))
+            return 0;                                                // C.SUBW/C.ADDW (RV64)
+          switch (bits(h, 6, 5)) {
+            case 0: return enc_r(0x20, rd_p, rs1_p, 0, rs1_p, 0x33); // C.SUB
+            case 1: return enc_r(0x00, rd_p, rs1_p, 4, rs1_p, 0x33); // C.XOR
+            case 2: return enc_r(0x00, rd_p, rs1_p, 6, rs1_p, 0x33); // C.OR
+            default: return enc_r(0x00, rd_p, rs1_p, 7, rs1_p, 0x33); // C.AND
+          }
+        }
+        case 5: return enc_j(cj_offset(h), 0);                       // C.J
+        case 6: return enc_b(cb_offset(h), 0, rs1_p, 0);             // C.BEQZ
+        default: return enc_b(cb_offset(h), 0, rs1_p, 1);            // C.BNEZ
+      }
+
+    case 2:
+      switch (funct3) {
+        case 0:                                                      // C.SLLI
+          return bits(h, 12, 12) ? 0 : enc_r(0x00, rs2, rd, 1, rd, 0x13);
+        case 2: {                                                    // C.LWSP
+          unsigned int imm = bits(h, 12, 12) << 5 | bits(h, 6, 4) << 2 | bits(h, 3, 2) << 6;
+          return rd ? enc_i(imm, 2, 2, rd, 0x03) : 0;
+        }
+        case 4:
+          if (!bits(h, 12, 12)) {
+            if (rs2 == 0)                                            // C.JR
+              return rd ? enc_i(0, rd, 0, 0, 0x67) : 0;
+            return enc_r(0x00, rs2, 0, 0, rd, 0x33);                 // C.MV
+          }
+          if (rs2 == 0)                                              // C.EBREAK, C.JALR
+            return rd ? enc_i(0, rd, 0, 1, 0x67) : 0x00100073;
+          return enc_r(0x00, rs2, rd, 0, rd, 0x33);                  // C.ADD
+        case 6: {                                                    // C.SWSP
+          unsigned int imm = bits(h, 12, 9) << 2 | bits(h, 8, 7) << 6;
+          return enc_s(imm, rs2, 2, 2);
+        }
+      }
+      return 0;
+  }
+  return 0;  // A 32-bit instruction, not a compressed one
+}
+
+static bool build_rvc_table() {
+  for (unsigned int h = 0; h < (1u << 16); h++)
+    rvc_table[h] = expand(h);
+  return true;
+}
+
+static const bool rvc_table_built = build_rvc_table();
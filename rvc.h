@@ -0,0 +1,34 @@
+#ifndef RVC_H
+#define RVC_H
+
+// RV32C compressed instructions. Every 16-bit parcel whose low two bits
+// are not 11 is a compressed instruction; it is executed as the 32-bit
+// instruction it expands to.
+
+extern unsigned int rvc_table[1 << 16];
+
+inline bool rvc_is_compressed(unsigned int parcel) {
+  return (parcel & 3) != 3;
+}
+
+// 32-bit equivalent of the compressed instruction half, or 0 (an illegal
+// instruction) if it is reserved or not part of RV32C without floating
+// point
+inline unsigned int rvc_expand(unsigned int half) {
+  return rvc_table[half & 0xFFFF];
+}
+
+// Instruction at the start of parcel (the 32 bits at its address),
+// expanded if compressed; *len receives its size in bytes. The exit word
+// 0xEF000011 is not a real instruction and its low bits would otherwise
+// mark it compressed, so it is always taken whole.
+inline unsigned int rvc_fetch(unsigned int parcel, unsigned int *len) {
+  if (rvc_is_compressed(parcel) && parcel != 0xEF000011) {
+    *len = 2;
+    return rvc_expand(parcel);
+  }
+  *len = 4;
+  return parcel;
+}
+
+#endif
@@ -0,0 +1,420 @@
+/* serve.cpp
+   Resident simulator service (see serve.h).
+
+   Every worker thread owns one preallocated FastSim and serves one
+   connection at a time; a connection can send any number of requests, and
+   may send the next before reading the reply to the last. Between programs
+   an instance is recycled rather than reset: memory and registers are
+   cleared, and only the text slots the last program used are decoded
+   again. System calls go one at a time through the shared syscall layer,
+   with the program's break, exit status and captured output switched in
+   around each.
+
+   Request: a run line, then the program in .mc format (lines that do not
+   parse are ignored, as in a file), then an end line. max-instrs above
+   the service's limit, or 0, runs to the limit.
+     run [max-instrs=<n>] [mem=<addr>[:<words>]]...
+     <address> <word>
+     end
+   Reply, numbers in hex except the counts:
+     status exit|fault|limit <exit code>
+     pc <pc>
+     instrs <n>
+     time-us <n>              host time of the run
+     regs <x0> ... <x31>
+     mem <addr> <word>...     one line per mem= item
+     output <n>               then the n bytes written to stdout and
+                              stderr, and a newline
+     end
+   A bad request gets "error <message>" and "end" instead. "shutdown" stops
+   the service from accepting connections; it exits when the open ones
+   have closed.
+*/
+
+#include "serve.h"
+#include "fastsim.h"
+#include "syscall.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define READ_CHUNK (1 << 16)
+
+struct MemRange {
+  unsigned int addr;
+  unsigned int words;
+};
+
+// Buffered reader over a socket
+struct LineReader {
+  int fd;
+  std::string buf;
+  size_t pos;                 // Start of the unread part of buf
+};
+
+static FastSim instances[SERVE_MAX_INSTANCES];
+static std::mutex syscall_lock;     // The syscall layer is shared by the workers
+static int listen_fd = -1;
+static unsigned long long instr_limit;   // Most instructions of any run
+static std::atomic<unsigned long long> programs_run;
+
+// Appends more of the stream to r->buf; false at its end or on an error
+static bool fill(LineReader *r) {
+  if (r->pos == r->buf.size()) {
+    r->buf.clear();
+    r->pos = 0;
+  } else if (r->pos >= READ_CHUNK) {
+    r->buf.erase(0, r->pos);
+    r->pos = 0;
+  }
+  char chunk[READ_CHUNK];
+  ssize_t n;
+  do {
+    n = read(r->fd, chunk, sizeof(chunk));
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0)
+    return false;
+  r->buf.append(chunk, (size_t)n);
+  return true;
+}
+
+// Reads the next line, without its line ending, into *line. False at the
+// end of the stream or if the line is longer than max_len.
+static bool read_line(LineReader *r, std::string *line, size_t max_len) {
+  for (;;) {
+    size_t nl = r->buf.find('\n', r->pos);
+    if (nl != std::string::npos) {
+      line->assign(r->buf, r->pos, nl - r->pos);
+      r->pos = nl + 1;
+      if (!line->empty() && (*line)[line->size() - 1] == '\r')
+        line->erase(line->size() - 1);
+      return true;
+    }
+    if (r->buf.size() - r->pos > max_len || !fill(r))
+      return false;
+  }
+}
+
+static bool read_bytes(LineReader *r, size_t n, std::string *out) {
+  while (r->buf.size() - r->pos < n) {
+    if (!fill(r))
+      return false;
+  }
+  out->append(r->buf, r->pos, n);
+  r->pos += n;
+  return true;
+}
+
+static bool send_all(int fd, const std::string &s) {
+  size_t off = 0;
+  while (off < s.size()) {
+    ssize_t n = send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    off += (size_t)n;
+  }
+  return true;
+}
+
+static void append_format(std::string *s, const char *format, unsigned long long v) {
+  char text[32];
+  std::snprintf(text, sizeof(text), format, v);
+  *s += text;
+}
+
+// Parses the options of a run line; returns an error message, empty if
+// there is none
+static std::string parse_run(const std::string &line, unsigned long long *max_instrs,
+                             MemRange *ranges, int *num_ranges) {
+  std::vector<char> copy(line.begin(), line.end());
+  copy.push_back('\0');
+  char *save;
+  char *tok = strtok_r(&copy[0], " \t", &save);    // "run"
+  while ((tok = strtok_r(nullptr, " \t", &save)) != nullptr) {
+    char *end;
+    if (std::strncmp(tok, "max-instrs=", 11) == 0) {
+      *max_instrs = std::strtoull(tok + 11, &end, 0);
+      if (*end != '\0' || end == tok + 11) return std::string("bad item ") + tok;
+    } else if (std::strncmp(tok, "mem=", 4) == 0) {
+      if (*num_ranges == SERVE_MAX_RANGES) return "too many mem items";
+      MemRange &m = ranges[(*num_ranges)++];
+      m.addr = (unsigned int)std::strtoul(tok + 4, &end, 0);
+      m.words = 1;
+      if (end != tok + 4 && *end == ':')
+        m.words = (unsigned int)std::strtoul(end + 1, &end, 0);
+      if (*end != '\0' || end == tok + 4 || m.words == 0 || m.words > MEM_SIZE / 4 ||
+          mem_index(m.addr, 4) < 0 || mem_index(m.addr + (m.words - 1) * 4, 4) < 0)
+        return std::string("bad item ") + tok;
+    } else {
+      return std::string("unknown item ") + tok;
+    }
+  }
+  return std::string();
+}
+
+// Reads the program of a run request into s and runs it, leaving the
+// reply in *reply. Returns false if the stream ended inside the request.
+static bool run_request(FastSim *s, LineReader *r, const std::string &run_line,
+                        std::string *reply, std::string *output) {
+  unsigned long long max_instrs = instr_limit;
+  MemRange ranges[SERVE_MAX_RANGES];
+  int num_ranges = 0;
+  std::string error = parse_run(run_line, &max_instrs, ranges, &num_ranges);
+  if (max_instrs == 0 || max_instrs > instr_limit)
+    max_instrs = instr_limit;
+
+  // The program is read up to its end line even after an error, to stay
+  // in step with the client
+  fast_recycle(s);
+  unsigned int data_end = DATA_OFFSET;
+  size_t bytes = 0;
+  std::string line;
+  for (;;) {
+    if (!read_line(r, &line, SERVE_MAX_REQUEST))
+      return false;
+    if (line == "end")
+      break;
+    bytes += line.size() + 1;
+    if (!error.empty())
+      continue;
+    unsigned int address, word;
+    if (bytes > SERVE_MAX_REQUEST) {
+      error = "request too large";
+    } else if (parse_mc_line(line.c_str(), &address, &word)) {
+      int idx = mem_index(address, 4);
+      if (idx < 0) {
+        error = "address out of range: " + line;
+        continue;
+      }
+      std::memcpy(s->MEM + idx, &word, 4);
+      if (address >= DATA_OFFSET && address + 4 > data_end) data_end = address + 4;
+    }
+  }
+  if (!error.empty()) {
+    *reply = "error " + error + "\nend\n";
+    return true;
+  }
+  fast_predecode_text(s);
+
+  // Same initial break as syscall_reset()
+  SyscallContext ctx;
+  ctx.brk_start = ctx.brk_current = (data_end + 7) & ~7u;
+  ctx.exit_code = 0;
+  ctx.output = output;
+  output->clear();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (!s->halted) {
+    fast_run(s, max_instrs);
+    if (!s->serial_pending)
+      break;
+    std::lock_guard<std::mutex> guard(syscall_lock);
+    syscall_restore(&ctx);
+    fast_ecall(s, s->MEM);
+    syscall_save(&ctx);
+  }
+  unsigned long long us = (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  programs_run++;
+
+  const char *status = s->fault ? "fault" : s->halted ? "exit" : "limit";
+  char text[64];
+  std::snprintf(text, sizeof(text), "status %s %d\n", status, ctx.exit_code);
+  *reply = text;
+  append_format(reply, "pc 0x%08llX\n", s->PC);
+  append_format(reply, "instrs %llu\n", s->instret);
+  append_format(reply, "time-us %llu\n", us);
+  *reply += "regs";
+  for (int i = 0; i < 32; i++)
+    append_format(reply, " 0x%llX", s->R[i]);
+  *reply += "\n";
+  for (int i = 0; i < num_ranges; i++) {
+    append_format(reply, "mem 0x%08llX", ranges[i].addr);
+    for (unsigned int w = 0; w < ranges[i].words; w++) {
+      unsigned int word;
+      std::memcpy(&word, s->MEM + mem_index(ranges[i].addr + w * 4, 4), 4);
+      append_format(reply, " 0x%llX", word);
+    }
+    *reply += "\n";
+  }
+  append_format(reply, "output %llu\n", output->size());
+  *reply += *output;
+  *reply += "\nend\n";
+  return true;
+}
+
+static void serve_connection(FastSim *s, int fd) {
+  LineReader r;
+  r.fd = fd;
+  r.pos = 0;
+  std::string line, reply, output;
+  while (read_line(&r, &line, SERVE_MAX_REQUEST)) {
+    if (line.empty())
+      continue;
+    if (line.compare(0, 3, "run") == 0 && (line.size() == 3 || line[3] == ' ' || line[3] == '\t')) {
+      if (!run_request(s, &r, line, &reply, &output))
+        return;
+    } else if (line == "shutdown") {
+      shutdown(listen_fd, SHUT_RDWR);
+      reply = "end\n";
+    } else {
+      reply = "error unknown request\nend\n";
+    }
+    if (!send_all(fd, reply))
+      return;
+  }
+}
+
+static void worker(FastSim *s) {
+  for (;;) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      return;     // The listening socket was shut down
+    }
+    serve_connection(s, fd);
+    close(fd);
+  }
+}
+
+static bool socket_address(const char *socket_path, sockaddr_un *addr) {
+  std::memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (std::strlen(socket_path) >= sizeof(addr->sun_path)) {
+    std::printf("Socket path too long: %s\n", socket_path);
+    return false;
+  }
+  std::strcpy(addr->sun_path, socket_path);
+  return true;
+}
+
+int run_serve(const char *socket_path, int num_instances, unsigned long long max_instrs) {
+  sockaddr_un addr;
+  if (!socket_address(socket_path, &addr))
+    return 1;
+  if (num_instances <= 0) {
+    num_instances = (int)std::thread::hardware_concurrency();
+    if (num_instances <= 0) num_instances = 1;
+  }
+  if (num_instances > SERVE_MAX_INSTANCES)
+    num_instances = SERVE_MAX_INSTANCES;
+
+  // Only a socket left by an earlier run is replaced
+  struct stat st;
+  if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(socket_path);
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0 || bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listen_fd, 128) < 0) {
+    std::printf("Error listening on %s: %s\n", socket_path, std::strerror(errno));
+    return 1;
+  }
+
+  instr_limit = max_instrs ? max_instrs : SERVE_MAX_INSTRS;
+  programs_run = 0;
+  std::printf("Serving on %s with %d instances, at most %llu instructions per run\n",
+              socket_path, num_instances, instr_limit);
+  std::fflush(stdout);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < num_instances; i++) {
+    FastSim *s = &instances[i];
+    fast_reset(s);
+    fast_predecode(s);
+    s->serial_ecalls = true;
+    workers.emplace_back(worker, s);
+  }
+  for (size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+  close(listen_fd);
+  unlink(socket_path);
+  std::printf("Ran %llu programs\n", programs_run.load());
+  return 0;
+}
+
+int run_submit(const char *socket_path, const char *file_name, const char *mem,
+               unsigned long long max_instrs) {
+  sockaddr_un addr;
+  if (!socket_address(socket_path, &addr))
+    return 1;
+  FILE *fp = std::fopen(file_name, "r");
+  if (fp == nullptr) {
+    std::printf("Error opening input mem file\n");
+    std::exit(1);
+  }
+  std::string request = "run";
+  if (max_instrs)
+    append_format(&request, " max-instrs=%llu", max_instrs);
+  if (mem != nullptr) {
+    std::string items(mem);
+    size_t start = 0;
+    while (start <= items.size()) {
+      size_t comma = items.find(',', start);
+      if (comma == std::string::npos) comma = items.size();
+      request += " mem=" + items.substr(start, comma - start);
+      start = comma + 1;
+    }
+  }
+  request += "\n";
+  char line[256];
+  while (std::fgets(line, sizeof(line), fp) != nullptr) {
+    request += line;
+    if (request[request.size() - 1] != '\n') request += "\n";
+  }
+  std::fclose(fp);
+  request += "end\n";
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    std::printf("Error connecting to %s: %s\n", socket_path, std::strerror(errno));
+    return 1;
+  }
+  if (!send_all(fd, request)) {
+    std::printf("Error sending to %s\n", socket_path);
+    close(fd);
+    return 1;
+  }
+
+  LineReader r;
+  r.fd = fd;
+  r.pos = 0;
+  std::string reply;
+  int rc = 1;
+  bool complete = false;
+  while (read_line(&r, &reply, SERVE_MAX_REQUEST)) {
+    std::printf("%s\n", reply.c_str());
+    unsigned long long n;
+    int code;
+    char status[16];
+    if (std::sscanf(reply.c_str(), "status %15s %d", status, &code) == 2) {
+      rc = std::strcmp(status, "fault") == 0 ? 1 : code;
+    } else if (std::sscanf(reply.c_str(), "output %llu", &n) == 1) {
+      std::string out;
+      if (!read_bytes(&r, (size_t)n + 1, &out)) break;
+      std::fwrite(out.data(), 1, out.size(), stdout);
+    } else if (reply == "end") {
+      complete = true;
+      break;
+    } else if (reply.compare(0, 6, "error ") == 0) {
+      rc = 1;
+    }
+  }
+  close(fd);
+  if (!complete) {
+    std::printf("Incomplete reply from %s\n", socket_path);
+    return 1;
+  }
+  return rc;
+}
@@ -0,0 +1,28 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+// Resident simulator service. A daemon listens on a Unix socket and runs
+// the programs it is sent on a pool of preallocated fast-interpreter
+// instances, so a harness running many short programs pays neither
+// process startup nor a full reset per program. See serve.cpp for the
+// protocol.
+
+#define SERVE_MAX_INSTANCES 64
+#define SERVE_MAX_RANGES    16      // mem= items of one request
+#define SERVE_MAX_REQUEST   (1 << 20)  // Bytes of one request
+#define SERVE_MAX_INSTRS    100000000ULL  // Run limit without -max-instrs
+
+// Serves requests on socket_path with one instance (and host thread) per
+// connection being served, up to instances at a time (0 for one per
+// core). No run goes past max_instrs (SERVE_MAX_INSTRS if 0), so a
+// program that never exits cannot hold an instance; requests may set a
+// lower limit. Returns when a client sends "shutdown".
+int run_serve(const char *socket_path, int instances, unsigned long long max_instrs);
+
+// Sends file_name to the service on socket_path and prints the reply.
+// mem lists the words to return as <addr>[:<words>],... (may be null).
+// Returns the exit status of the program, or 1 if it faulted.
+int run_submit(const char *socket_path, const char *file_name, const char *mem,
+               unsigned long long max_instrs);
+
+#endif
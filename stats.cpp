@@ -0,0 +1,171 @@
+/* stats.cpp
+   Counter registry shared by the timing models, with a readable summary,
+   JSON/CSV dumps and periodic interval rows for plotting CPI phases.
+*/
+
+#include "stats.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+unsigned long long stats[NUM_STATS];
+unsigned long long stats_next_interval = 0;
+
+struct StatInfo {
+  const char *name;
+  int models;               // StatModel bits of the models that keep it
+};
+
+static const int BOTH = STATS_PIPELINE | STATS_OOO;
+
+static const StatInfo stat_info[] = {
+  {"cycles",              BOTH},
+  {"instructions",        BOTH},
+  {"retired.alu",         BOTH},
+  {"retired.alu_imm",     BOTH},
+  {"retired.muldiv",      BOTH},
+  {"retired.load",        BOTH},
+  {"retired.store",       BOTH},
+  {"retired.branch",      BOTH},
+  {"retired.jump",        BOTH},
+  {"retired.upper",       BOTH},
+  {"retired.atomic",      BOTH},
+  {"retired.other",       BOTH},
+  {"stall.data",          STATS_PIPELINE},
+  {"stall.control",       BOTH},
+  {"hazard.data",         STATS_PIPELINE},
+  {"hazard.control",      BOTH},
+  {"flush.count",         BOTH},
+  {"flush.instrs",        STATS_PIPELINE},
+  {"bp.lookups",          BOTH},
+  {"bp.taken",            BOTH},
+  {"bp.mispredicts",      BOTH},
+  {"issue.slot0",         STATS_PIPELINE},
+  {"issue.slot1",         STATS_PIPELINE},
+  {"issue.slot2",         STATS_PIPELINE},
+  {"issue.slot3",         STATS_PIPELINE},
+  {"issue.intra_dep",     STATS_PIPELINE},
+  {"issue.structural",    STATS_PIPELINE},
+  {"stall.execute",       STATS_PIPELINE},
+  {"stall.memory",        STATS_PIPELINE},
+  {"stall.syscall",       STATS_PIPELINE},
+  {"cycles.skipped",      STATS_PIPELINE},
+  {"ooo.rob_occupancy",   STATS_OOO},
+  {"stall.rob_full",      STATS_OOO},
+  {"stall.iq_full",       STATS_OOO},
+  {"stall.lsq_full",      STATS_OOO},
+  {"stall.frontend",      STATS_OOO},
+  {"ooo.load_forwards",   STATS_OOO}
+};
+
+static_assert(sizeof(stat_info) / sizeof(stat_info[0]) == NUM_STATS,
+              "every counter needs a name");
+
+// Interval dump state
+static FILE *interval_fp = nullptr;
+static unsigned long long interval_len = 0;
+static unsigned long long interval_prev[NUM_STATS];
+static unsigned long long interval_rows = 0;
+
+// Model whose counters are reported
+static int active_model = STATS_PIPELINE;
+
+static bool stat_active(int id) {
+  return (stat_info[id].models & active_model) != 0;
+}
+
+static double ratio(unsigned long long num, unsigned long long den) {
+  return den ? (double)num / den : 0.0;
+}
+
+void stats_reset(int model) {
+  active_model = model;
+  std::memset(stats, 0, sizeof(stats));
+  std::memset(interval_prev, 0, sizeof(interval_prev));
+  stats_next_interval = interval_len;
+}
+
+const char *stat_name(int id) {
+  return (id >= 0 && id < NUM_STATS) ? stat_info[id].name : "?";
+}
+
+// Every `cycles` cycles a CSV row with the cycle the interval ended at
+// and the counter deltas of the interval is appended to file_name.
+void stats_set_interval(unsigned long long cycles, const char *file_name) {
+  interval_fp = std::fopen(file_name, "w");
+  if (interval_fp == nullptr) {
+    std::printf("Error opening %s for writing\n", file_name);
+    std::exit(1);
+  }
+  interval_len = cycles;
+  stats_next_interval = cycles;
+  interval_rows = 0;
+}
+
+void stats_dump_interval() {
+  if (interval_fp == nullptr)
+    return;
+  // The columns depend on the model, which is known once it has reset
+  if (interval_rows++ == 0) {
+    std::fprintf(interval_fp, "end_cycle,");
+    for (int i = 0; i < NUM_STATS; i++)
+      if (stat_active(i)) std::fprintf(interval_fp, "%s,", stat_info[i].name);
+    std::fprintf(interval_fp, "cpi\n");
+  }
+  std::fprintf(interval_fp, "%llu,", stats[STAT_CYCLES]);
+  for (int i = 0; i < NUM_STATS; i++)
+    if (stat_active(i)) std::fprintf(interval_fp, "%llu,", stats[i] - interval_prev[i]);
+  std::fprintf(interval_fp, "%.4f\n",
+               ratio(stats[STAT_CYCLES] - interval_prev[STAT_CYCLES],
+                     stats[STAT_INSTRS] - interval_prev[STAT_INSTRS]));
+  std::memcpy(interval_prev, stats, sizeof(stats));
+  stats_next_interval += interval_len;
+}
+
+void stats_print() {
+  std::printf("\n=== STATISTICS ===\n");
+  for (int i = 0; i < NUM_STATS; i++)
+    if (stat_active(i)) std::printf("%-18s %llu\n", stat_info[i].name, stats[i]);
+  std::printf("CPI = %.2f\n", ratio(stats[STAT_CYCLES], stats[STAT_INSTRS]));
+  std::printf("IPC = %.2f\n", ratio(stats[STAT_INSTRS], stats[STAT_CYCLES]));
+  for (int i = 0; i < MAX_ISSUE_WIDTH && stats[STAT_ISSUE_SLOT + i]; i++)
+    std::printf("slot %d utilization = %.1f%%\n", i,
+                100.0 * ratio(stats[STAT_ISSUE_SLOT + i], stats[STAT_CYCLES]));
+
+  // Flush the partial last interval so the rows cover the whole run
+  if (interval_fp != nullptr) {
+    if (stats[STAT_CYCLES] != interval_prev[STAT_CYCLES])
+      stats_dump_interval();
+    std::fclose(interval_fp);
+    interval_fp = nullptr;
+  }
+}
+
+void stats_write_json(const char *file_name) {
+  FILE *fp = std::fopen(file_name, "w");
+  if (fp == nullptr) {
+    std::printf("Error opening %s for writing\n", file_name);
+    return;
+  }
+  std::fprintf(fp, "{\n");
+  for (int i = 0; i < NUM_STATS; i++)
+    if (stat_active(i)) std::fprintf(fp, "  \"%s\": %llu,\n", stat_info[i].name, stats[i]);
+  std::fprintf(fp, "  \"cpi\": %.4f,\n", ratio(stats[STAT_CYCLES], stats[STAT_INSTRS]));
+  std::fprintf(fp, "  \"ipc\": %.4f\n", ratio(stats[STAT_INSTRS], stats[STAT_CYCLES]));
+  std::fprintf(fp, "}\n");
+  std::fclose(fp);
+}
+
+void stats_write_csv(const char *file_name) {
+  FILE *fp = std::fopen(file_name, "w");
+  if (fp == nullptr) {
+    std::printf("Error opening %s for writing\n", file_name);
+    return;
+  }
+  std::fprintf(fp, "counter,value\n");
+  for (int i = 0; i < NUM_STATS; i++)
+    if (stat_active(i)) std::fprintf(fp, "%s,%llu\n", stat_info[i].name, stats[i]);
+  std::fprintf(fp, "cpi,%.4f\n", ratio(stats[STAT_CYCLES], stats[STAT_INSTRS]));
+  std::fprintf(fp, "ipc,%.4f\n", ratio(stats[STAT_INSTRS], stats[STAT_CYCLES]));
+  std::fclose(fp);
+}
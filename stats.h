@@ -0,0 +1,77 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "myRISCVSim.h"
+
+// Counter registry of the timing models. Every counter has a fixed slot
+// and a dotted name used in the JSON/CSV output (see stats.cpp).
+enum StatId {
+  STAT_CYCLES,
+  STAT_INSTRS,              // Retired instructions
+  STAT_RETIRED_CLASS,       // Retired instructions per InstrClass
+  STAT_STALL_DATA = STAT_RETIRED_CLASS + NUM_INSTR_CLASSES,
+  STAT_STALL_CONTROL,       // Issue slots lost to mispredictions: penalty cycles x width
+  STAT_DATA_HAZARDS,
+  STAT_CONTROL_HAZARDS,     // Branches and jumps resolved
+  STAT_FLUSHES,
+  STAT_FLUSHED_INSTRS,
+  STAT_BP_LOOKUPS,
+  STAT_BP_TAKEN,            // Lookups predicted taken
+  STAT_BP_MISPREDICTS,
+  STAT_ISSUE_SLOT,          // Instructions issued from each bundle slot
+  STAT_ISSUE_INTRA_DEP = STAT_ISSUE_SLOT + MAX_ISSUE_WIDTH,  // Bundles cut by a dependency inside them
+  STAT_ISSUE_STRUCTURAL,    // Bundles cut by the load/store or mul/div limit
+  STAT_STALL_EXECUTE,       // Cycles EX held a DIV/REM bundle
+  STAT_STALL_MEMORY,        // Cycles MEM held a load/store bundle
+  STAT_STALL_SYSCALL,       // Cycles decode waited for an ECALL to retire
+  STAT_SKIPPED_CYCLES,      // Idle cycles jumped over in bulk
+  STAT_OOO_ROB_OCCUPANCY,   // Sum over cycles of the ROB entries in use
+  STAT_OOO_STALL_ROB,       // Cycles dispatch was blocked by a full ROB
+  STAT_OOO_STALL_IQ,
+  STAT_OOO_STALL_LSQ,
+  STAT_OOO_STALL_FRONTEND,  // Cycles with nothing fetched to dispatch
+  STAT_OOO_LOAD_FORWARDS,   // Loads served by an older in-flight store
+  NUM_STATS
+};
+
+// Timing models that keep counters. Each counter is marked with the
+// models that own it, and the reports only list those of the model that
+// ran.
+enum StatModel {
+  STATS_PIPELINE = 1,
+  STATS_OOO = 2
+};
+
+extern unsigned long long stats[NUM_STATS];
+extern unsigned long long stats_next_interval;
+
+void stats_reset(int model);
+const char *stat_name(int id);
+void stats_set_interval(unsigned long long cycles, const char *file_name);
+void stats_dump_interval();
+void stats_print();
+void stats_write_json(const char *file_name);
+void stats_write_csv(const char *file_name);
+
+inline void stat_inc(int id, unsigned long long n = 1) {
+  stats[id] += n;
+}
+
+// Called once at the end of every simulated cycle
+inline void stats_end_cycle() {
+  if (++stats[STAT_CYCLES] == stats_next_interval)
+    stats_dump_interval();
+}
+
+// Cycles that can pass before the next interval dump is due
+inline unsigned long long stats_cycles_to_interval() {
+  return stats_next_interval ? stats_next_interval - stats[STAT_CYCLES] : ~0ULL;
+}
+
+// Ends n cycles at once; n must not exceed stats_cycles_to_interval()
+inline void stats_end_cycles(unsigned long long n) {
+  stats[STAT_CYCLES] += n - 1;
+  stats_end_cycle();
+}
+
+#endif
@@ -0,0 +1,193 @@
+/* syscall.cpp
+   ECALL system call layer. a7 selects an entry of the system call table,
+   a0-a2 carry the arguments and a0 receives the result, following the
+   Linux RISC-V convention. Program output is collected in a large host
+   buffer and written out when it fills, before a read from stdin and when
+   the program ends, so I/O-heavy programs do not make one host call per
+   write.
+*/
+
+#include "syscall.h"
+#include <cstdio>
+#include <cstring>
+
+#define OUT_BUF_SIZE (1 << 16)
+#define EFAULT 14
+#define EBADF  9
+#define ENOSYS 38
+
+int syscall_exit_code = 0;
+bool syscall_quiet = false;
+ReadLog *syscall_read_log = nullptr;
+
+static char out_buf[OUT_BUF_SIZE];
+static unsigned int out_len = 0;
+static unsigned int brk_start = DATA_OFFSET;
+static unsigned int brk_current = DATA_OFFSET;
+static std::string *capture = nullptr;
+
+typedef bool (*SyscallHandler)(unsigned int *R, unsigned char *mem, unsigned long long instret);
+
+struct Syscall {
+  unsigned int number;
+  const char *name;
+  SyscallHandler handler;
+};
+
+void syscall_reset(unsigned int data_end) {
+  brk_start = brk_current = (data_end + 7) & ~7u;
+  syscall_exit_code = 0;
+}
+
+void syscall_save(SyscallContext *c) {
+  c->brk_start = brk_start;
+  c->brk_current = brk_current;
+  c->exit_code = syscall_exit_code;
+  c->output = capture;
+}
+
+void syscall_restore(const SyscallContext *c) {
+  brk_start = c->brk_start;
+  brk_current = c->brk_current;
+  syscall_exit_code = c->exit_code;
+  capture = c->output;
+}
+
+void syscall_flush() {
+  if (out_len != 0) {
+    std::fwrite(out_buf, 1, out_len, stdout);
+    out_len = 0;
+  }
+  std::fflush(stdout);
+}
+
+static bool sys_exit(unsigned int *R, unsigned char *, unsigned long long) {
+  syscall_exit_code = (int)R[10];
+  syscall_flush();
+  return false;
+}
+
+// write(fd, buf, count); stdout is buffered, stderr goes straight out
+static bool sys_write(unsigned int *R, unsigned char *mem, unsigned long long) {
+  unsigned int fd = R[10], len = R[12];
+  int idx = mem_index(R[11], len);
+  if (idx < 0) {
+    R[10] = (unsigned int)-EFAULT;
+    return true;
+  }
+  if (syscall_quiet && (fd == 1 || fd == 2)) {
+    R[10] = len;
+    return true;
+  }
+  if (capture != nullptr && (fd == 1 || fd == 2)) {
+    capture->append(reinterpret_cast<char*>(mem + idx), len);
+  } else if (fd == 1) {
+    if (trace_enabled) {
+      // Keep the output in order with the stage trace
+      std::fwrite(mem + idx, 1, len, stdout);
+    } else {
+      if (out_len + len > OUT_BUF_SIZE) syscall_flush();
+      if (len > OUT_BUF_SIZE)
+        std::fwrite(mem + idx, 1, len, stdout);
+      else {
+        std::memcpy(out_buf + out_len, mem + idx, len);
+        out_len += len;
+      }
+    }
+  } else if (fd == 2) {
+    syscall_flush();
+    std::fwrite(mem + idx, 1, len, stderr);
+  } else {
+    R[10] = (unsigned int)-EBADF;
+    return true;
+  }
+  R[10] = len;
+  return true;
+}
+
+// read(fd, buf, count) from stdin; returns at most one line, like a
+// terminal read
+static bool sys_read(unsigned int *R, unsigned char *mem, unsigned long long instret) {
+  unsigned int len = R[12];
+  int idx = mem_index(R[11], len);
+  if (R[10] != 0) {
+    R[10] = (unsigned int)-EBADF;
+    return true;
+  }
+  if (idx < 0) {
+    R[10] = (unsigned int)-EFAULT;
+    return true;
+  }
+  if (capture != nullptr) {
+    R[10] = 0;
+    return true;
+  }
+  if (syscall_read_log != nullptr) {
+    ReadLog::const_iterator it = syscall_read_log->find(instret);
+    if (it != syscall_read_log->end()) {
+      unsigned int n = (it->second.size() < len) ? (unsigned int)it->second.size() : len;
+      std::memcpy(mem + idx, it->second.data(), n);
+      R[10] = n;
+      return true;
+    }
+  }
+  syscall_flush();
+  unsigned int n = 0;
+  while (n < len) {
+    int c = std::fgetc(stdin);
+    if (c == EOF) break;
+    mem[idx + n++] = (unsigned char)c;
+    if (c == '\n') break;
+  }
+  if (syscall_read_log != nullptr)
+    (*syscall_read_log)[instret].assign(reinterpret_cast<char*>(mem + idx), n);
+  R[10] = n;
+  return true;
+}
+
+// brk(addr); the heap grows from the end of the loaded data up to the end
+// of the data segment. Returns the new break, or the old one on failure.
+static bool sys_brk(unsigned int *R, unsigned char *, unsigned long long) {
+  unsigned int want = R[10];
+  if (want >= brk_start && want <= DATA_OFFSET + (MEM_SIZE - TEXT_SIZE))
+    brk_current = want;
+  R[10] = brk_current;
+  return true;
+}
+
+// clock_gettime64(clock, tp); simulated time advances 1 ns per
+// instruction, so the reading is the same on every run. tp is the kernel's
+// 64-bit timespec, {s64 sec, s64 nsec}.
+static bool sys_clock_gettime64(unsigned int *R, unsigned char *mem, unsigned long long instret) {
+  int idx = mem_index(R[11], 16);
+  if (idx < 0) {
+    R[10] = (unsigned int)-EFAULT;
+    return true;
+  }
+  unsigned long long ts[2] = {instret / 1000000000ULL, instret % 1000000000ULL};
+  std::memcpy(mem + idx, ts, sizeof(ts));
+  R[10] = 0;
+  return true;
+}
+
+static const Syscall syscall_table[] = {
+  {SYS_READ,             "read",            sys_read},
+  {SYS_WRITE,            "write",           sys_write},
+  {SYS_EXIT,             "exit",            sys_exit},
+  {SYS_EXIT_GROUP,       "exit_group",      sys_exit},
+  {SYS_BRK,              "brk",             sys_brk},
+  {SYS_CLOCK_GETTIME64,  "clock_gettime64", sys_clock_gettime64}
+};
+
+bool syscall_dispatch(unsigned int *R, unsigned char *mem, unsigned long long instret) {
+  for (unsigned int i = 0; i < sizeof(syscall_table) / sizeof(syscall_table[0]); i++) {
+    if (syscall_table[i].number == R[17]) {
+      bool running = syscall_table[i].handler(R, mem, instret);
+      R[0] = 0;
+      return running;
+    }
+  }
+  std::fprintf(stderr, "Unknown system call %u\n", R[17]);
+  R[10] = (unsigned int)-ENOSYS;
+  return true;
+}
@@ -0,0 +1,61 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include "myRISCVSim.h"
+#include <map>
+#include <string>
+
+#define ECALL_INSTR 0x00000073
+
+// Linux RISC-V system call numbers of the rv32 ABI, passed in a7. rv32
+// only has the 64-bit time calls, so clock_gettime is clock_gettime64.
+#define SYS_READ             63
+#define SYS_WRITE            64
+#define SYS_EXIT             93
+#define SYS_EXIT_GROUP       94
+#define SYS_BRK             214
+#define SYS_CLOCK_GETTIME64 403
+
+// Exit status passed to the exit system call
+extern int syscall_exit_code;
+
+// Set while re-executing instructions that already ran, so write() does
+// not repeat their output
+extern bool syscall_quiet;
+
+// Bytes returned by each read(), keyed by the instruction count at its
+// ECALL. While set, a read() found in the log returns the logged bytes
+// instead of consuming stdin again, and other reads are added to it.
+typedef std::map<unsigned long long, std::string> ReadLog;
+extern ReadLog *syscall_read_log;
+
+// True if instr is an ECALL that will end the program
+inline bool ecall_exits(unsigned int instr, const unsigned int *R) {
+  return instr == ECALL_INSTR && (R[17] == SYS_EXIT || R[17] == SYS_EXIT_GROUP);
+}
+
+// Sets the initial program break just above the loaded data
+void syscall_reset(unsigned int data_end);
+
+// Runs the system call selected by a7 with arguments a0-a2 against the
+// memory image mem; instret drives the simulated clock. The result is
+// returned in a0. Returns false if the program exited.
+bool syscall_dispatch(unsigned int *R, unsigned char *mem, unsigned long long instret);
+
+// Writes out the program output buffered by write()
+void syscall_flush();
+
+// Per-program state of the layer, for a host that runs several programs
+// through it in turn (see serve.cpp). With output set, write() to stdout
+// or stderr appends there and read() sees end of file.
+struct SyscallContext {
+  unsigned int brk_start;
+  unsigned int brk_current;
+  int exit_code;
+  std::string *output;
+};
+
+void syscall_save(SyscallContext *c);
+void syscall_restore(const SyscallContext *c);
+
+#endif
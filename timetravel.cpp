@@ -0,0 +1,419 @@
+/* timetravel.cpp
+   Reverse execution on top of the fast interpreter. Going forward, every
+   instruction is recorded in a bounded undo log (old destination register,
+   old memory bytes) and a snapshot of the registers and memory is taken
+   every interval instructions. A snapshot copies only the pages written
+   since the previous one and shares the rest with it.
+
+   Stepping back within the undo log just undoes the entries. Anything
+   further back restores the nearest earlier snapshot and replays forward
+   with the fast interpreter; only the last stretch, which has to refill
+   the undo log, runs with recording. Snapshots also hold the system call
+   state (the program break), and replayed read()s return the input they
+   got the first time from a log instead of reading stdin again.
+*/
+
+#include "timetravel.h"
+#include "syscall.h"
+#include "fastdebug.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+static_assert(TT_NUM_PAGES <= 64, "dirty page mask holds 64 pages");
+
+struct Page {
+  unsigned char bytes[TT_PAGE_SIZE];
+};
+
+struct Snapshot {
+  unsigned long long instret;
+  unsigned int PC;
+  unsigned int R[32];
+  bool reserved;
+  unsigned int reserved_addr;
+  SyscallContext sys;
+  std::shared_ptr<const Page> pages[TT_NUM_PAGES];
+};
+
+// State before one recorded instruction
+struct UndoEntry {
+  unsigned long long instret;
+  unsigned int pc;
+  unsigned int rd_old;
+  unsigned char rd;
+  unsigned char mem_size;     // 0 if the instruction stored nothing
+  unsigned short mem_idx;
+  unsigned int mem_old;
+  bool reserved;
+  unsigned int reserved_addr;
+  bool exact;                 // False for an ECALL, whose memory writes are not logged
+};
+
+static std::vector<Snapshot> snapshots;
+static unsigned long long snap_interval = 0;
+static unsigned long long next_snapshot = 0;
+static unsigned long long dirty_pages = 0;  // Pages written since the last snapshot
+
+static std::vector<UndoEntry> undo_log;
+static unsigned int undo_head = 0;           // Next slot to fill
+static unsigned int undo_count = 0;
+
+// Furthest point ever executed; program output before it is not repeated
+static unsigned long long high_water = 0;
+
+// Input read by the program so far, returned again on replay
+static ReadLog read_log;
+
+static void mark_dirty(unsigned int idx, unsigned int size) {
+  for (unsigned int p = idx / TT_PAGE_SIZE; p <= (idx + size - 1) / TT_PAGE_SIZE; p++)
+    dirty_pages |= 1ULL << p;
+}
+
+static void take_snapshot(FastSim *s) {
+  Snapshot snap;
+  snap.instret = s->instret;
+  snap.PC = s->PC;
+  std::memcpy(snap.R, s->R, sizeof(snap.R));
+  snap.reserved = s->reserved;
+  snap.reserved_addr = s->reserved_addr;
+  syscall_save(&snap.sys);
+  const Snapshot *prev = snapshots.empty() ? nullptr : &snapshots.back();
+  for (unsigned int p = 0; p < TT_NUM_PAGES; p++) {
+    if (prev == nullptr || (dirty_pages & (1ULL << p))) {
+      std::shared_ptr<Page> page = std::make_shared<Page>();
+      std::memcpy(page->bytes, s->MEM + p * TT_PAGE_SIZE, TT_PAGE_SIZE);
+      snap.pages[p] = page;
+    } else {
+      snap.pages[p] = prev->pages[p];
+    }
+  }
+  snapshots.push_back(snap);
+  dirty_pages = 0;
+
+  // Too many snapshots: keep every other one and double the interval
+  if (snapshots.size() > TT_MAX_SNAPSHOTS) {
+    std::vector<Snapshot> kept;
+    for (size_t i = 0; i < snapshots.size(); i += 2)
+      kept.push_back(snapshots[i]);
+    snapshots.swap(kept);
+    snap_interval *= 2;
+  }
+  next_snapshot = snapshots.back().instret + snap_interval;
+}
+
+static void restore_snapshot(FastSim *s, const Snapshot &snap) {
+  for (unsigned int p = 0; p < TT_NUM_PAGES; p++)
+    std::memcpy(s->MEM + p * TT_PAGE_SIZE, snap.pages[p]->bytes, TT_PAGE_SIZE);
+  s->instret = snap.instret;
+  s->PC = snap.PC;
+  std::memcpy(s->R, snap.R, sizeof(snap.R));
+  s->reserved = snap.reserved;
+  s->reserved_addr = snap.reserved_addr;
+  syscall_restore(&snap.sys);
+  s->halted = s->fault = false;
+  s->stop = STOP_NONE;
+  fast_predecode(s);
+  // The newest snapshot may lie ahead of this point
+  dirty_pages = ~0ULL;
+  undo_count = 0;
+}
+
+// Latest snapshot taken at or before instret
+static const Snapshot &snapshot_before(unsigned long long instret) {
+  size_t k = snapshots.size() - 1;
+  while (k > 0 && snapshots[k].instret > instret)
+    k--;
+  return snapshots[k];
+}
+
+// Executes one instruction and logs how to undo it
+static bool record_step(FastSim *s) {
+  if (s->halted)
+    return false;
+  if (s->instret >= next_snapshot && s->instret > snapshots.back().instret)
+    take_snapshot(s);
+
+  UndoEntry &u = undo_log[undo_head];
+  u.instret = s->instret;
+  u.pc = s->PC;
+  u.rd = 0;
+  u.mem_size = 0;
+  u.reserved = s->reserved;
+  u.reserved_addr = s->reserved_addr;
+  u.exact = true;
+  if (s->PC < TEXT_SIZE && !(s->PC & 1)) {
+    const DecodedInstr &d = fast_decoded(s, s->PC);
+    u.rd = d.rd;
+    switch (d.op) {
+      case F_SB: u.mem_size = 1; break;
+      case F_SH: u.mem_size = 2; break;
+      case F_SW: case F_SC: case F_AMO: u.mem_size = 4; break;
+      case F_ECALL: u.rd = 10; u.exact = false; break;
+      default: break;
+    }
+    if (u.mem_size) {
+      int idx = mem_index(s->R[d.rs1] + d.imm, u.mem_size);
+      if (idx < 0) {
+        u.mem_size = 0;
+      } else {
+        u.mem_idx = (unsigned short)idx;
+        std::memcpy(&u.mem_old, s->MEM + idx, u.mem_size);
+      }
+    }
+  }
+  u.rd_old = s->R[u.rd];
+
+  syscall_quiet = s->instret < high_water;
+  RetireInfo ri;
+  bool ok = fast_step(s, &ri);
+  syscall_quiet = false;
+  if (!ok)
+    return false;
+
+  // A failed SC stores nothing
+  if (ri.mem_size == 0) u.mem_size = 0;
+  if (u.mem_size) mark_dirty(u.mem_idx, u.mem_size);
+  if (!u.exact) dirty_pages = ~0ULL;
+  undo_head = (undo_head + 1) % undo_log.size();
+  if (undo_count < undo_log.size()) undo_count++;
+  if (s->instret > high_water) high_water = s->instret;
+  return true;
+}
+
+// Reverts the newest undo log entry; returns false if it cannot be undone
+// exactly
+static bool undo_one(FastSim *s) {
+  unsigned int slot = (undo_head + undo_log.size() - 1) % undo_log.size();
+  const UndoEntry &u = undo_log[slot];
+  if (!u.exact)
+    return false;
+  undo_head = slot;
+  undo_count--;
+  s->R[u.rd] = u.rd_old;
+  s->R[0] = 0;
+  if (u.mem_size) {
+    std::memcpy(s->MEM + u.mem_idx, &u.mem_old, u.mem_size);
+    mark_dirty(u.mem_idx, u.mem_size);
+    unsigned int first = (u.mem_idx >= 2) ? (u.mem_idx - 2) & ~1u : 0;
+    for (unsigned int i = first; i < TEXT_SIZE && i < u.mem_idx + u.mem_size; i += 2)
+      s->code[i >> 1] = fast_decode_at(s->MEM, i);
+    if (s->num_breaks) fast_break_rearm(s);
+  }
+  s->PC = u.pc;
+  s->stop = STOP_NONE;
+  s->instret = u.instret;
+  s->reserved = u.reserved;
+  s->reserved_addr = u.reserved_addr;
+  return true;
+}
+
+void tt_start(FastSim *s, unsigned long long interval, unsigned int undo_entries) {
+  snapshots.clear();
+  snap_interval = interval;
+  dirty_pages = 0;
+  undo_log.assign(undo_entries, UndoEntry());
+  undo_head = undo_count = 0;
+  high_water = s->instret;
+  read_log.clear();
+  syscall_read_log = &read_log;
+  take_snapshot(s);
+}
+
+bool tt_step(FastSim *s, unsigned long long n) {
+  for (unsigned long long i = 0; i < n; i++) {
+    if (!record_step(s) || s->stop)
+      return false;
+  }
+  return true;
+}
+
+void tt_back(FastSim *s, unsigned long long n) {
+  unsigned long long target = (n > s->instret) ? 0 : s->instret - n;
+  // A stopped program did not change its state on the last attempt
+  s->halted = s->fault = false;
+  s->stop = STOP_NONE;
+  if (s->instret - target <= undo_count) {
+    while (s->instret > target) {
+      if (!undo_one(s))
+        break;
+    }
+    if (s->instret == target)
+      return;
+  }
+  tt_goto(s, target);
+}
+
+void tt_goto(FastSim *s, unsigned long long instret) {
+  if (instret >= s->instret) {
+    tt_step(s, instret - s->instret);
+    return;
+  }
+  restore_snapshot(s, snapshot_before(instret));
+  // Replay at full speed up to where the undo log has to start
+  unsigned long long log_start = (instret > undo_log.size()) ? instret - undo_log.size() : 0;
+  if (log_start > s->instret) {
+    syscall_quiet = true;
+    fast_run(s, log_start);
+    syscall_quiet = false;
+  }
+  tt_step(s, instret - s->instret);
+}
+
+bool tt_last_write(FastSim *s, unsigned int address) {
+  int idx = mem_index(address, 1);
+  if (idx < 0)
+    return false;
+
+  // The undo log covers the most recent instructions
+  for (unsigned int i = 0; i < undo_count; i++) {
+    const UndoEntry &u = undo_log[(undo_head + undo_log.size() - 1 - i) % undo_log.size()];
+    if (u.mem_size && idx >= u.mem_idx && idx < u.mem_idx + u.mem_size) {
+      tt_back(s, s->instret - u.instret);
+      return true;
+    }
+  }
+
+  // Before that, search one snapshot interval at a time, newest first
+  unsigned long long now = s->instret;
+  unsigned long long end = now - undo_count;
+  for (size_t k = snapshots.size(); k-- > 0;) {
+    if (snapshots[k].instret >= end)
+      continue;
+    // A page shared with the next snapshot was not written in between
+    if (k + 1 < snapshots.size() && snapshots[k + 1].instret <= end &&
+        snapshots[k + 1].pages[idx / TT_PAGE_SIZE] == snapshots[k].pages[idx / TT_PAGE_SIZE]) {
+      end = snapshots[k].instret;
+      continue;
+    }
+    restore_snapshot(s, snapshots[k]);
+    unsigned long long found = ~0ULL;
+    RetireInfo ri;
+    syscall_quiet = true;
+    while (s->instret < end) {
+      unsigned long long before = s->instret;
+      if (!fast_step(s, &ri))
+        break;
+      int w = ri.mem_size ? mem_index(ri.mem_addr, ri.mem_size) : -1;
+      if (w >= 0 && idx >= w && idx < w + (int)ri.mem_size)
+        found = before;
+    }
+    syscall_quiet = false;
+    if (found != ~0ULL) {
+      tt_goto(s, found);
+      return true;
+    }
+    end = snapshots[k].instret;
+  }
+  tt_goto(s, now);
+  return false;
+}
+
+static void print_position(FastSim *s, double ms) {
+  unsigned int instr = (s->PC < TEXT_SIZE && !(s->PC & 1)) ? s->code[s->PC >> 1].instr : 0;
+  std::printf("instret %llu, PC 0x%08X, instruction 0x%08X%s%s (%.3f ms)\n", s->instret, s->PC,
+              instr, s->halted && !s->fault ? ", exited" : "", s->fault ? ", FAULT" : "", ms);
+  fast_stop_report(s);
+}
+
+static void print_help() {
+  std::printf("  step [n]          execute n instructions (default 1)\n"
+              "  continue          run to the end of the program or a breakpoint\n"
+              "  back [n]          step back n instructions (default 1)\n"
+              "  goto <n>          go to the point after n instructions\n"
+              "  lastwrite <addr>  go back to the last instruction that wrote addr\n"
+              "  regs              print the registers\n"
+              "  mem <addr>        print the word at addr\n"
+              "  break <addr>      stop before the instruction at addr when going forward\n"
+              "  watch <addr>[:len][:r|w|rw]  stop after an access to the range\n"
+              "  delete            remove all breakpoints and watchpoints\n"
+              "  info              snapshot and undo log usage, breakpoints and watchpoints\n"
+              "  quit              dump the state and exit\n");
+}
+
+int run_timetravel(const char *file_name, unsigned long long interval, unsigned int undo_entries) {
+  static FastSim sim;
+  fast_reset(&sim);
+  fast_load(&sim, file_name);
+  if (!fast_debug_apply(&sim))
+    return 1;
+  tt_start(&sim, interval, undo_entries);
+  std::printf("Time travel: snapshot every %llu instructions, undo log of %u instructions; "
+              "type help for commands\n", interval, undo_entries);
+  print_position(&sim, 0.0);
+
+  char line[256];
+  for (;;) {
+    std::printf("(tt) ");
+    std::fflush(stdout);
+    if (std::fgets(line, sizeof(line), stdin) == nullptr)
+      break;
+    char cmd[32];
+    char arg[64] = "";
+    if (std::sscanf(line, "%31s %63s", cmd, arg) < 1)
+      continue;
+    bool has_arg = arg[0] != '\0';
+    unsigned long long n = has_arg ? std::strtoull(arg, nullptr, 0) : 1;
+
+    // Replays on the way back or to a given point ignore breakpoints and
+    // watchpoints
+    sim.debug_suspended = true;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (std::strcmp(cmd, "step") == 0 || std::strcmp(cmd, "s") == 0) {
+      sim.debug_suspended = false;
+      tt_step(&sim, n);
+    } else if (std::strcmp(cmd, "continue") == 0 || std::strcmp(cmd, "c") == 0) {
+      sim.debug_suspended = false;
+      tt_step(&sim, ~0ULL);
+    } else if (std::strcmp(cmd, "back") == 0 || std::strcmp(cmd, "b") == 0) {
+      tt_back(&sim, n);
+    } else if ((std::strcmp(cmd, "goto") == 0 || std::strcmp(cmd, "g") == 0) && has_arg) {
+      tt_goto(&sim, n);
+    } else if ((std::strcmp(cmd, "lastwrite") == 0 || std::strcmp(cmd, "w") == 0) && has_arg) {
+      if (!tt_last_write(&sim, (unsigned int)n))
+        std::printf("No earlier write to 0x%08X\n", (unsigned int)n);
+    } else if (std::strcmp(cmd, "regs") == 0 || std::strcmp(cmd, "r") == 0) {
+      for (int i = 0; i < 32; i++)
+        std::printf("R%-2d = %d%s", i, (int)sim.R[i], (i % 4 == 3) ? "\n" : "\t");
+      continue;
+    } else if ((std::strcmp(cmd, "mem") == 0 || std::strcmp(cmd, "x") == 0) && has_arg) {
+      if (mem_index((unsigned int)n, 4) < 0)
+        std::printf("Address 0x%08X is outside memory\n", (unsigned int)n);
+      else
+        std::printf("[0x%08X] = %d\n", (unsigned int)n,
+                    read_word(reinterpret_cast<char*>(sim.MEM), (unsigned int)n));
+      continue;
+    } else if ((std::strcmp(cmd, "break") == 0 || std::strcmp(cmd, "bp") == 0) && has_arg) {
+      if (!fast_break_set(&sim, (unsigned int)n))
+        std::printf("Cannot set a breakpoint at 0x%08X\n", (unsigned int)n);
+      continue;
+    } else if (std::strcmp(cmd, "watch") == 0 && has_arg) {
+      unsigned int addr, len;
+      int kind;
+      if (!parse_watch(arg, &addr, &len, &kind) || !fast_watch_set(&sim, addr, len, kind))
+        std::printf("Cannot watch %s\n", arg);
+      continue;
+    } else if (std::strcmp(cmd, "delete") == 0) {
+      fast_debug_clear(&sim);
+      continue;
+    } else if (std::strcmp(cmd, "info") == 0) {
+      std::printf("%zu snapshots every %llu instructions, undo log %u of %zu\n",
+                  snapshots.size(), snap_interval, undo_count, undo_log.size());
+      fast_debug_list(&sim);
+      continue;
+    } else if (std::strcmp(cmd, "quit") == 0 || std::strcmp(cmd, "q") == 0) {
+      break;
+    } else {
+      print_help();
+      continue;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    print_position(&sim, elapsed.count());
+  }
+
+  fast_dump(&sim);
+  return sim.fault ? 1 : syscall_exit_code;
+}
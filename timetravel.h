@@ -0,0 +1,37 @@
+#ifndef TIMETRAVEL_H
+#define TIMETRAVEL_H
+
+#include "fastsim.h"
+
+// Snapshot memory is shared page by page between snapshots; only pages
+// written since the previous snapshot are copied
+#define TT_PAGE_SIZE     256
+#define TT_NUM_PAGES     (MEM_SIZE / TT_PAGE_SIZE)
+#define TT_MAX_SNAPSHOTS 256
+
+// Starts recording s, which must be freshly loaded. A snapshot is taken
+// every interval instructions; the undo log holds the last undo_entries
+// instructions.
+void tt_start(FastSim *s, unsigned long long interval, unsigned int undo_entries);
+
+// Executes up to n instructions forward, recording them. Returns false if
+// the program stopped first.
+bool tt_step(FastSim *s, unsigned long long n);
+
+// Moves back n instructions
+void tt_back(FastSim *s, unsigned long long n);
+
+// Moves to the point where instret instructions have executed, or to the
+// end of the program if it stops earlier
+void tt_goto(FastSim *s, unsigned long long instret);
+
+// Moves back to the last instruction before the current point that wrote
+// the byte at address, leaving that instruction unexecuted. Returns false
+// and stays put if there is none.
+bool tt_last_write(FastSim *s, unsigned int address);
+
+// Interactive time-travel session over file_name, driven by commands on
+// stdin
+int run_timetravel(const char *file_name, unsigned long long interval, unsigned int undo_entries);
+
+#endif
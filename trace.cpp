@@ -0,0 +1,226 @@
+/* trace.cpp
+   Recording and reading of retired-instruction traces (see trace.h).
+
+   File layout, all fields little-endian:
+     u32 magic, u32 version, u32 text bytes stored, u32 end PC,
+     u64 instructions, u64 payload bytes, the text, the payload.
+   The payload is walked along with the text from PC 0. Per instruction:
+     branch         one bit, taken; bits are packed eight to a byte, the
+                    byte being placed where the first of them falls
+     JALR           varint target
+     load/store/AMO varint zigzag delta from the last address at that PC
+     anything else  nothing
+*/
+
+#include "trace.h"
+#include "fastsim.h"
+#include "syscall.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static std::vector<unsigned char> payload;
+static size_t bit_byte;             // Payload byte collecting branch outcomes
+static int bit_count;               // Outcomes already in it
+static unsigned int last_addr[TEXT_SIZE / 2];
+
+static bool is_mem_op(unsigned int opcode) {
+  return opcode == 0x03 || opcode == 0x23 || opcode == 0x2F;
+}
+
+static void put_varint(unsigned int v) {
+  while (v >= 0x80) {
+    payload.push_back((unsigned char)(v | 0x80));
+    v >>= 7;
+  }
+  payload.push_back((unsigned char)v);
+}
+
+static void put_bit(bool b) {
+  if (bit_count == 8) {
+    bit_byte = payload.size();
+    payload.push_back(0);
+    bit_count = 0;
+  }
+  if (b) payload[bit_byte] |= (unsigned char)(1 << bit_count);
+  bit_count++;
+}
+
+static void put_entry(unsigned int pc, unsigned int instr, unsigned int next_pc,
+                      unsigned int addr, bool taken) {
+  unsigned int opcode = OPCODE(instr);
+  if (opcode == 0x63) {
+    put_bit(taken);
+  } else if (opcode == 0x67) {
+    put_varint(next_pc);
+  } else if (is_mem_op(opcode)) {
+    int delta = (int)(addr - last_addr[pc >> 1]);
+    put_varint(((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31));
+    last_addr[pc >> 1] = addr;
+  }
+}
+
+static void put_u32(FILE *fp, unsigned int v) {
+  std::fwrite(&v, 4, 1, fp);
+}
+
+static void put_u64(FILE *fp, unsigned long long v) {
+  std::fwrite(&v, 8, 1, fp);
+}
+
+int trace_record(const char *file_name, const char *trace_file, unsigned long long max_instrs) {
+  static FastSim sim;
+  FastSim *s = &sim;
+  fast_reset(s);
+  fast_load(s, file_name);
+
+  unsigned char text[TEXT_SIZE];
+  std::memcpy(text, s->MEM, TEXT_SIZE);
+  payload.clear();
+  bit_count = 8;
+  std::memset(last_addr, 0, sizeof(last_addr));
+
+  RetireInfo ri;
+  while (max_instrs == 0 || s->instret < max_instrs) {
+    // The effective address and branch outcome come from the registers
+    // before the instruction runs
+    unsigned int a = 0, b = 0, imm = 0;
+    if (s->PC < TEXT_SIZE && !(s->PC & 1)) {
+      const DecodedInstr &d = fast_decoded(s, s->PC);
+      a = s->R[d.rs1];
+      b = s->R[d.rs2];
+      imm = (unsigned int)d.imm;
+    }
+    if (!fast_step(s, &ri))
+      break;
+    put_entry(ri.pc, ri.instr, ri.next_pc, a + imm, branch_taken(ri.instr, a, b));
+  }
+  syscall_flush();
+
+  if (std::memcmp(text, s->MEM, TEXT_SIZE) != 0) {
+    std::printf("The program modified its text; no trace written\n");
+    return 1;
+  }
+  FILE *fp = std::fopen(trace_file, "wb");
+  if (fp == nullptr) {
+    std::printf("Error opening trace file %s\n", trace_file);
+    return 1;
+  }
+  unsigned int text_bytes = TEXT_SIZE;
+  while (text_bytes > 0 && text[text_bytes - 1] == 0)
+    text_bytes--;
+  put_u32(fp, TRACE_MAGIC);
+  put_u32(fp, TRACE_VERSION);
+  put_u32(fp, text_bytes);
+  put_u32(fp, s->PC);
+  put_u64(fp, s->instret);
+  put_u64(fp, payload.size());
+  std::fwrite(text, 1, text_bytes, fp);
+  if (!payload.empty())
+    std::fwrite(&payload[0], 1, payload.size(), fp);
+  std::fclose(fp);
+
+  unsigned long long bytes = 32 + text_bytes + payload.size();
+  std::printf("Trace: %llu instructions, %llu bytes (%.3f bytes per instruction) written to %s\n",
+              s->instret, bytes, s->instret ? (double)bytes / s->instret : 0.0, trace_file);
+  if (s->fault)
+    std::printf("FAULT at PC 0x%08X\n", s->PC);
+  return s->fault ? 1 : syscall_exit_code;
+}
+
+// Reader over the payload of one trace file
+struct PayloadReader {
+  const unsigned char *p;
+  const unsigned char *end;
+  unsigned int bits;
+  int bit_count;
+};
+
+static void malformed(const char *trace_file) {
+  std::printf("Malformed trace file %s\n", trace_file);
+  std::exit(1);
+}
+
+static bool get_varint(PayloadReader *r, unsigned int *v) {
+  *v = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (r->p == r->end) return false;
+    unsigned char byte = *r->p++;
+    *v |= (unsigned int)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+static bool get_bit(PayloadReader *r, bool *b) {
+  if (r->bit_count == 8) {
+    if (r->p == r->end) return false;
+    r->bits = *r->p++;
+    r->bit_count = 0;
+  }
+  *b = (r->bits >> r->bit_count++) & 1;
+  return true;
+}
+
+void trace_read(const char *trace_file, Trace *t) {
+  FILE *fp = std::fopen(trace_file, "rb");
+  if (fp == nullptr) {
+    std::printf("Error opening trace file %s\n", trace_file);
+    std::exit(1);
+  }
+  unsigned int header[4];
+  unsigned long long count, payload_bytes;
+  if (std::fread(header, 4, 4, fp) != 4 || std::fread(&count, 8, 1, fp) != 1 ||
+      std::fread(&payload_bytes, 8, 1, fp) != 1 || header[0] != TRACE_MAGIC ||
+      header[1] != TRACE_VERSION || header[2] > TEXT_SIZE)
+    malformed(trace_file);
+
+  std::memset(t->text, 0, sizeof(t->text));
+  std::vector<unsigned char> data(payload_bytes);
+  if (std::fread(t->text, 1, header[2], fp) != header[2] ||
+      (payload_bytes && std::fread(&data[0], 1, payload_bytes, fp) != payload_bytes))
+    malformed(trace_file);
+  std::fclose(fp);
+  t->end_pc = header[3];
+
+  PayloadReader r;
+  r.p = payload_bytes ? &data[0] : nullptr;
+  r.end = r.p + payload_bytes;
+  r.bit_count = 8;
+  std::memset(last_addr, 0, sizeof(last_addr));
+  t->entries.resize(count);
+
+  unsigned int pc = 0;
+  for (unsigned long long i = 0; i < count; i++) {
+    TraceEntry &e = t->entries[i];
+    unsigned int len;
+    unsigned int instr = trace_instr(t, pc, &len);
+    unsigned int opcode = OPCODE(instr);
+    unsigned int next_pc = pc + len;
+    bool taken = false;
+    unsigned int v;
+    if (pc >= TEXT_SIZE || (pc & 1))
+      malformed(trace_file);
+
+    e.pc = pc;
+    e.addr = 0;
+    if (opcode == 0x63) {
+      if (!get_bit(&r, &taken)) malformed(trace_file);
+      if (taken) next_pc = pc + imm_b(instr);
+    } else if (opcode == 0x6F) {
+      taken = true;
+      next_pc = pc + imm_j(instr);
+    } else if (opcode == 0x67) {
+      if (!get_varint(&r, &next_pc)) malformed(trace_file);
+      taken = true;
+    } else if (is_mem_op(opcode)) {
+      if (!get_varint(&r, &v)) malformed(trace_file);
+      e.addr = last_addr[pc >> 1] + ((v >> 1) ^ (0u - (v & 1)));
+      last_addr[pc >> 1] = e.addr;
+    }
+    e.taken = taken;
+    pc = next_pc;
+  }
+  if (pc != t->end_pc || r.p != r.end)
+    malformed(trace_file);
+}
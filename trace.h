@@ -0,0 +1,52 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "myRISCVSim.h"
+#include "rvc.h"
+#include <cstring>
+#include <vector>
+
+// Retired-instruction traces. A trace stores the program text once; the
+// instruction at each PC comes from the text, so per instruction the file
+// only holds what the text cannot tell: the outcome of a branch, the
+// target of a JALR and the effective address of a load, store or atomic
+// (as a delta from the previous address of the same instruction).
+
+#define TRACE_MAGIC   0x52545652   // "RVTR"
+#define TRACE_VERSION 1
+
+// One retired instruction
+struct TraceEntry {
+  unsigned int pc;
+  unsigned int addr;          // Effective address of a load, store or atomic, else 0
+  unsigned char taken;        // A branch that was taken, or a jump
+};
+
+// A decompressed trace, shared read-only by everything that replays it
+struct Trace {
+  unsigned char text[TEXT_SIZE + 4];  // Text segment, padded for 32-bit fetches
+  std::vector<TraceEntry> entries;
+  unsigned int end_pc;        // PC the program stopped at (normally the exit word)
+};
+
+// Runs file_name on the fast interpreter for up to max_instrs instructions
+// (0 for no limit) and writes its trace to trace_file. Returns the exit
+// status of the program, or 1 if it faulted or modified its text.
+int trace_record(const char *file_name, const char *trace_file, unsigned long long max_instrs);
+
+// Reads and decompresses trace_file into t. Exits on a malformed file.
+void trace_read(const char *trace_file, Trace *t);
+
+// Instruction of the traced program at pc, expanded if compressed; 0
+// outside the text segment, like the pipeline model's fetch
+inline unsigned int trace_instr(const Trace *t, unsigned int pc, unsigned int *len) {
+  unsigned int parcel;
+  if (pc >= TEXT_SIZE) {
+    *len = 4;
+    return 0;
+  }
+  std::memcpy(&parcel, t->text + pc, 4);
+  return rvc_fetch(parcel, len);
+}
+
+#endif